@@ -0,0 +1,289 @@
+// End-to-end benchmark: runs ./main over a fixed matrix of scenes,
+// resolutions and max_t_count values, each run in its own process pinned to
+// the first `threads` CPUs. Host wall time, peak RSS, simulated cycles, FPS
+// and PSNR are compared against a checked-in baseline with tolerances.
+//
+// Usage: ./bench-e2e [--baseline Bench/e2e_baseline.json] [--main ./main]
+//                    [--threads n] [--repetitions n] [--filter substring]
+//                    [--update] [--json e2e.json] [--log-dir e2e_logs]
+// Exits with 1 when a run failed, has no recorded baseline or a metric
+// regressed beyond its tolerance. --update records the current results as
+// the baseline.
+#include <nlohmann/json.hpp>
+
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Options {
+    std::string baseline_path = "Bench/e2e_baseline.json";
+    std::string main_path = "./main";
+    std::string json_path = "e2e.json";
+    std::string log_dir = "e2e_logs";
+    std::string filter;
+    int threads = 1;
+    int repetitions = 3;
+    bool update = false;
+};
+
+struct Run {
+    std::string name;
+    std::string scene;
+    int frequency;
+    int resolution;
+    int max_t_count;
+};
+
+struct Measurement {
+    double host_time_s = 0.0;   // Median over repetitions
+    double peak_rss_mb = 0.0;   // Largest over repetitions
+    double cycles = 0.0;
+    double fps = 0.0;
+    double psnr_db = 0.0;
+    bool has_psnr = false;
+};
+
+// Which way a metric regresses, and whether its tolerance is relative
+struct Metric {
+    const char* name;
+    bool higher_is_worse;
+    bool relative;
+};
+const Metric METRICS[] = {
+    {"host_time_s", true, true},
+    {"peak_rss_mb", true, true},
+    {"cycles", true, true},
+    {"fps", false, true},
+    {"psnr_db", false, false}
+};
+
+double value(const Measurement& m, const std::string& metric) {
+    if (metric == "host_time_s") return m.host_time_s;
+    if (metric == "peak_rss_mb") return m.peak_rss_mb;
+    if (metric == "cycles") return m.cycles;
+    if (metric == "fps") return m.fps;
+    return m.psnr_db;
+}
+
+std::vector<Run> buildMatrix(const nlohmann::json& matrix) {
+    std::vector<Run> runs;
+    int frequency = matrix.at("frequency");
+    for (const std::string scene : matrix.at("scenes")) {
+        for (int resolution : matrix.at("resolutions")) {
+            for (int max_t_count : matrix.at("max_t_counts")) {
+                std::string name = scene + "-" + std::to_string(resolution) + "-" + std::to_string(max_t_count);
+                runs.push_back(Run{name, scene, frequency, resolution, max_t_count});
+            }
+        }
+    }
+    return runs;
+}
+
+// One run of ./main in a child process. Returns false when it failed.
+bool runOnce(const Options& options, const Run& run, double& seconds, double& rss_mb) {
+    std::string log_path = options.log_dir + "/" + run.name + ".log";
+    std::vector<std::string> args = {
+        options.main_path, run.scene, std::to_string(run.frequency), std::to_string(run.max_t_count),
+        "--resolution", std::to_string(run.resolution)
+    };
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid < 0) {
+        puts("Error: fork failed");
+        exit(1);
+    }
+    if (pid == 0) {
+        // Pin the run and its OpenMP threads to the first CPUs
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for (int c = 0; c < options.threads; c++) CPU_SET(c, &cpus);
+        sched_setaffinity(0, sizeof(cpus), &cpus);
+        setenv("OMP_NUM_THREADS", std::to_string(options.threads).c_str(), 1);
+        setenv("OMP_PROC_BIND", "close", 1);
+        setenv("OMP_PLACES", "cores", 1);
+        int fd = open(log_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0) {
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+            close(fd);
+        }
+        std::vector<char*> argv;
+        for (std::string& arg : args) argv.push_back(&arg[0]);
+        argv.push_back(nullptr);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    int status;
+    struct rusage usage;
+    wait4(pid, &status, 0, &usage);
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    rss_mb = usage.ru_maxrss / 1024.0;  // KiB on Linux
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        printf("Error: [%s] failed, see [%s]\n", run.name.c_str(), log_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool measure(const Options& options, const Run& run, Measurement& m) {
+    // The run report main writes next to the text history, never a stale one
+    std::string report_path = "History_" + std::to_string(run.frequency) + "MHz_" + run.scene + ".json";
+    remove(report_path.c_str());
+    std::vector<double> times;
+    for (int r = 0; r < options.repetitions; r++) {
+        double seconds, rss_mb;
+        if (!runOnce(options, run, seconds, rss_mb)) return false;
+        times.push_back(seconds);
+        m.peak_rss_mb = std::max(m.peak_rss_mb, rss_mb);
+    }
+    std::sort(times.begin(), times.end());
+    m.host_time_s = times[times.size() / 2];
+
+    std::ifstream fin(report_path);
+    if (!fin) {
+        printf("Error: [%s] wrote no report [%s]\n", run.name.c_str(), report_path.c_str());
+        return false;
+    }
+    nlohmann::json report;
+    fin >> report;
+    m.cycles = report.at("cycle_count").get<double>();
+    m.fps = report.at("fps").get<double>();
+    if (report.contains("quality")) {
+        m.psnr_db = report["quality"].at("psnr_db").get<double>();
+        m.has_psnr = true;
+    }
+    return true;
+}
+
+// CPU model and thread count, recorded with the baseline since host time and
+// memory only compare on the same machine
+std::string describeMachine(int threads) {
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line, model = "unknown CPU";
+    while (std::getline(cpuinfo, line)) {
+        if (line.compare(0, 10, "model name") == 0 && line.find(':') != std::string::npos) {
+            model = line.substr(line.find(':') + 2);
+            break;
+        }
+    }
+    return model + ", " + std::to_string(threads) + " threads";
+}
+
+nlohmann::json toJson(const Measurement& m) {
+    nlohmann::json j = {
+        {"host_time_s", m.host_time_s},
+        {"peak_rss_mb", m.peak_rss_mb},
+        {"cycles", m.cycles},
+        {"fps", m.fps}
+    };
+    if (m.has_psnr) j["psnr_db"] = m.psnr_db;
+    return j;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--baseline" && i + 1 < argc) options.baseline_path = argv[++i];
+        else if (arg == "--main" && i + 1 < argc) options.main_path = argv[++i];
+        else if (arg == "--json" && i + 1 < argc) options.json_path = argv[++i];
+        else if (arg == "--log-dir" && i + 1 < argc) options.log_dir = argv[++i];
+        else if (arg == "--filter" && i + 1 < argc) options.filter = argv[++i];
+        else if (arg == "--threads" && i + 1 < argc) options.threads = std::stoi(argv[++i]);
+        else if (arg == "--repetitions" && i + 1 < argc) options.repetitions = std::stoi(argv[++i]);
+        else if (arg == "--update") options.update = true;
+        else {
+            printf("Unknown argument [%s]\n", arg.c_str());
+            exit(1);
+        }
+    }
+    if (options.threads < 1 || options.threads > CPU_SETSIZE || options.repetitions < 1) {
+        puts("Error: need at least one thread and one repetition");
+        exit(1);
+    }
+    nlohmann::json baseline;
+    std::ifstream fin(options.baseline_path);
+    if (!fin) {
+        printf("Cannot open baseline [%s]\n", options.baseline_path.c_str());
+        exit(1);
+    }
+    fin >> baseline;
+    fin.close();
+    mkdir(options.log_dir.c_str(), 0755);
+
+    const nlohmann::json& tolerances = baseline.at("tolerances");
+    nlohmann::json& recorded = baseline["baselines"];
+    if (recorded.is_null()) recorded = nlohmann::json::object();
+    nlohmann::json results;
+    results["threads"] = options.threads;
+    results["repetitions"] = options.repetitions;
+    int regressions = 0, failures = 0, missing = 0;
+
+    printf("%-22s %-12s %14s %14s %9s  %s\n", "Run", "Metric", "Baseline", "Current", "Delta", "Status");
+    for (const Run& run : buildMatrix(baseline.at("matrix"))) {
+        if (run.name.find(options.filter) == std::string::npos) continue;
+        Measurement m;
+        if (!measure(options, run, m)) {
+            failures++;
+            continue;
+        }
+        results["runs"][run.name] = toJson(m);
+        bool has_baseline = recorded.contains(run.name);
+        for (const Metric& metric : METRICS) {
+            if (std::string(metric.name) == "psnr_db" && !m.has_psnr) continue;
+            double current = value(m, metric.name);
+            if (!has_baseline || !recorded[run.name].contains(metric.name)) {
+                // Only rerecording may add a baseline, a gate without one cannot fail
+                printf("%-22s %-12s %14s %14.6g %9s  %s\n", run.name.c_str(), metric.name, "-", current, "-",
+                    options.update ? "NEW" : "MISSING");
+                missing++;
+                continue;
+            }
+            double base = recorded[run.name][metric.name].get<double>();
+            double tolerance = tolerances.value(metric.name, 0.0);
+            // Positive delta is the bad direction
+            double delta = metric.higher_is_worse ? current - base : base - current;
+            if (metric.relative) delta = base != 0.0 ? delta / std::abs(base) : 0.0;
+            const char* status = delta > tolerance ? "REGRESSED" : delta < -tolerance ? "IMPROVED" : "OK";
+            if (delta > tolerance) regressions++;
+            char delta_text[32];
+            double shown = metric.higher_is_worse ? delta : -delta;
+            if (metric.relative) snprintf(delta_text, sizeof(delta_text), "%+.2f%%", shown * 100);
+            else snprintf(delta_text, sizeof(delta_text), "%+.3f", shown);
+            printf("%-22s %-12s %14.6g %14.6g %9s  %s\n", run.name.c_str(), metric.name, base, current, delta_text, status);
+        }
+        if (options.update) recorded[run.name] = toJson(m);
+    }
+    results["regressions"] = regressions;
+    results["failures"] = failures;
+    results["missing"] = missing;
+    std::ofstream fout(options.json_path);
+    fout << results.dump(4) << "\n";
+    fout.close();
+    if (options.update) {
+        baseline["machine"] = describeMachine(options.threads);
+        fout.open(options.baseline_path);
+        fout << baseline.dump(4) << "\n";
+        fout.close();
+        printf("Baseline updated [%s]\n", options.baseline_path.c_str());
+    }
+    printf("%d regressions, %d failed runs, %d metrics without baseline, results written to [%s]\n",
+        regressions, failures, missing, options.json_path.c_str());
+    // Rerecording accepts the regressions and new runs it reports
+    return failures > 0 || ((regressions > 0 || missing > 0) && !options.update) ? 1 : 0;
+}
@@ -0,0 +1,300 @@
+// Microbenchmarks of the simulator's hot kernels. Inputs are random but
+// seeded, so two runs measure the same work and their JSON can be compared.
+//
+// Usage: ./bench [--filter substring] [--min-time seconds] [--repetitions n]
+//                [--seed n] [--json path]
+#include "hash.hpp"
+#include "mlp.hpp"
+#include "sh.hpp"
+#include "camera.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Options {
+    std::string filter;
+    double min_time_s = 0.2;   // Per repetition
+    int repetitions = 5;
+    unsigned seed = 0;
+    std::string json_path = "bench.json";
+};
+
+struct Result {
+    std::string name;
+    int items_per_op;
+    long long iterations;      // Per repetition
+    std::vector<double> ns_per_op;
+};
+
+// Inputs are cycled through in a power-of-two ring
+constexpr int NUM_INPUTS = 4096;
+
+// Results are summed into a sink so the work cannot be optimized away
+volatile float sink;
+
+class Runner {
+public:
+    explicit Runner(const Options& options): options(options) {}
+
+    // body(i) runs operation i and returns a value depending on its result
+    template <typename Body>
+    void run(const std::string& name, int items_per_op, Body&& body) {
+        if (name.find(options.filter) == std::string::npos) return;
+        // Double the iterations until one batch takes min_time
+        long long iterations = 1;
+        while (true) {
+            double seconds = time(body, iterations);
+            if (seconds >= options.min_time_s || iterations >= (1LL << 40)) break;
+            double growth = seconds > 0 ? std::min(options.min_time_s / seconds * 1.2, 100.0) : 100.0;
+            iterations = static_cast<long long>(iterations * std::max(growth, 2.0));
+        }
+        Result result{name, items_per_op, iterations, {}};
+        for (int r = 0; r < options.repetitions; r++) {
+            result.ns_per_op.push_back(time(body, iterations) * 1e9 / iterations);
+        }
+        results.push_back(result);
+        print(result);
+    }
+
+    void writeJson(const std::string& path) const {
+        nlohmann::json report;
+        report["seed"] = options.seed;
+        report["min_time_s"] = options.min_time_s;
+        report["repetitions"] = options.repetitions;
+        for (const Result& result : results) {
+            double ns = median(result.ns_per_op);
+            report["benchmarks"].push_back({
+                {"name", result.name},
+                {"items_per_op", result.items_per_op},
+                {"iterations", result.iterations},
+                {"ns_per_op", ns},
+                {"ns_per_op_min", *std::min_element(result.ns_per_op.begin(), result.ns_per_op.end())},
+                {"ns_per_op_max", *std::max_element(result.ns_per_op.begin(), result.ns_per_op.end())},
+                {"items_per_second", result.items_per_op * 1e9 / ns}
+            });
+        }
+        std::ofstream fout(path);
+        fout << report.dump(4) << "\n";
+        printf("Results written to [%s]\n", path.c_str());
+    }
+
+private:
+    const Options& options;
+    std::vector<Result> results;
+
+    template <typename Body>
+    static double time(Body& body, long long iterations) {
+        float sum = 0.0f;
+        auto start = std::chrono::steady_clock::now();
+        for (long long i = 0; i < iterations; i++) {
+            sum += body(static_cast<int>(i & (NUM_INPUTS - 1)));
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        sink = sum;
+        return seconds;
+    }
+    static double median(std::vector<double> values) {
+        std::sort(values.begin(), values.end());
+        return values[values.size() / 2];
+    }
+    static void print(const Result& result) {
+        double ns = median(result.ns_per_op);
+        double low = *std::min_element(result.ns_per_op.begin(), result.ns_per_op.end());
+        double high = *std::max_element(result.ns_per_op.begin(), result.ns_per_op.end());
+        printf("%-28s %12.2f ns/op  [%10.2f, %10.2f]  %14.0f items/s\n",
+            result.name.c_str(), ns, low, high, result.items_per_op * 1e9 / ns);
+        fflush(stdout);
+    }
+};
+
+std::vector<float> randomFloats(std::mt19937& rng, size_t n, float low, float high) {
+    std::uniform_real_distribution<float> dist(low, high);
+    std::vector<float> values(n);
+    for (float& v : values) v = dist(rng);
+    return values;
+}
+
+std::vector<Vec3f> randomPoints(std::mt19937& rng, float low, float high) {
+    std::vector<float> values = randomFloats(rng, NUM_INPUTS * 3, low, high);
+    std::vector<Vec3f> points(NUM_INPUTS);
+    for (int i = 0; i < NUM_INPUTS; i++) points[i] = Vec3f(values[3 * i], values[3 * i + 1], values[3 * i + 2]);
+    return points;
+}
+
+void benchHash(Runner& runner, const nlohmann::json& configs, std::mt19937& rng) {
+    const nlohmann::json& encoding = configs.at("encoding");
+    HashEncoding hash_enc(encoding);
+    hash_enc.loadParameters(randomFloats(rng, hash_enc.getNumParams(), -1e-2f, 1e-2f));
+    std::vector<Vec3f> points = randomPoints(rng, 0.0f, 1.0f);
+    runner.run(hash_enc.isSpecialized() ? "hash.encode (specialized)" : "hash.encode", 1, [&](int i) {
+        return hash_enc.encode(points[i])(0);
+    });
+    std::vector<float> packed(NUM_INPUTS * 3);
+    for (int i = 0; i < NUM_INPUTS; i++) std::copy(points[i].data(), points[i].data() + 3, &packed[3 * i]);
+    int n_features = hash_enc.getNumLevels() * hash_enc.getNumFeaturesPerLevel();
+    std::vector<float> features(MAX_LANES * n_features);
+    runner.run("hash.encodeBatch x16", MAX_LANES, [&](int i) {
+        hash_enc.encodeBatch(&packed[3 * (i & (NUM_INPUTS - MAX_LANES))], MAX_LANES, features.data());
+        return features[0];
+    });
+
+    // Each level on its own through the encoder's per-level path, with the
+    // grid of the loaded config
+    for (int level = 0; level < hash_enc.getNumLevels(); level++) {
+        runner.run("hash.level[" + std::to_string(level) + "]", 1, [&](int i) {
+            hash_enc.encodeLevel(level, points[i], features.data());
+            return features[level * hash_enc.getNumFeaturesPerLevel()];
+        });
+    }
+}
+
+void benchMLP(Runner& runner, const nlohmann::json& configs, std::mt19937& rng) {
+    std::vector<VecXf> inputs(NUM_INPUTS);
+    std::vector<float> values = randomFloats(rng, NUM_INPUTS * 32, -1.0f, 1.0f);
+    for (int i = 0; i < NUM_INPUTS; i++) inputs[i] = Eigen::Map<VecXf>(&values[32 * i], 32);
+    MatXf batch = Eigen::Map<MatXf>(values.data(), 32, MAX_LANES);
+    const std::pair<const char*, const char*> networks[] = {{"sigma", "network"}, {"color", "rgb_network"}};
+    for (auto& network : networks) {
+        MLP mlp(32, 16, configs.at(network.second));
+        mlp.loadParameters(randomFloats(rng, mlp.getNumParams(), -0.1f, 0.1f));
+        std::string name = std::string("mlp.") + network.first;
+        runner.run(name + ".inference", 1, [&](int i) {
+            return mlp.inference(inputs[i])(0);
+        });
+        runner.run(name + ".inferenceBatch x16", MAX_LANES, [&](int i) {
+            batch(0, 0) = values[i];
+            return mlp.inferenceBatch(batch)(0, 0);
+        });
+    }
+}
+
+void benchSH(Runner& runner, const nlohmann::json& configs, std::mt19937& rng) {
+    SHEncoding sh_enc(configs.at("dir_encoding").at("nested")[0]);
+    std::vector<Vec3f> dirs = randomPoints(rng, -1.0f, 1.0f);
+    for (Vec3f& dir : dirs) dir = (dir.normalized() + Vec3f(1, 1, 1)) / 2;
+    runner.run("sh.encode", 1, [&](int i) {
+        return sh_enc.encode(dirs[i])(0);
+    });
+    std::vector<float> x(NUM_INPUTS), y(NUM_INPUTS), z(NUM_INPUTS);
+    for (int i = 0; i < NUM_INPUTS; i++) x[i] = dirs[i].x(), y[i] = dirs[i].y(), z[i] = dirs[i].z();
+    std::vector<float> out(16 * MAX_LANES);
+    runner.run("sh.encodeBatch x16", MAX_LANES, [&](int i) {
+        int base = i & (NUM_INPUTS - MAX_LANES);
+        sh_enc.encodeBatch(&x[base], &y[base], &z[base], MAX_LANES, out.data());
+        return out[0];
+    });
+}
+
+void benchCamera(Runner& runner, std::mt19937& rng) {
+    // About 20% of the cells occupied, sampled over a margin around the grid
+    OccupancyGrid grid(128, -0.5, 1.5);
+    std::bernoulli_distribution occupied(0.2);
+    std::vector<int> cells(grid.getNumParams());
+    for (int& cell : cells) cell = occupied(rng);
+    grid.loadParameters(cells);
+    std::vector<Vec3f> points = randomPoints(rng, -0.1f, 1.1f);
+    runner.run("occupancy.isOccupy", 1, [&](int i) {
+        return static_cast<float>(grid.isOccupy(points[i]));
+    });
+
+    nlohmann::json frame;
+    frame["transform_matrix"] = {
+        {-0.9999, 0.0042, -0.0133, -0.0538},
+        {-0.0140, -0.2997, 0.9539, 3.8455},
+        {0.0, 0.9540, 0.2997, 1.2081},
+        {0.0, 0.0, 0.0, 1.0}
+    };
+    nlohmann::json camera_config;
+    camera_config["camera_angle_x"] = 0.6911112070083618;
+    camera_config["frames"] = nlohmann::json::array({frame});
+    std::shared_ptr<Image> img = std::make_shared<Image>(800, 800, false);
+    Camera camera(camera_config, img);
+    std::vector<float> pixels = randomFloats(rng, NUM_INPUTS * 2, 0.0f, 800.0f);
+    runner.run("camera.generateRay", 1, [&](int i) {
+        return camera.generateRay(std::floor(pixels[2 * i]), std::floor(pixels[2 * i + 1])).getDirection().x();
+    });
+}
+
+void benchFIFO(Runner& runner) {
+    // The producer writes and the consumer reads one entry per cycle, as
+    // between two pipeline stages; the cycle stamps replace update()
+    struct Entry {
+        int rayID;
+        int tag;
+        Packet<16> payload;
+    };
+    FIFO<Entry> fifo(4);
+    long long cycle = 0;
+    fifo.bind(&cycle, &cycle, false);
+    fifo.reset();
+    Entry entry{0, 0, Packet<16>::Zero(16, 1)};
+    runner.run("fifo.write+read", 1, [&](int i) {
+        cycle++;
+        float value = 0.0f;
+        if (!fifo.isEmpty()) value = fifo.read().payload(0, 0);
+        if (!fifo.isFull()) {
+            entry.tag = i;
+            fifo.write(entry);
+        }
+        return value;
+    });
+}
+
+void benchFP16(Runner& runner, std::mt19937& rng) {
+    std::vector<uint32_t> halves(NUM_INPUTS);
+    std::uniform_int_distribution<uint32_t> dist(0, 0x7BFF);
+    for (uint32_t& h : halves) h = dist(rng);
+    runner.run("fp16.decode", 1, [&](int i) {
+        return utils::from_int_to_float16(halves[i]);
+    });
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    std::string config_path = "./configs/base.json";
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--filter" && i + 1 < argc) options.filter = argv[++i];
+        else if (arg == "--min-time" && i + 1 < argc) options.min_time_s = std::stod(argv[++i]);
+        else if (arg == "--repetitions" && i + 1 < argc) options.repetitions = std::stoi(argv[++i]);
+        else if (arg == "--seed" && i + 1 < argc) options.seed = std::stoul(argv[++i]);
+        else if (arg == "--json" && i + 1 < argc) options.json_path = argv[++i];
+        else if (arg == "--config" && i + 1 < argc) config_path = argv[++i];
+        else {
+            printf("Unknown argument [%s]\n", arg.c_str());
+            exit(1);
+        }
+    }
+    if (options.repetitions < 1 || options.min_time_s <= 0) {
+        puts("Error: need at least one repetition and a positive minimum time");
+        exit(1);
+    }
+    nlohmann::json configs;
+    std::ifstream fin(config_path);
+    if (!fin) {
+        printf("Cannot open configs [%s]\n", config_path.c_str());
+        exit(1);
+    }
+    fin >> configs;
+
+    printf("%-28s %15s  %25s  %16s\n", "Benchmark", "Median", "[Min, Max]", "Throughput");
+    Runner runner(options);
+    std::mt19937 rng(options.seed);
+    benchHash(runner, configs, rng);
+    benchMLP(runner, configs, rng);
+    benchSH(runner, configs, rng);
+    benchCamera(runner, rng);
+    benchFIFO(runner);
+    benchFP16(runner, rng);
+    runner.writeJson(options.json_path);
+    return 0;
+}
@@ -1,4 +1,5 @@
 import os
+import json
 
 
 scenes = ["chair", "drums", "ficus", "hotdog", "lego", "materials", "mic", "ship"]
@@ -12,13 +13,10 @@ if __name__ == '__main__':
     for scene in scenes:
         os.system(f"./main {scene} {freq} {max_t}")
     for scene in scenes:
-        with open(f"./History_200MHz_{scene}.txt") as f:
-            lines = f.readlines()
-            fps_line = lines[6]
-            psnr_line = lines[9]
-            # FPS: xxxx
-            fps.append(float(fps_line.split(": ")[1].strip()))
-            psnrs.append(float(psnr_line.split(": ")[1].strip()))
+        with open(f"./History_{freq}MHz_{scene}.json") as f:
+            report = json.load(f)
+            fps.append(report["fps"])
+            psnrs.append(report["quality"]["psnr_db"])
             print(f"Scene: {scene}, FPS: {fps[-1]}")
     print(f"Mean FPS: {round(sum(fps) / len(fps), 4)}")
     print(f"Mean PSNR: {round(sum(psnrs) / len(psnrs), 4)}")
\ No newline at end of file
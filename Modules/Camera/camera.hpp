@@ -4,6 +4,7 @@
 #include "image.hpp"
 #include "ray.hpp"
 #include <fstream>
+#include <limits>
 
 class OccupancyGrid{
 public:
@@ -31,10 +32,11 @@ public:
         loadParameters(params);
     }
 
-    int isOccupy(Vec3f point){
+    int isOccupy(Vec3f point) const{
         
         for(int i = 0; i < 3; i++){
-            if (point(i) < 0.0f || point(i) > 1.0f){
+            // Upper bound is exclusive: 1.0 * 128 would index past the grid
+            if (point(i) < 0.0f || point(i) >= 1.0f){
                 return 0;
             }
         }
@@ -44,15 +46,65 @@ public:
         return grid[index];
     }
 
-    int getNumParams(){
+    // Coarser grids for skipping empty space, a level-k cell covers 2^k cells per axis
+    void buildMips(int levels){
+        mips.assign(levels + 1, std::vector<uint8_t>());
+        mips[0].resize(num_of_params);
+        for(int i = 0; i < num_of_params; i++){
+            mips[0][i] = grid[i] != 0;
+        }
+        for(int k = 1; k <= levels; k++){
+            int fine = resolution >> (k - 1), coarse = resolution >> k;
+            mips[k].assign(coarse * coarse * coarse, 0);
+            for(int x = 0; x < fine; x++){
+                for(int y = 0; y < fine; y++){
+                    for(int z = 0; z < fine; z++){
+                        if (mips[k - 1][(x * fine + y) * fine + z]){
+                            mips[k][(x / 2 * coarse + y / 2) * coarse + z / 2] = 1;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    int getMipLevels() const{
+        return mips.empty() ? 0 : static_cast<int>(mips.size()) - 1;
+    }
+    // Occupancy of the level-k cell holding point, 0 outside the grid
+    int isOccupyAt(int level, Vec3f point) const{
+        for(int i = 0; i < 3; i++){
+            if (point(i) < 0.0f || point(i) >= 1.0f){
+                return 0;
+            }
+        }
+        int r = resolution >> level;
+        Vec3f loc_vec = point * static_cast<float>(r);
+        return mips[level][(static_cast<int>(loc_vec.x()) * r + static_cast<int>(loc_vec.y())) * r +
+            static_cast<int>(loc_vec.z())];
+    }
+    // Distance along dir from point to the boundary of its level-k cell
+    float cellExit(int level, Vec3f point, Vec3f dir) const{
+        float cell = static_cast<float>(1 << level) / resolution;
+        float dist = std::numeric_limits<float>::max();
+        for(int i = 0; i < 3; i++){
+            if (dir(i) == 0.0f) continue;
+            float lower = std::floor(point(i) / cell) * cell;
+            float bound = dir(i) > 0.0f ? lower + cell : lower;
+            dist = std::min(dist, (bound - point(i)) / dir(i));
+        }
+        return std::max(dist, 0.0f);
+    }
+
+    int getNumParams() const{
         return num_of_params;
     }
-    int getResolution(){
+    int getResolution() const{
         return resolution;
     }
 
 private:
     std::vector<int> grid;
+    std::vector<std::vector<uint8_t>> mips;
     int resolution;
     int num_of_params;
     float aabb_l_f, aabb_r_f;
@@ -0,0 +1,97 @@
+#include "march.hpp"
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+bool MarchPolicy::parse(const std::string& text, MarchPolicy& out) {
+    out = MarchPolicy();
+    if (text == "constant") return true;
+    float angle, max_steps;
+    int levels;
+    if (sscanf(text.c_str(), "cone:%f:%f", &angle, &max_steps) == 2) {
+        if (angle <= 0.0f || max_steps < 1.0f) return false;
+        out.kind = MarchKind::CONE;
+        out.cone_angle = angle;
+        out.max_step = max_steps * NGP_STEP_SIZE;
+        return true;
+    }
+    if (sscanf(text.c_str(), "occupancy:%d", &levels) == 1) {
+        // The 128^3 grid has 7 coarser levels
+        if (levels < 1 || levels > 7) return false;
+        out.kind = MarchKind::OCCUPANCY;
+        out.levels = levels;
+        return true;
+    }
+    return false;
+}
+
+std::string MarchPolicy::name() const {
+    char text[64];
+    switch (kind) {
+        case MarchKind::CONE:
+            snprintf(text, sizeof(text), "cone:%g:%g", cone_angle, max_step / NGP_STEP_SIZE);
+            return text;
+        case MarchKind::OCCUPANCY:
+            snprintf(text, sizeof(text), "occupancy:%d", levels);
+            return text;
+        default:
+            return "constant";
+    }
+}
+
+float MarchPolicy::next(const OccupancyGrid& grid, const Ray& ray, float t, float& dt, int& steps) const {
+    if (kind != MarchKind::OCCUPANCY) {
+        do {
+            dt = stepSize(t);
+            t += dt;
+            steps++;
+        }
+        while (!grid.isOccupy(ray(t)) && t < RAY_DEFAULT_MAX + EPS);
+        return t;
+    }
+    dt = NGP_STEP_SIZE;
+    while (true) {
+        t += NGP_STEP_SIZE;
+        steps++;
+        Vec3f point = ray(t);
+        if (grid.isOccupy(point) || t >= RAY_DEFAULT_MAX + EPS) return t;
+        int level = levels;
+        while (level > 0 && grid.isOccupyAt(level, point)) level--;
+        if (level == 0) continue;
+        // Jump to the last step inside the empty cell, keeping the step lattice
+        float skip = grid.cellExit(level, point, ray.getDirection());
+        t += std::floor(skip / NGP_STEP_SIZE) * NGP_STEP_SIZE;
+    }
+}
+
+// The positions t += NGP_STEP_SIZE takes from RAY_DEFAULT_MIN, up to the first
+// one past RAY_DEFAULT_MAX + EPS. Float sums are not t0 + k * step exactly.
+static const std::vector<float>& stepLattice() {
+    static const std::vector<float> lattice = [] {
+        std::vector<float> t{RAY_DEFAULT_MIN};
+        while (t.back() < RAY_DEFAULT_MAX + EPS) t.push_back(t.back() + NGP_STEP_SIZE);
+        return t;
+    }();
+    return lattice;
+}
+
+float firstOccupied(const OccupancyGrid& grid, const Ray& ray) {
+    const std::vector<float>& lattice = stepLattice();
+    int levels = grid.getMipLevels(), level = levels;
+    size_t k = 0;
+    while (k + 1 < lattice.size()) {
+        Vec3f point = ray(lattice[k]);
+        if (grid.isOccupy(point)) break;
+        // Empty space is coarse around where it was coarse a position ago
+        level = std::min(level + 1, levels);
+        while (level > 0 && grid.isOccupyAt(level, point)) level--;
+        size_t next = k + 1;
+        if (level > 0) {
+            // Positions half a step short of the cell's exit are still inside it
+            float end = lattice[k] + grid.cellExit(level, point, ray.getDirection()) - 0.5f * NGP_STEP_SIZE;
+            next = std::lower_bound(lattice.begin() + next, lattice.end() - 1, end) - lattice.begin();
+        }
+        k = next;
+    }
+    return lattice[k];
+}
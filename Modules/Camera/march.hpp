@@ -0,0 +1,40 @@
+#ifndef MARCH_HPP_
+#define MARCH_HPP_
+
+#include "camera.hpp"
+#include <algorithm>
+#include <string>
+
+// How ray marching advances to the next occupied sample
+enum class MarchKind {
+    CONSTANT,   // NGP_STEP_SIZE everywhere
+    CONE,       // Steps grow with distance: dt = clamp(t * cone_angle, NGP_STEP_SIZE, max_step)
+    OCCUPANCY   // NGP_STEP_SIZE, but empty cells of the coarser occupancy levels are skipped whole
+};
+
+struct MarchPolicy {
+    MarchKind kind = MarchKind::CONSTANT;
+    float cone_angle = 0.0f;
+    float max_step = NGP_STEP_SIZE;
+    int levels = 0;
+
+    // "constant", "cone:<angle>:<max step in NGP_STEP_SIZE>", "occupancy:<levels>"
+    static bool parse(const std::string& text, MarchPolicy& out);
+    std::string name() const;
+
+    float stepSize(float t) const {
+        if (kind != MarchKind::CONE) return NGP_STEP_SIZE;
+        return std::min(std::max(t * cone_angle, NGP_STEP_SIZE), max_step);
+    }
+    // Advance t to the next occupied sample, or past RAY_DEFAULT_MAX. dt is the
+    // step that reached it, steps counts the positions tested against the grid.
+    float next(const OccupancyGrid& grid, const Ray& ray, float t, float& dt, int& steps) const;
+};
+
+// First position RAY_DEFAULT_MIN + k * NGP_STEP_SIZE that is occupied, or
+// the first past RAY_DEFAULT_MAX + EPS, bit for bit as stepping through every
+// position finds it. Positions inside empty cells of the coarser levels are
+// skipped without a lookup.
+float firstOccupied(const OccupancyGrid& grid, const Ray& ray);
+
+#endif // MARCH_HPP_
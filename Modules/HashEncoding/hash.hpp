@@ -3,6 +3,8 @@
 
 #include <vector>
 #include "utils.hpp"
+#include "quant.hpp"
+#include "hash_fixed.hpp"
 #include <fstream>
 
 // One Layer of Multi-Hash
@@ -15,7 +17,12 @@ public:
         table[index_of_hash] = value;
     }
 
-    VecXf getFeature(Vec3i vertex, float non_hashing_resolution = 0.0){
+    VecXf getFeature(Vec3i vertex, float non_hashing_resolution = 0.0) const{
+        return table[index(vertex, size, non_hashing_resolution)];
+    }
+    // Entry of a vertex in a table of `size` entries: dense when
+    // non_hashing_resolution is set, else the spatial hash
+    static int index(Vec3i vertex, long long size, float non_hashing_resolution = 0.0){
         int x = vertex.x(), y = vertex.y(), z = vertex.z();
         
         int index;
@@ -27,7 +34,7 @@ public:
             int int_scale = static_cast<int>(non_hashing_resolution);
             index = (x + y * int_scale + z * int_scale * int_scale) % size;
         }
-        return table[index];
+        return index;
     }
 private:
     long long size;
@@ -43,7 +50,8 @@ public:
         utils::get_int_from_json(configs, "n_features_per_level"), 
         utils::get_int_from_json(configs, "base_resolution"), 
         utils::get_int_from_json(configs, "log2_hashmap_size"),
-        utils::get_int_from_json(configs, "n_levels")){}
+        utils::get_int_from_json(configs, "n_levels"),
+        configs.contains("per_level_scale") ? configs["per_level_scale"].get<float>() : 1.38191288f){}
     explicit HashEncoding(
         int n_feature_per_level, int base_resolution, int log2_hashtable_size, 
             int n_levels, float per_level_scale = 1.38191288):
@@ -65,19 +73,56 @@ public:
                 
                 sizes.push_back(num_of_features);
                 scales.push_back(scale_raw);
-                layers.push_back(std::make_shared<HashTable>(num_of_features, n_feature_per_level));
                 total_features += num_of_features;
             }
             total_parameters = static_cast<int>(total_features * n_feature_per_level);
+            if (matchesStandard()) {
+                standard = std::make_shared<StandardHashEncoding>();
+            }
+            else {
+                for(int i = 0; i < n_levels; i++){
+                    layers.push_back(std::make_shared<HashTable>(sizes[i], n_feature_per_level));
+                }
+            }
         };
     void loadParametersFromFile(std::string file);
     void loadParameters(const std::vector<float>& params);
 
-    VecXf encode(Vec3f point);
+    VecXf encode(Vec3f point) const;
+    // n points of 3 floats each to n feature vectors, both packed
+    void encodeBatch(const float* points, int n, float* out) const;
+    // One level of encode(): out holds all levels, only this level's
+    // features are written
+    void encodeLevel(int level, const Vec3f& point, float* out) const;
 
-    int getNumParams(){
+    int getNumParams() const{
         return total_parameters;
     }
+    // Dispatched to the compile-time specialized encoder
+    bool isSpecialized() const{
+        return standard != nullptr;
+    }
+    int getNumLevels() const{
+        return n_levels;
+    }
+    int getNumFeaturesPerLevel() const{
+        return n_feature_per_level;
+    }
+    // Geometry of a level as encode() uses it
+    float getLevelScale(int level) const{
+        return scales[level];
+    }
+    long long getLevelSize(int level) const{
+        return sizes[level];
+    }
+    // Resolution of the dense index, 0 for a hashed level
+    float getLevelDenseResolution(int level) const{
+        return sizes[level] >= (1 << log2_hashtable_size) ? 0.0f : std::ceil(scales[level]) + 1;
+    }
+    // Precision of the trilinear weights and the interpolated features
+    void setInterpolationFormat(Quantizer format){
+        interp_quant = format;
+    }
 
 private:
     int n_feature_per_level;
@@ -86,8 +131,13 @@ private:
     int n_levels;
     int total_parameters;
     float per_level_scale;
+    // Generic tables, empty when the specialized encoder holds the parameters
     std::vector<std::shared_ptr<HashTable>> layers;
     std::vector<int> sizes;
     std::vector<float> scales;
+    Quantizer interp_quant;
+    std::shared_ptr<StandardHashEncoding> standard;
+    bool matchesStandard();
+    void encodeGenericLevel(int level, const Vec3f& point, float* out) const;
 };
 #endif // HASHENCODING_HPP_
\ No newline at end of file
@@ -0,0 +1,232 @@
+#include "hash_analysis.hpp"
+#include <algorithm>
+#include <sstream>
+
+namespace {
+    // Spread the low 21 bits of v to every third bit
+    uint64_t spreadBits(uint64_t v) {
+        v &= 0x1FFFFF;
+        v = (v | v << 32) & 0x1F00000000FFFFULL;
+        v = (v | v << 16) & 0x1F0000FF0000FFULL;
+        v = (v | v << 8) & 0x100F00F00F00F00FULL;
+        v = (v | v << 4) & 0x10C30C30C30C30C3ULL;
+        v = (v | v << 2) & 0x1249249249249249ULL;
+        return v;
+    }
+    // Vertices are non-negative and below 2^21 per axis for every level
+    uint64_t vertexKey(int x, int y, int z) {
+        return static_cast<uint64_t>(x) << 42 | static_cast<uint64_t>(y) << 21 | static_cast<uint64_t>(z);
+    }
+    int log2Bucket(long long v, int buckets) {
+        int b = 0;
+        while (v > 1 && b < buckets - 1) {
+            v >>= 1;
+            b++;
+        }
+        return b;
+    }
+}
+
+bool HashAnalysis::parse(const std::string& text, int& banks, std::vector<HashFunction>& functions) {
+    size_t colon = text.find(':');
+    try {
+        banks = std::stoi(text.substr(0, colon));
+    }
+    catch (...) {
+        return false;
+    }
+    if (banks < 1) return false;
+    functions.clear();
+    if (colon == std::string::npos) {
+        functions.push_back(HashFunction::NGP);
+        return true;
+    }
+    std::stringstream list(text.substr(colon + 1));
+    std::string item;
+    while (std::getline(list, item, ',')) {
+        if (item == "ngp") functions.push_back(HashFunction::NGP);
+        else if (item == "morton") functions.push_back(HashFunction::MORTON);
+        else if (item == "tiled") functions.push_back(HashFunction::TILED);
+        else return false;
+    }
+    return !functions.empty();
+}
+
+const char* HashAnalysis::name(HashFunction function) {
+    switch (function) {
+        case HashFunction::MORTON: return "morton";
+        case HashFunction::TILED: return "tiled";
+        default: return "ngp";
+    }
+}
+
+HashAnalysis::HashAnalysis(const HashEncoding& encoding, const std::vector<HashFunction>& functions, int banks):
+    functions(functions), banks(banks), entry_bytes(encoding.getNumFeaturesPerLevel() * 2) {
+    for (int l = 0; l < encoding.getNumLevels(); l++) {
+        levels.push_back(Level{encoding.getLevelScale(l), encoding.getLevelSize(l),
+            static_cast<int>(encoding.getLevelDenseResolution(l))});
+    }
+    stats.assign(functions.size(), std::vector<Stats>(levels.size()));
+    for (auto& per_level : stats) {
+        for (size_t l = 0; l < levels.size(); l++) per_level[l].last_touch.assign(levels[l].size, -1);
+    }
+    vertices.resize(levels.size());
+    deduplicated.assign(levels.size(), 0);
+}
+
+long long HashAnalysis::index(HashFunction function, const Level& level, int x, int y, int z) const {
+    if (level.dense_resolution > 0 || function == HashFunction::NGP) {
+        return HashTable::index(Vec3i(x, y, z), level.size, static_cast<float>(level.dense_resolution));
+    }
+    if (function == HashFunction::MORTON) {
+        uint64_t code = spreadBits(x) | spreadBits(y) << 1 | spreadBits(z) << 2;
+        return static_cast<long long>(code % static_cast<uint64_t>(level.size));
+    }
+    // TILED: 64 consecutive entries per brick
+    long long brick = HashTable::index(Vec3i(x >> 2, y >> 2, z >> 2), level.size / 64);
+    return brick * 64 + ((x & 3) * 16 + (y & 3) * 4 + (z & 3));
+}
+
+void HashAnalysis::record(const float* points, int n) {
+    for (int i = 0; i < n; i++) {
+        const float* p = points + 3 * i;
+        for (size_t l = 0; l < levels.size(); l++) {
+            const Level& level = levels[l];
+            // Same corners as HashEncoding::encode
+            int x_grid = static_cast<int>(std::floor(p[0] * level.scale + 0.5f)),
+                y_grid = static_cast<int>(std::floor(p[1] * level.scale + 0.5f)),
+                z_grid = static_cast<int>(std::floor(p[2] * level.scale + 0.5f));
+            for (int c = 0; c < 8; c++) {
+                vertices[l].push_back(vertexKey(x_grid + (c >> 2), y_grid + ((c >> 1) & 1), z_grid + (c & 1)));
+            }
+            if (vertices[l].size() > 2 * deduplicated[l] + (1 << 20)) deduplicate(l);
+
+            for (size_t f = 0; f < functions.size(); f++) {
+                Stats& s = stats[f][l];
+                long long group[8];
+                for (int c = 0; c < 8; c++) {
+                    long long entry = index(functions[f], level,
+                        x_grid + (c >> 2), y_grid + ((c >> 1) & 1), z_grid + (c & 1));
+                    group[c] = entry;
+                    long long& last = s.last_touch[entry];
+                    if (last < 0) s.first_touches++;
+                    else s.reuse[log2Bucket(s.accesses - last, REUSE_BUCKETS)]++;
+                    last = s.accesses++;
+                }
+                s.groups++;
+                // Strides and lines over the distinct entries of the group
+                std::sort(group, group + 8);
+                int distinct = std::unique(group, group + 8) - group;
+                long long last_line = -1;
+                for (int k = 0; k < distinct; k++) {
+                    if (k > 0) {
+                        long long stride = group[k] - group[k - 1];
+                        s.strides[stride == 1 ? 0 : std::min(1 + log2Bucket(stride, 64) / 4, STRIDE_BUCKETS - 1)]++;
+                    }
+                    long long line = group[k] * entry_bytes / LINE_BYTES;
+                    if (line != last_line) s.lines++;
+                    last_line = line;
+                }
+                // A bank serves one distinct entry per cycle
+                int cycles = 0;
+                for (int k = 0; k < distinct; k++) {
+                    int same_bank = 0;
+                    for (int m = 0; m < distinct; m++) same_bank += group[m] % banks == group[k] % banks;
+                    cycles = std::max(cycles, same_bank);
+                }
+                s.bank_cycles += cycles;
+            }
+        }
+    }
+}
+
+void HashAnalysis::deduplicate(int level) {
+    std::vector<uint64_t>& v = vertices[level];
+    std::sort(v.begin(), v.end());
+    v.erase(std::unique(v.begin(), v.end()), v.end());
+    deduplicated[level] = v.size();
+}
+
+// Collisions: distinct touched vertices sharing an entry
+void HashAnalysis::finish() {
+    if (finished) return;
+    finished = true;
+    for (size_t l = 0; l < levels.size(); l++) {
+        deduplicate(l);
+        for (size_t f = 0; f < functions.size(); f++) {
+            Stats& s = stats[f][l];
+            std::vector<long long> entries;
+            entries.reserve(vertices[l].size());
+            for (uint64_t key : vertices[l]) {
+                entries.push_back(index(functions[f], levels[l],
+                    static_cast<int>(key >> 42), static_cast<int>((key >> 21) & 0x1FFFFF), static_cast<int>(key & 0x1FFFFF)));
+            }
+            std::sort(entries.begin(), entries.end());
+            for (size_t i = 0; i < entries.size();) {
+                size_t j = i;
+                while (j < entries.size() && entries[j] == entries[i]) j++;
+                s.collisions[std::min<size_t>(j - i, COLLISION_BUCKETS) - 1]++;
+                s.distinct++;
+                i = j;
+            }
+        }
+        std::vector<uint64_t>().swap(vertices[l]);
+    }
+}
+
+void HashAnalysis::print() {
+    finish();
+    puts("========== Hash Grid Access Analysis ==========");
+    printf("Banks: %d, Entry: %d bytes, Line: %d bytes\n", banks, entry_bytes, LINE_BYTES);
+    for (size_t f = 0; f < functions.size(); f++) {
+        printf("Index function: %s\n", name(functions[f]));
+        printf("%5s %6s %10s %10s %10s %12s %10s %11s\n",
+            "Level", "Mode", "Entries", "Touched", "Shared%", "Reuse<=2^8%", "Lines/grp", "Bank cyc/grp");
+        for (size_t l = 0; l < levels.size(); l++) {
+            const Stats& s = stats[f][l];
+            long long vertices_total = 0, shared = 0, near_reuse = 0;
+            for (int b = 0; b < COLLISION_BUCKETS; b++) {
+                vertices_total += s.collisions[b] * (b + 1);
+                if (b > 0) shared += s.collisions[b] * (b + 1);
+            }
+            for (int b = 0; b <= 8; b++) near_reuse += s.reuse[b];
+            double groups = std::max(s.groups, 1LL);
+            printf("%5zu %6s %10lld %10lld %9.2f%% %11.2f%% %10.2f %11.2f\n", l,
+                levels[l].dense_resolution > 0 ? "dense" : "hashed", levels[l].size, s.distinct,
+                vertices_total > 0 ? 100.0 * shared / vertices_total : 0.0,
+                s.accesses > 0 ? 100.0 * near_reuse / s.accesses : 0.0,
+                s.lines / groups, s.bank_cycles / groups);
+        }
+    }
+}
+
+nlohmann::json HashAnalysis::report() {
+    finish();
+    nlohmann::json result;
+    result["banks"] = banks;
+    result["entry_bytes"] = entry_bytes;
+    result["line_bytes"] = LINE_BYTES;
+    for (size_t f = 0; f < functions.size(); f++) {
+        nlohmann::json per_level = nlohmann::json::array();
+        for (size_t l = 0; l < levels.size(); l++) {
+            const Stats& s = stats[f][l];
+            double groups = std::max(s.groups, 1LL);
+            per_level.push_back({
+                {"mode", levels[l].dense_resolution > 0 ? "dense" : "hashed"},
+                {"entries", levels[l].size},
+                {"accesses", s.accesses},
+                {"distinct_entries", s.distinct},
+                {"collision_histogram", std::vector<long long>(s.collisions, s.collisions + COLLISION_BUCKETS)},
+                {"first_touches", s.first_touches},
+                {"reuse_log2_histogram", std::vector<long long>(s.reuse, s.reuse + REUSE_BUCKETS)},
+                {"stride_histogram", std::vector<long long>(s.strides, s.strides + STRIDE_BUCKETS)},
+                {"lines_per_group", s.lines / groups},
+                {"bank_cycles_per_group", s.bank_cycles / groups}
+            });
+        }
+        result["functions"][name(functions[f])] = per_level;
+    }
+    result["stride_buckets"] = {"1", "2-15", "16-255", "256-4095", "4096-65535", "65536+"};
+    result["collision_buckets"] = {"1", "2", "3", "4", "5+"};
+    return result;
+}
@@ -0,0 +1,68 @@
+#ifndef HASH_ANALYSIS_HPP_
+#define HASH_ANALYSIS_HPP_
+
+#include <string>
+#include <vector>
+#include "hash.hpp"
+
+// Index functions of the hashed levels. Dense levels always use the dense index.
+enum class HashFunction {
+    NGP,      // x ^ y * 2654435761 ^ z * 805459861, as HashTable
+    MORTON,   // Interleaved coordinate bits, neighbours stay close
+    TILED     // 4x4x4 bricks: the brick is hashed, the vertex is linear inside it
+};
+
+// Address behaviour of the hash grid lookups, per level and index function.
+// The encoder itself is untouched: every recorded point is mapped through
+// each function so they are compared on the same access stream.
+class HashAnalysis {
+public:
+    // <banks>[:<function>,...], e.g. "16:ngp,morton,tiled"
+    static bool parse(const std::string& text, int& banks, std::vector<HashFunction>& functions);
+    static const char* name(HashFunction function);
+
+    HashAnalysis(const HashEncoding& encoding, const std::vector<HashFunction>& functions, int banks);
+
+    // The eight corner fetches of every level for each point
+    void record(const float* points, int n);
+    void print();
+    nlohmann::json report();
+
+    static constexpr int REUSE_BUCKETS = 24;      // log2 of accesses since the entry was last touched
+    static constexpr int STRIDE_BUCKETS = 6;      // Between sorted distinct entries of a fetch group
+    static constexpr int COLLISION_BUCKETS = 5;   // Distinct vertices per touched entry: 1, 2, 3, 4, 5+
+    static constexpr int LINE_BYTES = 64;
+
+private:
+    struct Level {
+        float scale;
+        long long size;
+        int dense_resolution;   // 0 for a hashed level
+    };
+    struct Stats {
+        std::vector<long long> last_touch;   // Access number, -1 if never
+        long long accesses = 0, groups = 0;
+        long long reuse[REUSE_BUCKETS] = {0};
+        long long first_touches = 0;
+        long long strides[STRIDE_BUCKETS] = {0};
+        long long lines = 0;          // Cache lines per group, summed
+        long long bank_cycles = 0;    // Cycles per group with one access per bank per cycle, summed
+        long long collisions[COLLISION_BUCKETS] = {0};
+        long long distinct = 0;
+    };
+
+    std::vector<Level> levels;
+    std::vector<HashFunction> functions;
+    int banks;
+    int entry_bytes;   // fp16 features of one entry
+    std::vector<std::vector<Stats>> stats;            // [function][level]
+    std::vector<std::vector<uint64_t>> vertices;      // Touched vertices per level, deduplicated lazily
+    std::vector<size_t> deduplicated;                 // Size after the last deduplication
+    bool finished = false;
+
+    long long index(HashFunction function, const Level& level, int x, int y, int z) const;
+    void deduplicate(int level);
+    void finish();
+};
+
+#endif // HASH_ANALYSIS_HPP_
@@ -0,0 +1,174 @@
+#ifndef HASH_FIXED_HPP_
+#define HASH_FIXED_HPP_
+
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "utils.hpp"
+#include "quant.hpp"
+
+// constexpr replacements of the libm calls used to size the levels. They are
+// accurate to a few ulp in double, which is far below the float the scales
+// are stored in; HashEncoding still compares the tables before dispatching.
+namespace hash_constexpr {
+    constexpr double LN2 = 0.693147180559945309417;
+
+    constexpr double log2(double x) {
+        // ln(x) = 2 atanh((x - 1) / (x + 1))
+        double t = (x - 1) / (x + 1), t2 = t * t, term = t, sum = 0.0;
+        for (int k = 0; k < 64; k++) {
+            sum += term / (2 * k + 1);
+            term *= t2;
+        }
+        return 2 * sum / LN2;
+    }
+    // y >= 0
+    constexpr double exp2(double y) {
+        int n = static_cast<int>(y);
+        double r = (y - n) * LN2, term = 1.0, sum = 1.0;
+        for (int k = 1; k < 32; k++) {
+            term *= r / k;
+            sum += term;
+        }
+        for (int i = 0; i < n; i++) sum *= 2;
+        return sum;
+    }
+    // v >= 0
+    constexpr long long ceil(double v) {
+        long long t = static_cast<long long>(v);
+        return t < v ? t + 1 : t;
+    }
+}
+
+// Hash encoding with the grid shape as template parameters. Per-level scale,
+// resolution, dense/hashed mode and table offsets are constexpr tables, the
+// level loop is unrolled and the table is one flat array. Results are identical
+// to HashEncoding with the default per-level scale.
+template <int N_LEVELS, int N_FEATURES, int LOG2_SIZE, int BASE_RESOLUTION>
+class FixedHashEncoding {
+public:
+    static constexpr int N_OUTPUT = N_LEVELS * N_FEATURES;
+    static constexpr float PER_LEVEL_SCALE = 1.38191288f;
+    static constexpr long long MAX_SIZE = 1LL << LOG2_SIZE;
+
+    struct Level {
+        float scale;
+        int resolution;      // Grid resolution used by the dense index
+        bool hashed;
+        long long size;      // Entries of this level
+        long long offset;    // First entry in the flat table
+    };
+    static constexpr std::array<Level, N_LEVELS> makeLevels() {
+        std::array<Level, N_LEVELS> result{};
+        // HashEncoding takes log2 of the float scale in float precision
+        float log2_scale = static_cast<float>(hash_constexpr::log2(static_cast<double>(PER_LEVEL_SCALE)));
+        long long offset = 0;
+        for (int i = 0; i < N_LEVELS; i++) {
+            double scale_raw = hash_constexpr::exp2(static_cast<double>(i * log2_scale)) * BASE_RESOLUTION - 1.0;
+            long long resolution = hash_constexpr::ceil(scale_raw) + 1;
+            long long dense_size = (resolution * resolution * resolution + 7) / 8 * 8;
+            Level& level = result[i];
+            level.scale = static_cast<float>(scale_raw);
+            level.resolution = static_cast<int>(hash_constexpr::ceil(level.scale)) + 1;
+            level.hashed = dense_size >= MAX_SIZE;
+            level.size = level.hashed ? MAX_SIZE : dense_size;
+            level.offset = offset;
+            offset += level.size;
+        }
+        return result;
+    }
+    static constexpr std::array<Level, N_LEVELS> levels = makeLevels();
+    static constexpr long long TOTAL_ENTRIES = levels[N_LEVELS - 1].offset + levels[N_LEVELS - 1].size;
+
+    // Same layout as HashEncoding::loadParameters: level by level, entry by entry
+    void loadParameters(const std::vector<float>& params) {
+        table.assign(params.begin(), params.begin() + TOTAL_ENTRIES * N_FEATURES);
+    }
+
+    void encode(const Vec3f& point, float* out, const Quantizer& quant) const {
+        encodeLevels(point, out, quant, std::make_integer_sequence<int, N_LEVELS>());
+    }
+    // One level chosen at run time, written to its slice of the full output
+    void encodeLevel(int level, const Vec3f& point, float* out, const Quantizer& quant) const {
+        levelEncoders(std::make_integer_sequence<int, N_LEVELS>())[level](*this, point, out, quant);
+    }
+
+private:
+    std::vector<float> table;
+
+    using LevelEncoder = void (*)(const FixedHashEncoding&, const Vec3f&, float*, const Quantizer&);
+    template <int... L>
+    static const std::array<LevelEncoder, N_LEVELS>& levelEncoders(std::integer_sequence<int, L...>) {
+        static const std::array<LevelEncoder, N_LEVELS> encoders = {
+            [](const FixedHashEncoding& self, const Vec3f& point, float* out, const Quantizer& quant) {
+                self.template encodeLevel<L>(point, out, quant);
+            }...
+        };
+        return encoders;
+    }
+
+    template <int... L>
+    void encodeLevels(const Vec3f& point, float* out, const Quantizer& quant,
+        std::integer_sequence<int, L...>) const {
+        (encodeLevel<L>(point, out, quant), ...);
+    }
+
+    template <int L>
+    static long long index(int x, int y, int z) {
+        constexpr Level level = levels[L];
+        if constexpr (level.hashed) {
+            // Same wrap-around as the int arithmetic of HashTable::getFeature
+            long long hy = static_cast<long long>(y) * 2654435761LL;
+            int hz = static_cast<int>(static_cast<uint32_t>(z) * 805459861u);
+            return (x ^ hy ^ hz) & (MAX_SIZE - 1);
+        }
+        else {
+            constexpr int R = level.resolution;
+            return (x + y * R + z * R * R) % level.size;
+        }
+    }
+
+    template <int L>
+    void encodeLevel(const Vec3f& point, float* out, const Quantizer& quant) const {
+        constexpr Level level = levels[L];
+        float x_scale = point.x() * level.scale + 0.5,
+            y_scale = point.y() * level.scale + 0.5,
+            z_scale = point.z() * level.scale + 0.5;
+        int x_grid = static_cast<int>(std::floor(x_scale)),
+            y_grid = static_cast<int>(std::floor(y_scale)),
+            z_grid = static_cast<int>(std::floor(z_scale));
+        float dx = x_scale - x_grid,
+            dy = y_scale - y_grid,
+            dz = z_scale - z_grid;
+
+        float w[8] = {
+            (1 - dx) * (1 - dy) * (1 - dz),
+            (1 - dx) * (1 - dy) * dz,
+            (1 - dx) * dy * (1 - dz),
+            (1 - dx) * dy * dz,
+            dx * (1 - dy) * (1 - dz),
+            dx * (1 - dy) * dz,
+            dx * dy * (1 - dz),
+            dx * dy * dz
+        };
+        if (!quant.isExact()) {
+            for (int c = 0; c < 8; c++) w[c] = quant(w[c]);
+        }
+        const float* base = table.data() + level.offset * N_FEATURES;
+        const float* f[8];
+        for (int c = 0; c < 8; c++) {
+            f[c] = base + index<L>(x_grid + (c >> 2), y_grid + ((c >> 1) & 1), z_grid + (c & 1)) * N_FEATURES;
+        }
+        for (int j = 0; j < N_FEATURES; j++) {
+            float v = f[0][j] * w[0] + f[1][j] * w[1] + f[2][j] * w[2] + f[3][j] * w[3] +
+                f[4][j] * w[4] + f[5][j] * w[5] + f[6][j] * w[6] + f[7][j] * w[7];
+            out[L * N_FEATURES + j] = quant(v);
+        }
+    }
+};
+
+// The configuration of configs/base.json
+using StandardHashEncoding = FixedHashEncoding<16, 2, 19, 16>;
+
+#endif // HASH_FIXED_HPP_
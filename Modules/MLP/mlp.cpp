@@ -1,6 +1,7 @@
 #include "mlp.hpp"
 #include <iostream>
 #include <fstream>
+#include <algorithm>
 
 void MLP::loadParametersFromFile(std::string path){
     std::ifstream nfin(path);
@@ -38,14 +39,104 @@ void MLP::loadParameters(const std::vector<float>& params){
     }
 }
 
-MLP::Output MLP::inference(MLP::Input vec){
-    Eigen::MatrixXf midvec = vec;
+MLP::Output MLP::inference(MLP::Input vec) const{
+    return inferenceBatch(vec);
+}
+
+MatXf MLP::inferenceBatch(const MatXf& batch) const{
+    Eigen::MatrixXf midvec = batch;
     for(auto& layer: layers){
         midvec = layer.transpose() * midvec;
+        accum_quant.apply(midvec);
         if (&layer == &layers.back()) break;
         for(int i = 0; i < midvec.size(); i++) {
             midvec(i) = ReLU(midvec(i));
         }
     }
     return midvec;
-}
\ No newline at end of file
+}
+
+MLP::Output MLP::inference(MLP::Input vec, const PEArray& pe, int& cycles) const{
+    if (!sparse) {
+        cycles = denseCycles(pe);
+        return inference(vec);
+    }
+    cycles = 0;
+    Eigen::VectorXf midvec = vec;
+    std::vector<int> pe_macs(pe.num_pe);
+    for (size_t l = 0; l < sparse_layers.size(); l++) {
+        const SparseWeight& layer = sparse_layers[l];
+        Eigen::VectorXf out(layer.rows());
+        std::fill(pe_macs.begin(), pe_macs.end(), 0);
+        for (int o = 0; o < layer.rows(); o++) {
+            float acc = 0.0f;
+            int macs = 0;
+            for (SparseWeight::InnerIterator it(layer, o); it; ++it) {
+                float a = midvec(it.col());
+                if (pe.skip_zero_activations && a == 0.0f) continue;
+                acc += it.value() * a;
+                macs++;
+            }
+            out(o) = acc;
+            pe_macs[o % pe.num_pe] += macs;
+        }
+        int slowest = *std::max_element(pe_macs.begin(), pe_macs.end());
+        cycles += std::max(1, (slowest + pe.macs_per_pe - 1) / pe.macs_per_pe);
+        accum_quant.apply(out);
+        midvec = out;
+        if (l + 1 == sparse_layers.size()) break;
+        for (int i = 0; i < midvec.size(); i++) {
+            midvec(i) = ReLU(midvec(i));
+        }
+    }
+    return midvec;
+}
+
+int MLP::denseCycles(const PEArray& pe) const{
+    int cycles = 0;
+    for (auto& layer: layers) {
+        int outputs_per_pe = (static_cast<int>(layer.cols()) + pe.num_pe - 1) / pe.num_pe;
+        int macs = outputs_per_pe * static_cast<int>(layer.rows());
+        cycles += std::max(1, (macs + pe.macs_per_pe - 1) / pe.macs_per_pe);
+    }
+    return cycles;
+}
+
+void MLP::prune(float threshold){
+    sparse_layers.clear();
+    for (auto& layer: layers) {
+        for (int i = 0; i < layer.size(); i++) {
+            if (std::abs(layer(i)) < threshold) layer(i) = 0.0f;
+        }
+        SparseWeight transposed = layer.transpose().sparseView();
+        transposed.makeCompressed();
+        sparse_layers.push_back(transposed);
+    }
+    sparse = true;
+}
+
+float MLP::thresholdForSparsity(float target_sparsity) const{
+    std::vector<float> magnitudes;
+    magnitudes.reserve(num_of_params);
+    for (auto& layer: layers) {
+        for (int i = 0; i < layer.size(); i++) {
+            magnitudes.push_back(std::abs(layer(i)));
+        }
+    }
+    size_t k = static_cast<size_t>(target_sparsity * magnitudes.size());
+    if (k == 0) return 0.0f;
+    if (k >= magnitudes.size()) return INFINITY;
+    std::nth_element(magnitudes.begin(), magnitudes.begin() + k, magnitudes.end());
+    // Weights strictly below the k-th smallest magnitude are pruned
+    return magnitudes[k];
+}
+
+int MLP::getNumNonZeros() const{
+    int nnz = 0;
+    for (auto& layer: layers) {
+        for (int i = 0; i < layer.size(); i++) {
+            if (layer(i) != 0.0f) nnz++;
+        }
+    }
+    return nnz;
+}
@@ -2,6 +2,8 @@
 #define MLP_HPP_
 
 #include "utils.hpp"
+#include "quant.hpp"
+#include <Eigen/Sparse>
 
 class MLP {
 public:
@@ -9,6 +11,15 @@ public:
     using Output = Eigen::VectorXf;
     using Weight = Eigen::MatrixXf;
     using act_fn = float(*)(float);
+    using SparseWeight = Eigen::SparseMatrix<float, Eigen::RowMajor>;
+    // Zero-skipping PE array. Output neurons are assigned to PEs round-robin,
+    // each PE does macs_per_pe MACs per cycle and a layer finishes with its
+    // slowest PE.
+    struct PEArray {
+        int num_pe = 64;
+        int macs_per_pe = 8;
+        bool skip_zero_activations = true;
+    };
     explicit MLP(int input_size, int output_size, 
         int num_of_hidden_layer, int width):
         input_size(input_size), output_size(output_size), 
@@ -30,15 +41,35 @@ public:
     void loadParameters(const std::vector<float>& params);
     void loadParametersFromFile(std::string path);
 
-    Output inference(Input vec);
+    Output inference(Input vec) const;
+    // One sample per column, the layers run as matrix products
+    MatXf inferenceBatch(const MatXf& batch) const;
+    // Same as inference, also returns the cycles spent on the PE array
+    Output inference(Input vec, const PEArray& pe, int& cycles) const;
+    int denseCycles(const PEArray& pe) const;
 
-    int getNumParams(){
+    // Magnitude pruning: weights with |w| < threshold become zero and are
+    // stored in CSR, inference then runs the sparse kernel
+    void prune(float threshold);
+    float thresholdForSparsity(float target_sparsity) const;
+    bool isSparse() const{
+        return sparse;
+    }
+    int getNumNonZeros() const;
+
+    int getNumParams() const{
         return num_of_params;
     }
+    // Precision of the layer outputs (accumulators)
+    void setAccumulatorFormat(Quantizer format){
+        accum_quant = format;
+    }
 
 private:
     int input_size, output_size, width, depth;
     std::vector<Weight> layers;
+    bool sparse = false;
+    std::vector<SparseWeight> sparse_layers;  // Transposed layers, one row per output
     static float Sigmoid(float input){
         return 1.0 / (1.0 + std::exp(-input));
     }
@@ -46,6 +77,7 @@ private:
         return std::max(0.0f, input);
     }
     int num_of_params = 0;
+    Quantizer accum_quant;
 };
 
 #endif // MLP_HPP_
\ No newline at end of file
@@ -5,6 +5,54 @@
 
 #include "utils.hpp"
 
+// Real spherical harmonics up to Degree (Degree^2 coefficients), float only and
+// without branches on the degree. Coefficient c of a direction is written to
+// out[c * stride], so the same code fills an AoS feature (stride 1) or one
+// column of a planar SoA batch (stride n).
+template <int Degree>
+class SHEncoder {
+    static_assert(Degree >= 1 && Degree <= 4, "Invalid Degree for SH Encoding");
+public:
+    static constexpr int N_COEFFS = Degree * Degree;
+
+    // Direction components in [0, 1], as produced by ray marching
+    static inline void encode(float dx, float dy, float dz, float* out, int stride = 1) {
+        float x = dx * 2 - 1, y = dy * 2 - 1, z = dz * 2 - 1;
+        // Reference from Junran's Jax-Instant-NGP
+        out[0] = 0.28209479177387814f;
+        if constexpr (Degree >= 2) {
+            out[1 * stride] = -0.48860251190291987f * y;
+            out[2 * stride] = 0.48860251190291987f * z;
+            out[3 * stride] = -0.48860251190291987f * x;
+        }
+        if constexpr (Degree >= 3) {
+            float x2 = x * x, y2 = y * y, z2 = z * z, xy = x * y, xz = x * z, yz = y * z;
+            out[4 * stride] = 1.0925484305920792f * xy;
+            out[5 * stride] = -1.0925484305920792f * yz;
+            out[6 * stride] = 0.94617469575755997f * z2 - 0.31539156525251999f;
+            out[7 * stride] = -1.0925484305920792f * xz;
+            out[8 * stride] = 0.54627421529603959f * x2 - 0.54627421529603959f * y2;
+            if constexpr (Degree >= 4) {
+                out[9 * stride] = 0.59004358992664352f * y * (-3.0f * x2 + y2);
+                out[10 * stride] = 2.8906114426405538f * xy * z;
+                out[11 * stride] = 0.45704579946446572f * y * (1.0f - 5.0f * z2);
+                out[12 * stride] = 0.3731763325901154f * z * (5.0f * z2 - 3.0f);
+                out[13 * stride] = 0.45704579946446572f * x * (1.0f - 5.0f * z2);
+                out[14 * stride] = 1.4453057213202769f * z * (x2 - y2);
+                out[15 * stride] = 0.59004358992664352f * x * (-x2 + 3.0f * y2);
+            }
+        }
+    }
+
+    // SoA batch: x, y, z hold n directions, out is planar with N_COEFFS rows of n
+    static void encodeBatch(const float* x, const float* y, const float* z, int n, float* out) {
+        #pragma omp simd
+        for (int i = 0; i < n; i++) {
+            encode(x[i], y[i], z[i], out + i, n);
+        }
+    }
+};
+
 class SHEncoding{
 public:
     using Direction = Vec3f;
@@ -15,9 +63,12 @@ public:
         utils::get_int_from_json(configs, "degree"),
         utils::get_int_from_json(configs, "n_dims_to_encode")
     ){}
-    SHEncoding(int degree, int n_dims_to_encode):
-        degree(degree), n_dims_to_encode(n_dims_to_encode){};
+    SHEncoding(int degree, int n_dims_to_encode);
     Feature encode(Direction dir);
+    // Planar batch, see SHEncoder::encodeBatch
+    void encodeBatch(const float* x, const float* y, const float* z, int n, float* out) {
+        encode_batch_fn(x, y, z, n, out);
+    }
 
     // Get Output Dimension
     int getOutDim() const{
@@ -26,7 +77,9 @@ public:
 private:
     int degree;
     int n_dims_to_encode;
+    // Bound once to the SHEncoder of the configured degree
+    void (*encode_fn)(float, float, float, float*, int);
+    void (*encode_batch_fn)(const float*, const float*, const float*, int, float*);
 };
 
 #endif // SHENCODING_HPP_
-
@@ -1,5 +1,17 @@
 #include "NGP_Simulator.hpp"
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <climits>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstdio>
+#include <stdexcept>
+#include <metrics.hpp>
 
 Simulator::Simulator(): rayCount(0), MAX_RAY_COUNT(1),
  camera(nullptr), occupancy_grid(nullptr),
@@ -24,33 +36,55 @@ Simulator::Simulator(
     {
         MAX_RAY_COUNT = camera->getResolution().x() * camera->getResolution().y();
         this->MAX_T_COUNT = MAX_T_COUNT;
+        unloaded.occupancy_grid = occupancy_grid;
+        unloaded.sig_mlp = sig_mlp;
+        unloaded.col_mlp = color_mlp;
+        unloaded.hash_enc = hash_encoding;
 
         // Initialize Statistics
         history.scene_name = Scene_Name;
         history.cycleCount = 0;
-        history.rgbs.resize(camera->getResolution().x() * camera->getResolution().y());
-        history.rgbs.assign(camera->getResolution().x() * camera->getResolution().y(), Vec3f::Zero());
-        history.opacities.resize(camera->getResolution().x() * camera->getResolution().y());
-        history.opacities.assign(camera->getResolution().x() * camera->getResolution().y(), 0.0);
         history.frequency = 1;
     }
 
+// A checkpoint still being written is finished first
+Simulator::~Simulator() {
+    if (checkpoint.writer.joinable()) checkpoint.writer.join();
+}
+
 void Simulator::loadParameters(std::string path) {
+    Snapshot snapshot;
+    {
+        Profiler::ScopedTimer timer(profiler, PROF_LOAD_PARAMS);
+        if (!readSnapshot(path, snapshot)) throw std::runtime_error("Cannot load snapshot [" + path + "]");
+    }
+    loadParameters(snapshot);
+}
+
+bool Simulator::readSnapshot(std::string path, Snapshot& snapshot) {
     using namespace nlohmann;
     std::ifstream input_msgpack_file(path, std::ios::in | std::ios::binary);
+    if (!input_msgpack_file) {
+        printf("Cannot open snapshot [%s]\n", path.c_str());
+        return false;
+    }
     json data = json::from_msgpack(input_msgpack_file);
 
     json::binary_t params = data["snapshot"]["params_binary"];
     
     int size_hashnet = sig_mlp->getNumParams(), size_rgbnet = col_mlp->getNumParams(),
         size_hashgrid = hash_enc->getNumParams();
-    std::vector<float> sig_mlp_params(size_hashnet), color_mlp_params(size_rgbnet),
-        hashgrid_params(size_hashgrid);
+    std::vector<float>& sig_mlp_params = snapshot.sig_mlp;
+    std::vector<float>& color_mlp_params = snapshot.color_mlp;
+    std::vector<float>& hashgrid_params = snapshot.hash_grid;
+    sig_mlp_params.assign(size_hashnet, 0.0f);
+    color_mlp_params.assign(size_rgbnet, 0.0f);
+    hashgrid_params.assign(size_hashgrid, 0.0f);
     int num_of_params = params.size();
 
     if (num_of_params / 2 != (size_hashgrid + size_hashnet + size_rgbnet)){
         std::cout << "Mismatched Snapshot and Config!" << std::endl;
-        exit(1);
+        return false;
     }
     
     for(int i = 0; i < num_of_params; i += 2){
@@ -67,16 +101,14 @@ void Simulator::loadParameters(std::string path) {
             hashgrid_params[index - size_hashnet - size_rgbnet] = value_float;
         }
     }
-    hash_enc->loadParameters(hashgrid_params);
-    sig_mlp->loadParameters(sig_mlp_params);
-    col_mlp->loadParameters(color_mlp_params);
 
     json::binary_t density_grid_params = data["snapshot"]["density_grid_binary"];
 
     int num_of_params_ocgrid = density_grid_params.size();
     int size_ocgrid = occupancy_grid->getNumParams(), resolution = occupancy_grid->getResolution();
 
-    std::vector<int> oc_params(size_ocgrid, 0);
+    std::vector<int>& oc_params = snapshot.occupancy;
+    oc_params.assign(size_ocgrid, 0);
     for(int i = 0; i < num_of_params_ocgrid; i += 2){
         uint32_t value = density_grid_params[i] | (density_grid_params[i + 1] << 8);
         float value_float = utils::from_int_to_float16(value);
@@ -84,66 +116,652 @@ void Simulator::loadParameters(std::string path) {
         if(value_float > 0.01) oc_params[index] = 1;
         else oc_params[index] = 0;
     }
-    occupancy_grid->loadParameters(oc_params);
+    return true;
+}
+
+void Simulator::loadParameters(const Snapshot& snapshot) {
+    Profiler::ScopedTimer timer(profiler, PROF_LOAD_PARAMS);
+    if (!quant.hash_table.isExact()) {
+        std::vector<float> hashgrid_params = snapshot.hash_grid;
+        for (float& p : hashgrid_params) p = quant.hash_table(p);
+        unloaded.hash_enc->loadParameters(hashgrid_params);
+    }
+    else {
+        unloaded.hash_enc->loadParameters(snapshot.hash_grid);
+    }
+    if (!quant.mlp_weights.isExact()) {
+        std::vector<float> sig_mlp_params = snapshot.sig_mlp, color_mlp_params = snapshot.color_mlp;
+        for (float& p : sig_mlp_params) p = quant.mlp_weights(p);
+        for (float& p : color_mlp_params) p = quant.mlp_weights(p);
+        unloaded.sig_mlp->loadParameters(sig_mlp_params);
+        unloaded.col_mlp->loadParameters(color_mlp_params);
+    }
+    else {
+        unloaded.sig_mlp->loadParameters(snapshot.sig_mlp);
+        unloaded.col_mlp->loadParameters(snapshot.color_mlp);
+    }
+    if (pruning.enabled) applyPruning();
+
+    unloaded.occupancy_grid->loadParameters(snapshot.occupancy);
+    // Every coarser level down to a single cell, for the prepass and the occupancy policy
+    int mip_levels = 0;
+    while ((unloaded.occupancy_grid->getResolution() >> (mip_levels + 1)) > 0) mip_levels++;
+    unloaded.occupancy_grid->buildMips(mip_levels);
+    unloaded = {};
+    attachModules();
+}
+
+Simulator::Modules Simulator::getModules() const {
+    return Modules{occupancy_grid, sig_mlp, col_mlp, hash_enc, pruning.sig_threshold, pruning.col_threshold};
+}
+
+void Simulator::useModules(const Modules& modules) {
+    occupancy_grid = modules.occupancy_grid;
+    sig_mlp = modules.sig_mlp;
+    col_mlp = modules.col_mlp;
+    hash_enc = modules.hash_enc;
+    pruning.sig_threshold = modules.sig_threshold;
+    pruning.col_threshold = modules.col_threshold;
+    unloaded = {};
+    attachModules();
+}
+
+void Simulator::attachModules() {
+    if (pruning.enabled) {
+        pruning.sig_sparsity = 1.0f - static_cast<float>(sig_mlp->getNumNonZeros()) / sig_mlp->getNumParams();
+        pruning.col_sparsity = 1.0f - static_cast<float>(col_mlp->getNumNonZeros()) / col_mlp->getNumParams();
+        pruning.sig_dense_cycles = sig_mlp->denseCycles(pruning.pe);
+        pruning.col_dense_cycles = col_mlp->denseCycles(pruning.pe);
+    }
+    energy.mlp_weights[0] = pruning.enabled ? sig_mlp->getNumNonZeros() : sig_mlp->getNumParams();
+    energy.mlp_weights[1] = pruning.enabled ? col_mlp->getNumNonZeros() : col_mlp->getNumParams();
+    if (!hash_analysis_functions.empty()) {
+        hash_analysis = std::make_unique<HashAnalysis>(*hash_enc, hash_analysis_functions, hash_analysis_banks);
+    }
 }
 
 void Simulator::render() {
-    initialize();
+    if (streaming.enabled && sampling.enabled) {
+        puts("Sampling is not supported with streaming, simulating every pixel");
+        sampling.enabled = false;
+    }
+    if (streaming.enabled && cost_maps.enabled) {
+        puts("Cost maps need the whole frame, they are not written with streaming");
+        cost_maps.enabled = false;
+    }
+    if ((!checkpoint.path.empty() || !checkpoint.resume_path.empty()) &&
+        (parallel.enabled || sampling.enabled || hash_analysis)) {
+        if (!checkpoint.resume_path.empty()) {
+            throw std::invalid_argument("Only sequential runs without sampling or hash analysis can be resumed");
+        }
+        puts("Checkpoints need a sequential run without sampling or hash analysis, none are written");
+        checkpoint.path.clear();
+    }
+    if (hash_miss.enabled &&
+        (static_cast<size_t>(reorder.join_size) < hash_miss.outstanding ||
+            static_cast<size_t>(reorder.vr_size) < hash_miss.outstanding)) {
+        throw std::invalid_argument("Hash misses complete out of order, reorder buffers must hold the outstanding lookups");
+    }
+    auto start = std::chrono::steady_clock::now();
+    {
+        Profiler::ScopedTimer timer(profiler, PROF_PREPASS);
+        initialize();
+        if (sampling.enabled) {
+            selectSampledPixels();
+        }
+        if (!checkpoint.path.empty() || !checkpoint.resume_path.empty()) {
+            checkpoint.fingerprint = checkpointFingerprint();
+        }
+        if (!checkpoint.resume_path.empty() && !resumeCheckpoint()) {
+            throw std::runtime_error("Cannot resume from [" + checkpoint.resume_path + "]");
+        }
+    }
+    simulate();
+    if (parallel.enabled && parallel.validate) {
+        validateParallel();
+    }
+    if (sampling.enabled) {
+        sampling.host_time_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        estimateFromSamples();
+        if (sampling.validate) {
+            validateSampling();
+        }
+    }
 
+    if (!streaming.enabled) {
+        Profiler::ScopedTimer timer(profiler, PROF_OUTPUT);
+        if (!output_image_path.empty()) camera->getImage()->writeImgToFile(output_image_path);
+        if (cost_maps.enabled) writeCostMaps();
+    }
+}
+
+void Simulator::simulate() {
+    if (parallel.enabled) {
+        simulateParallel();
+        return;
+    }
+    Profiler::ScopedTimer timer(profiler, PROF_SIMULATE);
+    Profiler::Clock::time_point start = Profiler::Clock::now(), last_progress = start, last_checkpoint = start;
+    sampling.current_ray = featurePool.rayID;
+    sampling.ray_start_cycle = 0;
     while (true) {
-        rayMarching();
-        hashEncoding();
-        shEncoding();
-        sigmaMLP();
-        colorMLP();
-        volumeRendering();
-
-        etFifo.update();
-        hash_in_Fifo.update();
-        hash_out_Fifo.update();
-        sh_in_Fifo.update();
-        sh_out_Fifo.update();
-        sigmlp_in_Fifo.update();
-        sigmlp_out_Fifo.update();
-        colmlpFifo_Hash.update();
-        colmlpFifo_SH.update();
-        colmlp_out_Fifo.update();
-        vr_in_Fifo.update();
-        vr_out_Fifo.update();
+        pipeline.tick([this](int stage, auto&& step) {
+            profiler.timeFine(PROF_RAYMARCHING + stage, step);
+        });
+        // Writes of this cycle become visible to the consumers
+        profiler.timeFine(PROF_FIFO_UPDATE, [this] {
+            for (StageClock& clock : clocks) clock.cycle++;
+        });
+        sampleReorderStats(COLORMLP);
+        sampleReorderStats(VOLUMERENDERING);
+        if (bottleneck.enabled) sampleOccupancy();
 
         history.cycleCount++;
-        rayCount = featurePool.rayMarchingID;
-        if (rayCount >= MAX_RAY_COUNT) {
+        history.simulatedCycles++;
+        if (endRayMarchingCycle()) {
             break;
         }
-        
-        if (rayCount % 500000 == 1) {
-            printf("Cycle Count: %d\n", history.cycleCount);
-            printf("Ray Count: %d\n", rayCount);
+
+        // Only look at the clock every 64K cycles
+        if ((history.cycleCount & 0xFFFF) == 0) {
+            Profiler::Clock::time_point now = Profiler::Clock::now();
+            double elapsed = std::chrono::duration<double>(now - start).count();
+            if (std::chrono::duration<double>(now - last_progress).count() >= progress_interval_s) {
+                printProgress(elapsed);
+                last_progress = now;
+            }
+            std::string limit = limitReached(history.cycleCount, elapsed);
+            if (!limit.empty()) throw std::runtime_error(limit);
+            if (!checkpoint.path.empty() &&
+                std::chrono::duration<double>(now - last_checkpoint).count() >= checkpoint.interval_s) {
+                writeCheckpoint();
+                last_checkpoint = now;
+            }
         }
     }
+    finishFrame();
+    if (checkpoint.writer.joinable()) checkpoint.writer.join();
+}
 
-    std::shared_ptr<Image> img = camera->getImage();
-    for (int i = 0; i < img->getResolution().x(); i++) {
-        for (int j = 0; j < img->getResolution().y(); j++) {
-            if (history.opacities[i * img->getResolution().y() + j] < featurePool.opacities[i * img->getResolution().y() + j]) {
-                history.rgbs[i * img->getResolution().y() + j] = featurePool.colors[i * img->getResolution().y() + j];
-                history.opacities[i * img->getResolution().y() + j] = featurePool.opacities[i * img->getResolution().y() + j];
+// After ray marching finished cycle history.cycleCount - 1: per-ray cycles
+// for sampling, and whether every ray has been marched
+bool Simulator::endRayMarchingCycle() {
+    if (sampling.enabled && featurePool.rayID != sampling.current_ray) {
+        // Ray marching moved on: the previous ray is done issuing samples
+        sampling.ray_cycles.push_back(history.cycleCount - sampling.ray_start_cycle);
+        sampling.ray_start_cycle = history.cycleCount;
+        sampling.current_ray = featurePool.rayID;
+    }
+    rayCount = featurePool.rayMarchingID;
+    return rayCount >= MAX_RAY_COUNT;
+}
+
+void Simulator::sampleReorderStats(int stage) {
+    if (stage == COLORMLP && reorder.join_size > 0) {
+        reorder.join_occupancy += reorder.join.getCount();
+        reorder.join_peak = std::max(reorder.join_peak, reorder.join.getCount());
+    }
+    if (stage == VOLUMERENDERING && reorder.vr_size > 0) {
+        reorder.vr_occupancy += reorder.vr.getCount();
+        reorder.vr_peak = std::max(reorder.vr_peak, reorder.vr.getCount());
+    }
+}
+
+template <typename T>
+void Simulator::connect(FIFO<T>& fifo, Stage producer, Stage consumer) {
+    fifo.bind(&clocks[producer].cycle, &clocks[consumer].cycle, consumer <= producer);
+    if (producer == consumer) return;
+    // The consumer sees writes of earlier cycles, the producer sees reads up
+    // to the cycle before, or up to this cycle if the consumer runs first
+    int& consumer_lead = parallel.lead[consumer][producer];
+    int& producer_lead = parallel.lead[producer][consumer];
+    consumer_lead = std::max(consumer_lead, 0);
+    producer_lead = std::max(producer_lead, consumer < producer ? 1 : 0);
+}
+
+void Simulator::connectStages() {
+    for (int s = 0; s < 6; s++) {
+        for (int t = 0; t < 6; t++) parallel.lead[s][t] = -1;
+        // Ray marching decides when the frame ends
+        parallel.lead[s][RAYMARCHING] = s == RAYMARCHING ? -1 : 0;
+    }
+    connect(etFifo, VOLUMERENDERING, RAYMARCHING);
+    connect(hash_in_Fifo, RAYMARCHING, HASHENCODING);
+    connect(hash_out_Fifo, HASHENCODING, HASHENCODING);
+    connect(sh_in_Fifo, RAYMARCHING, SHENCODING);
+    connect(sh_out_Fifo, SHENCODING, SHENCODING);
+    connect(sigmlp_in_Fifo, HASHENCODING, SIGMAMLP);
+    connect(sigmlp_out_Fifo, SIGMAMLP, SIGMAMLP);
+    connect(colmlpFifo_Hash, SIGMAMLP, COLORMLP);
+    connect(colmlpFifo_SH, SHENCODING, COLORMLP);
+    connect(colmlp_out_Fifo, COLORMLP, COLORMLP);
+    connect(vr_in_Fifo, COLORMLP, VOLUMERENDERING);
+    connect(vr_out_Fifo, VOLUMERENDERING, VOLUMERENDERING);
+    // Ray marching and volume rendering share the ray buffer. Volume
+    // rendering of a cycle sees that cycle's ray marching, which the
+    // ET FIFO already orders.
+}
+
+void Simulator::waitForStage(int stage, long long cycles, long long& waits) {
+    const std::atomic<long long>& done = clocks[stage].done;
+    if (done.load(std::memory_order_acquire) >= cycles) return;
+    waits++;
+    for (int spin = 0; done.load(std::memory_order_acquire) < cycles; spin++) {
+        if (spin >= 64) std::this_thread::yield();
+    }
+}
+
+// Ray marching decides when the frame ends: false if it ended before cycle.
+// A stage may have skipped past the end, so don't wait for ray marching there.
+bool Simulator::waitForRayMarching(long long cycle, long long& waits) {
+    const std::atomic<long long>& done = clocks[RAYMARCHING].done;
+    if (done.load(std::memory_order_acquire) < cycle) {
+        waits++;
+        for (int spin = 0; done.load(std::memory_order_acquire) < cycle; spin++) {
+            if (parallel.stop.load(std::memory_order_acquire) < cycle) break;
+            if (spin >= 64) std::this_thread::yield();
+        }
+    }
+    return cycle <= parallel.stop.load(std::memory_order_acquire);
+}
+
+// One stage thread. While a stage only counts down its latency it neither
+// reads nor writes anything shared, so those cycles are passed at once and
+// the stages waiting on it can run ahead (the conservative lookahead).
+template <int S>
+void Simulator::runStage() {
+    StageClock& clock = clocks[S];
+    bool busy_is_idle = S == SHENCODING || S == SIGMAMLP ||
+        (S == HASHENCODING && !hash_miss.enabled) ||
+        (S == COLORMLP && reorder.join_size == 0) ||
+        (S == VOLUMERENDERING && reorder.vr_size == 0);
+    for (long long& cycle = clock.cycle; ; cycle++) {
+        if (S != RAYMARCHING && !waitForRayMarching(cycle, parallel.waits[S])) {
+            break;
+        }
+        for (int t = 0; t < 6; t++) {
+            if (parallel.lead[S][t] > 0 || (t != RAYMARCHING && parallel.lead[S][t] == 0)) {
+                waitForStage(t, cycle + parallel.lead[S][t], parallel.waits[S]);
             }
         }
+
+        pipeline.tickStage<S>();
+        sampleReorderStats(S);
+
+        if (S == RAYMARCHING) {
+            history.cycleCount = cycle + 1;
+            if (endRayMarchingCycle() || parallel.abort.load(std::memory_order_relaxed)) {
+                parallel.stop.store(cycle, std::memory_order_release);
+                clock.done.store(cycle + 1, std::memory_order_release);
+                break;
+            }
+        }
+        else if (busy_is_idle && waitCounter[S] > 0) {
+            parallel.skipped[S] += waitCounter[S];
+            cycle += waitCounter[S];
+            waitCounter[S] = 0;
+        }
+        clock.done.store(cycle + 1, std::memory_order_release);
+    }
+    parallel.finished++;
+}
+
+void Simulator::simulateParallel() {
+    Profiler::ScopedTimer timer(profiler, PROF_SIMULATE);
+    Profiler::Clock::time_point start = Profiler::Clock::now(), last_progress = start;
+    sampling.current_ray = featurePool.rayID;
+    sampling.ray_start_cycle = 0;
+    int first_cycle = history.cycleCount;
+    long long issued = history.samplesIssued, rendered = history.samplesRendered;
+    parallel.stop.store(LLONG_MAX);
+    parallel.finished.store(0);
+    parallel.abort.store(false);
+    std::string limit;
+    for (int s = 0; s < 6; s++) {
+        parallel.waits[s] = parallel.skipped[s] = 0;
+    }
+
+    std::thread threads[6] = {
+        std::thread(&Simulator::runStage<RAYMARCHING>, this),
+        std::thread(&Simulator::runStage<HASHENCODING>, this),
+        std::thread(&Simulator::runStage<SHENCODING>, this),
+        std::thread(&Simulator::runStage<SIGMAMLP>, this),
+        std::thread(&Simulator::runStage<COLORMLP>, this),
+        std::thread(&Simulator::runStage<VOLUMERENDERING>, this)
+    };
+    while (parallel.finished.load() < 6) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        Profiler::Clock::time_point now = Profiler::Clock::now();
+        if (limit.empty()) {
+            limit = limitReached(clocks[RAYMARCHING].done.load(std::memory_order_relaxed),
+                std::chrono::duration<double>(now - start).count());
+            if (!limit.empty()) parallel.abort.store(true, std::memory_order_relaxed);
+        }
+        if (std::chrono::duration<double>(now - last_progress).count() >= progress_interval_s) {
+            double elapsed = std::chrono::duration<double>(now - start).count();
+            long long cycles = clocks[RAYMARCHING].done.load(std::memory_order_relaxed);
+            printf("[%7.1f s] Cycle Count: %lld | %.3f Mcycles/s (parallel)\n", elapsed, cycles, cycles / elapsed * 1e-6);
+            fflush(stdout);
+            if (progress_callback) progress_callback({{"elapsed_s", elapsed}, {"cycle_count", cycles}});
+            last_progress = now;
+        }
+    }
+    for (std::thread& thread : threads) thread.join();
+    if (!limit.empty()) throw std::runtime_error(limit);
+
+    history.simulatedCycles += history.cycleCount - first_cycle;
+    parallel.samples_issued = history.samplesIssued - issued;
+    parallel.samples_rendered = history.samplesRendered - rendered;
+    parallel.host_time_s = std::chrono::duration<double>(Profiler::Clock::now() - start).count();
+    finishFrame();
+}
+
+// Rerun the frame on the sequential simulator and compare
+void Simulator::validateParallel() {
+    int cycle_count = history.cycleCount;
+    uint64_t checksum = frameChecksum();
+    RunStats stats = saveRunStats();
+    initialize();
+    if (sampling.enabled) selectSampledPixels();
+    parallel.enabled = false;
+    auto start = std::chrono::steady_clock::now();
+    simulate();
+    parallel.enabled = true;
+    parallel.sequential_host_time_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    parallel.sequential_cycle_count = history.cycleCount;
+    parallel.validated = true;
+    parallel.matched = history.cycleCount == cycle_count && frameChecksum() == checksum &&
+        history.samplesIssued == parallel.samples_issued &&
+        history.samplesRendered == parallel.samples_rendered;
+    restoreRunStats(stats);
+}
+
+Simulator::RunStats Simulator::saveRunStats() {
+    RunStats stats(profiler);
+    stats.ray_count = rayCount;
+    stats.simulated_cycles = history.simulatedCycles;
+    stats.samples_issued = history.samplesIssued;
+    stats.samples_rendered = history.samplesRendered;
+    std::copy(std::begin(stalls), std::end(stalls), std::begin(stats.stalls));
+    stats.ray_buffer_peak = rayTable.peak_occupied;
+    stats.ray_buffer_full_stall_cycles = rayTable.full_stall_cycles;
+    stats.join_occupancy = reorder.join_occupancy;
+    stats.vr_occupancy = reorder.vr_occupancy;
+    stats.join_peak = reorder.join_peak;
+    stats.vr_peak = reorder.vr_peak;
+    stats.join_stall_cycles = reorder.join_stall_cycles;
+    stats.vr_stall_cycles = reorder.vr_stall_cycles;
+    stats.vr_order_stall_cycles = reorder.vr_order_stall_cycles;
+    stats.hash_lookups = hash_miss.lookups;
+    stats.hash_misses = hash_miss.misses;
+    stats.sh_evaluations = sh_evaluations;
+    stats.sh_reuses = sh_reuses;
+    std::copy(std::begin(pruning.dense_cycles), std::end(pruning.dense_cycles), std::begin(stats.dense_cycles));
+    std::copy(std::begin(pruning.sparse_cycles), std::end(pruning.sparse_cycles), std::begin(stats.sparse_cycles));
+    stats.lanes = lanes;
+    stats.march = march;
+    stats.energy = energy;
+    stats.bottleneck = bottleneck;
+    stats.hash_analysis = std::move(hash_analysis);
+
+    // The rerun starts its counters from zero
+    history.simulatedCycles = history.samplesIssued = history.samplesRendered = 0;
+    sh_evaluations = sh_reuses = 0;
+    for (int i = 0; i < 2; i++) pruning.dense_cycles[i] = pruning.sparse_cycles[i] = 0;
+    std::fill(std::begin(lanes.packets), std::end(lanes.packets), 0);
+    std::fill(std::begin(lanes.samples), std::end(lanes.samples), 0);
+    march.rays = march.samples = march.steps = march.extra_cycles = 0;
+    march.dt_sum = 0.0;
+    std::fill(std::begin(energy.accesses), std::end(energy.accesses), 0);
+    return stats;
+}
+
+void Simulator::restoreRunStats(RunStats& stats) {
+    profiler = stats.profiler;
+    rayCount = stats.ray_count;
+    history.simulatedCycles = stats.simulated_cycles;
+    history.samplesIssued = stats.samples_issued;
+    history.samplesRendered = stats.samples_rendered;
+    std::copy(std::begin(stats.stalls), std::end(stats.stalls), std::begin(stalls));
+    rayTable.peak_occupied = stats.ray_buffer_peak;
+    rayTable.full_stall_cycles = stats.ray_buffer_full_stall_cycles;
+    reorder.join_occupancy = stats.join_occupancy;
+    reorder.vr_occupancy = stats.vr_occupancy;
+    reorder.join_peak = stats.join_peak;
+    reorder.vr_peak = stats.vr_peak;
+    reorder.join_stall_cycles = stats.join_stall_cycles;
+    reorder.vr_stall_cycles = stats.vr_stall_cycles;
+    reorder.vr_order_stall_cycles = stats.vr_order_stall_cycles;
+    hash_miss.lookups = stats.hash_lookups;
+    hash_miss.misses = stats.hash_misses;
+    sh_evaluations = stats.sh_evaluations;
+    sh_reuses = stats.sh_reuses;
+    std::copy(std::begin(stats.dense_cycles), std::end(stats.dense_cycles), std::begin(pruning.dense_cycles));
+    std::copy(std::begin(stats.sparse_cycles), std::end(stats.sparse_cycles), std::begin(pruning.sparse_cycles));
+    lanes = stats.lanes;
+    march = stats.march;
+    energy = std::move(stats.energy);
+    bottleneck = std::move(stats.bottleneck);
+    hash_analysis = std::move(stats.hash_analysis);
+}
+
+// FNV-1a over the frame, or over the streamed error when there is no frame buffer
+uint64_t Simulator::frameChecksum() {
+    const unsigned char* bytes;
+    size_t size;
+    if (streaming.enabled) {
+        bytes = reinterpret_cast<const unsigned char*>(&streaming.squared_error);
+        size = sizeof(streaming.squared_error);
+    }
+    else {
+        const std::vector<Image::Color>& data = camera->getImage()->getData();
+        bytes = reinterpret_cast<const unsigned char*>(data.data());
+        size = data.size() * sizeof(Image::Color);
+    }
+    uint64_t hash = 1469598103934665603ull;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+void Simulator::printProgress(double elapsed) {
+    float tile_progress = featurePool.valid_pixel.empty() ? 1.0f :
+        static_cast<float>(featurePool.rayID) / static_cast<float>(featurePool.valid_pixel.size());
+    float progress = (streaming.marching_tile + tile_progress) / (streaming.tiles_x * streaming.tiles_y);
+    printf("[%7.1f s] Rays: %5.1f%% | Cycle Count: %d | %.3f Mcycles/s | %.3f Msamples/s\n",
+        elapsed, progress * 100, history.cycleCount,
+        history.cycleCount / elapsed * 1e-6, history.samplesIssued / elapsed * 1e-6);
+    fflush(stdout);
+    if (progress_callback) {
+        progress_callback({
+            {"elapsed_s", elapsed},
+            {"rays", progress},
+            {"cycle_count", history.cycleCount},
+            {"samples_issued", history.samplesIssued}
+        });
+    }
+}
+
+std::string Simulator::limitReached(long long cycles, double elapsed) const {
+    if (limits.max_cycles > 0 && cycles >= limits.max_cycles) {
+        return "Cycle limit of " + std::to_string(limits.max_cycles) + " reached";
+    }
+    if (limits.max_seconds > 0 && elapsed >= limits.max_seconds) {
+        char message[64];
+        snprintf(message, sizeof(message), "Time limit of %.1f s reached", limits.max_seconds);
+        return message;
+    }
+    return "";
+}
+
+void Simulator::selectSampledPixels() {
+    Vec2i resolution = camera->getResolution();
+    std::vector<int>& valid_pixel = featurePool.valid_pixel;
+    int num_valid = valid_pixel.size();
+    sampling.num_valid_pixel = num_valid;
+
+    // Estimate the sample counts by marching the occupancy grid only, with
+    // the first valid ray of each block standing in for the whole block
+    int block = Sampling::ESTIMATE_BLOCK;
+    int blocks_y = (resolution.y() + block - 1) / block;
+    auto blockOf = [&](int pixel) {
+        return (pixel / resolution.y()) / block * blocks_y + (pixel % resolution.y()) / block;
+    };
+    std::vector<int> block_ray(static_cast<size_t>((resolution.x() + block - 1) / block) * blocks_y, -1);
+    std::vector<int> marched;
+    for (int i = 0; i < num_valid; i++) {
+        int& first = block_ray[blockOf(valid_pixel[i])];
+        if (first < 0) {
+            first = i;
+            marched.push_back(i);
+        }
+    }
+    std::vector<int> marched_count(num_valid, 0);
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (size_t k = 0; k < marched.size(); k++) {
+        int i = marched[k];
+        int pixel = valid_pixel[i];
+        Ray ray = camera->generateRay(pixel / resolution.y(), pixel % resolution.y());
+        float t = featurePool.valid_t[i], dt;
+        int count = 0, steps = 0;
+        while (count < MAX_T_COUNT) {
+            t = march.policy.next(*occupancy_grid, ray, t, dt, steps);
+            if (t >= RAY_DEFAULT_MAX) break;
+            count++;
+        }
+        marched_count[i] = count;
+    }
+    std::vector<int> est_count(num_valid);
+    for (int i = 0; i < num_valid; i++) {
+        est_count[i] = marched_count[block_ray[blockOf(valid_pixel[i])]];
+    }
+
+    // Quantile bins of the estimated sample count
+    std::vector<int> sorted_count = est_count;
+    std::sort(sorted_count.begin(), sorted_count.end());
+    std::vector<int> bin_upper(Sampling::NUM_COUNT_BINS - 1);
+    for (int b = 0; b < Sampling::NUM_COUNT_BINS - 1; b++) {
+        bin_upper[b] = num_valid > 0 ? sorted_count[(b + 1) * num_valid / Sampling::NUM_COUNT_BINS] : 0;
+    }
+
+    int tile = sampling.tile_size;
+    int tiles_y = (resolution.y() + tile - 1) / tile;
+    int tiles_x = (resolution.x() + tile - 1) / tile;
+    int num_strata = tiles_x * tiles_y * Sampling::NUM_COUNT_BINS;
+    std::vector<std::vector<int>> strata(num_strata);
+    for (int i = 0; i < num_valid; i++) {
+        int pixel = valid_pixel[i];
+        int tile_id = (pixel / resolution.y()) / tile * tiles_y + (pixel % resolution.y()) / tile;
+        int bin = std::upper_bound(bin_upper.begin(), bin_upper.end(), est_count[i]) - bin_upper.begin();
+        strata[tile_id * Sampling::NUM_COUNT_BINS + bin].push_back(i);
     }
 
-    // Write history data to image
-    for (int i = 0; i < img->getResolution().x(); i++) {
-        for (int j = 0; j < img->getResolution().y(); j++) {
-            Vec3f color = history.rgbs[i * img->getResolution().y() + j];
-            img->setPixel(i, img->getResolution().y() - 1 - j, color);
+    // Proportional allocation, at least two rays per stratum for a variance estimate
+    std::mt19937 rng(sampling.seed);
+    std::vector<std::pair<int, int>> chosen; // (index in valid_pixel, stratum)
+    sampling.stratum_size.assign(num_strata, 0);
+    for (int h = 0; h < num_strata; h++) {
+        std::vector<int>& members = strata[h];
+        int N_h = members.size();
+        sampling.stratum_size[h] = N_h;
+        if (N_h == 0) continue;
+        int n_h = static_cast<int>(std::lround(sampling.ratio * N_h));
+        n_h = std::min(N_h, std::max(n_h, std::min(2, N_h)));
+        for (int k = 0; k < n_h; k++) {
+            std::uniform_int_distribution<int> pick(k, N_h - 1);
+            std::swap(members[k], members[pick(rng)]);
+            chosen.push_back({members[k], h});
         }
     }
-    img->writeImgToFile("output.png");
+    // Keep the original scan order so neighbouring rays stay neighbours
+    std::sort(chosen.begin(), chosen.end());
+
+    std::vector<int> sampled_pixel(chosen.size());
+    std::vector<float> sampled_t(chosen.size());
+    sampling.ray_stratum.resize(chosen.size());
+    for (size_t k = 0; k < chosen.size(); k++) {
+        sampled_pixel[k] = valid_pixel[chosen[k].first];
+        sampled_t[k] = featurePool.valid_t[chosen[k].first];
+        sampling.ray_stratum[k] = chosen[k].second;
+    }
+    valid_pixel.swap(sampled_pixel);
+    featurePool.valid_t.swap(sampled_t);
+    sampling.num_sampled_pixel = valid_pixel.size();
+    if (energy.enabled) energy.ray_accesses.assign(chosen.size() * NUM_ACCESSES, 0);
+    printf("Sampled Rays: %d / %d\n", static_cast<int>(valid_pixel.size()), num_valid);
 }
 
-void Simulator::printHistory() {
+void Simulator::estimateFromSamples() {
+    int num_strata = sampling.stratum_size.size();
+    std::vector<double> sum(num_strata, 0.0), sum_sq(num_strata, 0.0);
+    std::vector<int> n(num_strata, 0);
+    long long per_ray_total = 0;
+    for (size_t k = 0; k < sampling.ray_cycles.size(); k++) {
+        int h = sampling.ray_stratum[k];
+        double c = sampling.ray_cycles[k];
+        sum[h] += c;
+        sum_sq[h] += c * c;
+        n[h]++;
+        per_ray_total += sampling.ray_cycles[k];
+    }
+
+    // Stratified estimator of the total with finite population correction
+    double total = 0.0, variance = 0.0;
+    for (int h = 0; h < num_strata; h++) {
+        if (n[h] == 0) continue;
+        double N_h = sampling.stratum_size[h];
+        double mean = sum[h] / n[h];
+        total += N_h * mean;
+        if (n[h] > 1) {
+            double s2 = (sum_sq[h] - n[h] * mean * mean) / (n[h] - 1);
+            variance += N_h * N_h * (1.0 - n[h] / N_h) * std::max(s2, 0.0) / n[h];
+        }
+    }
+    // Pipeline fill and drain are paid once per frame
+    total += history.cycleCount - per_ray_total;
+
+    // Energy accesses of the frame, from the per-ray counts of each stratum
+    if (energy.enabled) {
+        std::vector<double> access_sum(num_strata * NUM_ACCESSES, 0.0);
+        std::vector<int> rays(num_strata, 0);
+        for (size_t k = 0; k < sampling.ray_stratum.size(); k++) {
+            int h = sampling.ray_stratum[k];
+            rays[h]++;
+            for (int a = 0; a < NUM_ACCESSES; a++) access_sum[h * NUM_ACCESSES + a] += energy.ray_accesses[k * NUM_ACCESSES + a];
+        }
+        std::fill(std::begin(energy.estimated), std::end(energy.estimated), 0.0);
+        for (int h = 0; h < num_strata; h++) {
+            if (rays[h] == 0) continue;
+            double scale = static_cast<double>(sampling.stratum_size[h]) / rays[h];
+            for (int a = 0; a < NUM_ACCESSES; a++) energy.estimated[a] += scale * access_sum[h * NUM_ACCESSES + a];
+        }
+    }
+
+    sampling.sampled_cycle_count = history.cycleCount;
+    sampling.estimated_cycles = total;
+    sampling.ci_half_width = 1.96 * std::sqrt(variance);
+    history.cycleCount = static_cast<int>(std::lround(total));
+}
+
+void Simulator::validateSampling() {
+    int estimated_cycle_count = history.cycleCount;
+    RunStats stats = saveRunStats();
+    auto start = std::chrono::steady_clock::now();
+    sampling.enabled = false;
+    initialize();
+    simulate();
+    sampling.enabled = true;
+    sampling.full_host_time_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    sampling.full_cycle_count = history.cycleCount;
+    sampling.validated = true;
+    history.cycleCount = estimated_cycle_count;
+    restoreRunStats(stats);
+}
+
+nlohmann::json Simulator::printHistory() {
+    evaluateQuality();
+
     puts("========== Simulation History ==========");
     printf("Run Scene: %s\n", history.scene_name.c_str());
     printf("Simulation Frequency: %d MHz\n", history.frequency);
@@ -159,35 +777,1131 @@ void Simulator::printHistory() {
     float equ_fps_to_1920_1080 = 1.0 / (total_time / MAX_RAY_COUNT * 1920 * 1080);
     printf("Equivalent FPS to 800x800: %.6f\n", equ_fps_to_800_800);
     printf("Equivalent FPS to 1920x1080: %.6f\n", equ_fps_to_1920_1080);
+    if (history.has_quality) {
+        printf("PSNR(dB): %.6f\n", history.psnr);
+        if (history.has_ssim) printf("SSIM: %.6f\n", history.ssim);
+    }
+    if (streaming.enabled) {
+        printf("Streamed Tiles: %d (%dx%d px) to %s\n", streaming.tiles_written,
+            streaming.tile_size, streaming.tile_size, streaming.output_path.c_str());
+        printf("Valid Pixel Ratio: %.6f\n", static_cast<float>(streaming.valid_rays) / MAX_RAY_COUNT);
+        printf("Peak Open Tiles: %d\n", streaming.peak_open_tiles);
+    }
+    printf("Ray Buffer: %d / %d slots peak, %lld full stall cycles\n",
+        rayTable.peak_occupied, rayTable.capacity, rayTable.full_stall_cycles);
+    double cycles = std::max(history.cycleCount, 1);
+    if (reorder.join_size > 0) {
+        printf("Join Reorder Buffer: %.2f avg / %d peak of %d entries, %lld stall cycles\n",
+            reorder.join_occupancy / cycles, reorder.join_peak, reorder.join_size, reorder.join_stall_cycles);
+    }
+    if (reorder.vr_size > 0) {
+        printf("VR Reorder Buffer: %.2f avg / %d peak of %d entries, %lld stall cycles, %lld order stall cycles\n",
+            reorder.vr_occupancy / cycles, reorder.vr_peak, reorder.vr_size,
+            reorder.vr_stall_cycles, reorder.vr_order_stall_cycles);
+    }
+    if (hash_miss.enabled) {
+        printf("Hash Lookups: %lld, %lld misses (%.2f%%), %d cycles per miss, %zu outstanding\n",
+            hash_miss.lookups, hash_miss.misses, 100.0 * hash_miss.misses / std::max(hash_miss.lookups, 1LL),
+            hash_miss.latency, hash_miss.outstanding);
+    }
+    long long sh_requests = sh_evaluations + sh_reuses;
+    double sh_saved = sh_requests > 0 ? static_cast<double>(sh_reuses) / sh_requests : 0.0;
+    if (sh_per_ray) {
+        printf("SH Encoding: %lld evaluations for %lld samples, once per ray (%.2f%% saved), "
+            "%d cycles per evaluation, 1 per reuse\n", sh_evaluations, sh_requests, sh_saved * 100, latency[SHENCODING]);
+    }
+    double fps_low = 0.0, fps_high = 0.0;
+    if (sampling.enabled) {
+        double cycles_high = sampling.estimated_cycles + sampling.ci_half_width;
+        double cycles_low = std::max(sampling.estimated_cycles - sampling.ci_half_width, 1.0);
+        fps_low = 1.0 / (cycle_period * cycles_high);
+        fps_high = 1.0 / (cycle_period * cycles_low);
+        printf("Sampled Rays: %d / %d (%d cycles simulated)\n",
+            sampling.num_sampled_pixel, sampling.num_valid_pixel, sampling.sampled_cycle_count);
+        printf("Estimated Cycle Count: %.0f +- %.0f (95%% CI)\n", sampling.estimated_cycles, sampling.ci_half_width);
+        printf("Estimated FPS: %.6f [%.6f, %.6f]\n", fps, fps_low, fps_high);
+        if (sampling.validated) {
+            double error = (sampling.estimated_cycles - sampling.full_cycle_count) / sampling.full_cycle_count;
+            printf("Full Run Cycle Count: %d, Error: %.3f%%\n", sampling.full_cycle_count, error * 100);
+            printf("Host Time: %.3f s sampled vs %.3f s full\n", sampling.host_time_s, sampling.full_host_time_s);
+        }
+    }
+
+    nlohmann::json quant_report = printQuantization();
+    nlohmann::json pruning_report = printPruning();
+    nlohmann::json approx_report = printApproximation();
+    nlohmann::json parallel_report = printParallel();
+    nlohmann::json lanes_report = printLanes();
+    nlohmann::json march_report = printMarching();
+    nlohmann::json cost_maps_report = printCostMaps();
+    nlohmann::json energy_report = printEnergy();
+    nlohmann::json bottleneck_report = printBottleneck();
+    nlohmann::json checkpoint_report = printCheckpoint();
+    nlohmann::json hash_analysis_report;
+    if (hash_analysis) {
+        hash_analysis->print();
+        hash_analysis_report = hash_analysis->report();
+    }
+
+    double sim_seconds = profiler.getSeconds(PROF_SIMULATE);
+    double cycles_per_second = sim_seconds > 0 ? history.simulatedCycles / sim_seconds : 0.0;
+    double samples_per_second = sim_seconds > 0 ? history.samplesIssued / sim_seconds : 0.0;
+    puts("============= Host Profile =============");
+    profiler.print();
+    printf("Samples Issued: %lld, Rendered: %lld\n", history.samplesIssued, history.samplesRendered);
+    printf("Simulated Cycles per Host Second: %.0f\n", cycles_per_second);
+    printf("Samples per Host Second: %.0f\n", samples_per_second);
 
     // Write history data to file
     std::string freq_str = std::to_string(history.frequency);
-    std::string file_name = "History_" + freq_str + "MHz_" + history.scene_name + ".txt";
-    std::ofstream fout(file_name);
-    fout << "========== Simulation History ==========\n";
-    fout << "Run Scene: " << history.scene_name << "\n";
-    fout << "Simulation Frequency: " << history.frequency << " MHz\n";
-    fout << "Cycle Count: " << history.cycleCount << "\n";
-    fout << "Cycle Per Ray: " << static_cast<float>(history.cycleCount) / static_cast<float>(rayCount) << "\n";
-    fout << "Simulation Time: " << total_time << " s\n";
-    fout << "FPS: " << fps << "\n";
-    fout << "Equivalent FPS to 800x800: " << equ_fps_to_800_800 << "\n";
-    fout << "Equivalent FPS to 1920x1080: " << equ_fps_to_1920_1080 << "\n";
-    fout.close();
-
-    std::string call_psnr = "python ./eval.py " + history.scene_name + " " + freq_str;
-    system(call_psnr.c_str());
+    std::string file_name = "History_" + freq_str + "MHz_" + history.scene_name;
+    std::ofstream fout;
+    if (write_history_files) {
+        fout.open(file_name + ".txt");
+        fout << "========== Simulation History ==========\n";
+        fout << "Run Scene: " << history.scene_name << "\n";
+        fout << "Simulation Frequency: " << history.frequency << " MHz\n";
+        fout << "Cycle Count: " << history.cycleCount << "\n";
+        fout << "Cycle Per Ray: " << static_cast<float>(history.cycleCount) / static_cast<float>(rayCount) << "\n";
+        fout << "Simulation Time: " << total_time << " s\n";
+        fout << "FPS: " << fps << "\n";
+        fout << "Equivalent FPS to 800x800: " << equ_fps_to_800_800 << "\n";
+        fout << "Equivalent FPS to 1920x1080: " << equ_fps_to_1920_1080 << "\n";
+        if (history.has_quality) {
+            fout << "PSNR(dB): " << history.psnr << "\n";
+            if (history.has_ssim) fout << "SSIM: " << history.ssim << "\n";
+        }
+        if (sampling.enabled) {
+            fout << "Estimated Cycle Count: " << sampling.estimated_cycles << " +- " << sampling.ci_half_width << "\n";
+            fout << "Estimated FPS: " << fps << " [" << fps_low << ", " << fps_high << "]\n";
+            if (sampling.validated) {
+                fout << "Full Run Cycle Count: " << sampling.full_cycle_count << "\n";
+            }
+        }
+        fout.close();
+    }
+
+    // Structured run report
+    nlohmann::json report;
+    report["scene"] = history.scene_name;
+    report["frequency_mhz"] = history.frequency;
+    report["resolution"] = {camera->getResolution().x(), camera->getResolution().y()};
+    report["max_t_count"] = MAX_T_COUNT;
+    report["cycle_count"] = history.cycleCount;
+    report["ray_count"] = rayCount;
+    report["cycles_per_ray"] = static_cast<float>(history.cycleCount) / static_cast<float>(rayCount);
+    report["simulation_time_s"] = total_time;
+    report["fps"] = fps;
+    report["equivalent_fps_800x800"] = equ_fps_to_800_800;
+    report["equivalent_fps_1920x1080"] = equ_fps_to_1920_1080;
+    if (history.has_quality) {
+        report["quality"] = {{"psnr_db", history.psnr}};
+        if (history.has_ssim) report["quality"]["ssim"] = history.ssim;
+    }
+    report["ray_buffer"] = {
+        {"capacity", rayTable.capacity},
+        {"peak_occupied", rayTable.peak_occupied},
+        {"full_stall_cycles", rayTable.full_stall_cycles}
+    };
+    if (reorder.join_size > 0 || reorder.vr_size > 0) {
+        report["reorder_buffers"] = {
+            {"join", {
+                {"size", reorder.join_size},
+                {"avg_occupancy", reorder.join_size > 0 ? reorder.join_occupancy / cycles : 0.0},
+                {"peak_occupancy", reorder.join_peak},
+                {"stall_cycles", reorder.join_stall_cycles}
+            }},
+            {"volume_rendering", {
+                {"size", reorder.vr_size},
+                {"avg_occupancy", reorder.vr_size > 0 ? reorder.vr_occupancy / cycles : 0.0},
+                {"peak_occupancy", reorder.vr_peak},
+                {"stall_cycles", reorder.vr_stall_cycles},
+                {"order_stall_cycles", reorder.vr_order_stall_cycles}
+            }}
+        };
+    }
+    if (hash_miss.enabled) {
+        report["hash_misses"] = {
+            {"rate", hash_miss.rate},
+            {"latency", hash_miss.latency},
+            {"outstanding", hash_miss.outstanding},
+            {"lookups", hash_miss.lookups},
+            {"misses", hash_miss.misses}
+        };
+    }
+    report["sh_encoding"] = {
+        {"per_ray", sh_per_ray},
+        {"latency", latency[SHENCODING]},
+        {"evaluations", sh_evaluations},
+        {"reuses", sh_reuses},
+        {"saved_ratio", sh_saved}
+    };
+    if (streaming.enabled) {
+        report["streaming"] = {
+            {"tile_size", streaming.tile_size},
+            {"tiles_written", streaming.tiles_written},
+            {"output", streaming.output_path},
+            {"valid_rays", streaming.valid_rays},
+            {"peak_open_tiles", streaming.peak_open_tiles}
+        };
+    }
+    if (sampling.enabled) {
+        nlohmann::json& sp = report["sampling"];
+        sp["ratio"] = sampling.ratio;
+        sp["tile_size"] = sampling.tile_size;
+        sp["seed"] = sampling.seed;
+        sp["sampled_rays"] = sampling.num_sampled_pixel;
+        sp["valid_rays"] = sampling.num_valid_pixel;
+        sp["sampled_cycle_count"] = sampling.sampled_cycle_count;
+        sp["estimated_cycles"] = sampling.estimated_cycles;
+        sp["cycles_ci95"] = {sampling.estimated_cycles - sampling.ci_half_width, sampling.estimated_cycles + sampling.ci_half_width};
+        sp["fps_ci95"] = {fps_low, fps_high};
+        sp["host_time_s"] = sampling.host_time_s;
+        if (sampling.validated) {
+            sp["full_cycle_count"] = sampling.full_cycle_count;
+            sp["full_host_time_s"] = sampling.full_host_time_s;
+            sp["relative_error"] = (sampling.estimated_cycles - sampling.full_cycle_count) / sampling.full_cycle_count;
+            sp["within_ci"] = std::abs(sampling.estimated_cycles - sampling.full_cycle_count) <= sampling.ci_half_width;
+            sp["host_speedup"] = sampling.full_host_time_s / sampling.host_time_s;
+        }
+    }
+    report["quantization"] = quant_report;
+    if (pruning.enabled) report["sparse_mlp"] = pruning_report;
+    if (approx_enabled) report["approximation"] = approx_report;
+    if (parallel.enabled) report["parallel"] = parallel_report;
+    if (lanes.width > 1) report["lanes"] = lanes_report;
+    report["marching"] = march_report;
+    if (hash_analysis) report["hash_analysis"] = hash_analysis_report;
+    if (cost_maps.enabled) report["cost_maps"] = cost_maps_report;
+    if (energy.enabled) report["energy"] = energy_report;
+    if (bottleneck.enabled) report["bottleneck"] = bottleneck_report;
+    if (!checkpoint_report.is_null()) report["checkpoint"] = checkpoint_report;
+    report["host_profile"] = {
+        {"sections", profiler.toJson()},
+        {"fine_timing", profiler.isFineTiming()},
+        {"simulated_cycles", history.simulatedCycles},
+        {"samples_issued", history.samplesIssued},
+        {"samples_rendered", history.samplesRendered},
+        {"cycles_per_host_second", cycles_per_second},
+        {"samples_per_host_second", samples_per_second}
+    };
+    if (write_history_files) {
+        fout.open(file_name + ".json");
+        fout << report.dump(4) << "\n";
+        fout.close();
+    }
+    return report;
+}
+
+nlohmann::json Simulator::printApproximation() {
+    if (!approx_enabled) return nullptr;
+    puts("========== Transcendental Units ==========");
+    printf("%-12s %-20s %8s %9s %8s %6s %10s %12s\n",
+        "Unit", "Config", "Latency", "ROM bits", "Adders", "Mults", "Area(GE)", "Max Error");
+    nlohmann::json units;
+    const std::pair<const char*, const ApproxUnit*> list[] = {
+        {"density_exp", &approx.density_exp}, {"alpha_exp", &approx.alpha_exp}, {"sigmoid", &approx.sigmoid}
+    };
+    for (auto& entry : list) {
+        const ApproxUnit& unit = *entry.second;
+        printf("%-12s %-20s %8d %9d %8d %6d %10.0f %12.3e\n", entry.first, unit.name().c_str(),
+            unit.getLatency(), unit.romBits(), unit.adders(), unit.multipliers(), unit.areaGE(), unit.getMaxError());
+        units[entry.first] = {
+            {"config", unit.name()},
+            {"latency", unit.getLatency()},
+            {"rom_bits", unit.romBits()},
+            {"adders", unit.adders()},
+            {"multipliers", unit.multipliers()},
+            {"area_ge", unit.areaGE()},
+            {"max_error", unit.getMaxError()},
+            {"mean_error", unit.getMeanError()}
+        };
+    }
+    printf("Volume Rendering Latency: %d cycles\n", latency[VOLUMERENDERING] + approx_latency);
+    return {
+        {"units", units},
+        {"volume_rendering_latency", latency[VOLUMERENDERING] + approx_latency}
+    };
+}
+
+nlohmann::json Simulator::printMarching() {
+    double rays = std::max(march.rays, 1LL);
+    double samples_per_ray = march.samples / rays;
+    double steps_per_ray = march.steps / rays;
+    double mean_dt = march.samples > 0 ? march.dt_sum / march.samples : 0.0;
+    printf("Ray Marching: %s, %.2f samples/ray, %.1f steps/ray, mean dt %.3e, %lld extra cycles\n",
+        march.policy.name().c_str(), samples_per_ray, steps_per_ray, mean_dt, march.extra_cycles);
+    nlohmann::json report = {
+        {"policy", march.policy.name()},
+        {"steps_per_cycle", march.steps_per_cycle},
+        {"rays", march.rays},
+        {"samples", march.samples},
+        {"samples_per_ray", samples_per_ray},
+        {"steps_per_ray", steps_per_ray},
+        {"mean_dt", mean_dt},
+        {"extra_cycles", march.extra_cycles},
+        {"cycle_count", history.cycleCount}
+    };
+    if (history.has_quality) report["psnr_db"] = history.psnr;
+    if (quant_reference_psnr >= 0.0f) report["psnr_db_fp32"] = quant_reference_psnr;
+    return report;
+}
+
+void Simulator::writeCostMaps() {
+    std::filesystem::create_directories(cost_maps.directory);
+    Vec2i resolution = camera->getResolution();
+    std::string ext = cost_maps.pfm ? ".pfm" : ".raw";
+    std::string base = cost_maps.directory + "/";
+    camera->getImage()->writeFloatToFile(base + "color" + ext, cost_maps.pfm);
+    const std::pair<const char*, const std::vector<float>*> maps[] = {
+        {"alpha", &cost_maps.alpha}, {"depth", &cost_maps.depth}, {"samples", &cost_maps.samples},
+        {"cycles", &cost_maps.cycles}, {"termination", &cost_maps.termination}
+    };
+    for (const auto& map : maps) {
+        writeFloatImage(base + map.first + ext, map.second->data(), resolution.x(), resolution.y(), 1, cost_maps.pfm);
+    }
+}
+
+nlohmann::json Simulator::printCostMaps() {
+    if (!cost_maps.enabled) return nullptr;
+    long long reasons[4] = {0};
+    double samples = 0.0, cycles = 0.0;
+    float max_samples = 0.0f, max_cycles = 0.0f;
+    for (size_t p = 0; p < cost_maps.termination.size(); p++) {
+        int reason = static_cast<int>(cost_maps.termination[p]);
+        reasons[reason]++;
+        if (reason == NOT_MARCHED) continue;
+        samples += cost_maps.samples[p];
+        cycles += cost_maps.cycles[p];
+        max_samples = std::max(max_samples, cost_maps.samples[p]);
+        max_cycles = std::max(max_cycles, cost_maps.cycles[p]);
+    }
+    double marched = std::max(1LL, reasons[LEFT_GRID] + reasons[MAX_T] + reasons[EARLY]);
+    puts("========== Cost Maps ==========");
+    printf("Written to [%s] as %s\n", cost_maps.directory.c_str(), cost_maps.pfm ? "PFM" : "raw float32");
+    printf("Rays: %lld left the grid, %lld hit max_t_count, %lld terminated early, %lld pixels not marched\n",
+        reasons[LEFT_GRID], reasons[MAX_T], reasons[EARLY], reasons[NOT_MARCHED]);
+    printf("Samples per ray: mean %.2f, max %.0f. Cycles per ray: mean %.1f, max %.0f\n",
+        samples / marched, max_samples, cycles / marched, max_cycles);
+    Vec2i resolution = camera->getResolution();
+    return {
+        {"directory", cost_maps.directory},
+        {"format", cost_maps.pfm ? "pfm" : "raw"},
+        {"width", resolution.x()},
+        {"height", resolution.y()},
+        {"maps", {"color", "alpha", "depth", "samples", "cycles", "termination"}},
+        {"termination_codes", {"not_marched", "left_grid", "max_t", "early"}},
+        {"termination_counts", std::vector<long long>(reasons, reasons + 4)},
+        {"mean_samples", samples / marched},
+        {"max_samples", max_samples},
+        {"mean_cycles", cycles / marched},
+        {"max_cycles", max_cycles}
+    };
+}
+
+nlohmann::json Simulator::printEnergy() {
+    if (!energy.enabled) return nullptr;
+    using json = nlohmann::json;
+    const EnergyTable& e = energy.table;
+    const char* names[6] = {"rayMarching", "hashEncoding", "shEncoding", "sigmaMLP", "colorMLP", "volumeRendering"};
+    double pj[6] = {0.0}, bytes[6] = {0.0};
+    double seconds = std::max(history.cycleCount, 1) / (history.frequency * 1e6);
+    // A sampled run charges the frame estimate, like its cycle count
+    double count[NUM_ACCESSES];
+    for (int a = 0; a < NUM_ACCESSES; a++) {
+        count[a] = sampling.enabled ? energy.estimated[a] : static_cast<double>(energy.accesses[a]);
+    }
+
+    // Occupancy bits tested while marching
+    pj[RAYMARCHING] += count[OCCUPANCY_READS] * e.occupancy_read;
+    bytes[RAYMARCHING] += count[OCCUPANCY_READS] / 8.0;
+
+    int levels = hash_enc->getNumLevels(), features = hash_enc->getNumFeaturesPerLevel();
+    double read_bytes = count[HASH_CORNER_READS] * features * e.value_bytes;
+    pj[HASHENCODING] += read_bytes * e.hash_read_byte + count[HASH_INTERP_MACS] * e.mac;
+    bytes[HASHENCODING] += read_bytes;
+    json hash_levels = json::array();
+    for (int l = 0; l < levels; l++) {
+        hash_levels.push_back({
+            {"reads", count[HASH_CORNER_READS] / levels},
+            {"read_bytes", read_bytes / levels},
+            {"writes", 0},
+            {"table_bytes", static_cast<double>(hash_enc->getLevelSize(l)) * features * e.value_bytes}
+        });
+    }
+
+    pj[SHENCODING] += count[SH_EVALUATIONS] * e.sh_evaluation;
+
+    const Access mlp_accesses[2][2] = {{SIGMA_MACS, SIGMA_WEIGHT_READS}, {COLOR_MACS, COLOR_WEIGHT_READS}};
+    double weight_bytes[2];
+    for (int m = 0; m < 2; m++) {
+        int stage = m == 0 ? SIGMAMLP : COLORMLP;
+        weight_bytes[m] = count[mlp_accesses[m][1]] * e.value_bytes;
+        pj[stage] += count[mlp_accesses[m][0]] * e.mac + weight_bytes[m] * e.weight_read_byte;
+        bytes[stage] += weight_bytes[m];
+    }
+
+    // RGB8 per pixel
+    double framebuffer_bytes = count[PIXEL_WRITES] * 3;
+    pj[VOLUMERENDERING] += count[EXPS] * e.exp + count[SIGMOIDS] * e.sigmoid + framebuffer_bytes * e.framebuffer_write_byte;
+    bytes[VOLUMERENDERING] += framebuffer_bytes;
+
+    // FIFO traffic, charged to the producer: one entry per packet it writes
+    struct FifoTraffic {
+        const char* name;
+        int producer;
+        Access entries, samples;
+        int values;   // Per sample
+    };
+    const FifoTraffic fifo_traffic[] = {
+        {"hash_in", RAYMARCHING, MARCH_PACKETS, MARCH_SAMPLES, 3},
+        {"sh_in", RAYMARCHING, MARCH_PACKETS, MARCH_SAMPLES, 4},
+        {"hash_out", HASHENCODING, HASH_PACKETS, HASH_SAMPLES, 32},
+        {"sigmlp_in", HASHENCODING, HASH_PACKETS, HASH_SAMPLES, 32},
+        {"sh_out", SHENCODING, SH_PACKETS, SH_SAMPLES, 17},
+        {"colmlp_sh", SHENCODING, SH_PACKETS, SH_SAMPLES, 17},
+        {"sigmlp_out", SIGMAMLP, SIGMA_PACKETS, SIGMA_SAMPLES, 16},
+        {"colmlp_hash", SIGMAMLP, SIGMA_PACKETS, SIGMA_SAMPLES, 16},
+        {"colmlp_out", COLORMLP, COLOR_PACKETS, COLOR_SAMPLES, 5},
+        {"vr_in", COLORMLP, COLOR_PACKETS, COLOR_SAMPLES, 5},
+        {"vr_out", VOLUMERENDERING, VR_PACKETS, VR_SAMPLES, 0},
+        {"et", VOLUMERENDERING, ET_WRITES, VR_SAMPLES, 0}
+    };
+    json fifos;
+    for (const FifoTraffic& fifo : fifo_traffic) {
+        double moved = count[fifo.entries] * e.header_bytes + count[fifo.samples] * fifo.values * e.value_bytes;
+        pj[fifo.producer] += moved * e.fifo_byte;
+        bytes[fifo.producer] += moved;
+        fifos[fifo.name] = {{"entries", count[fifo.entries]}, {"bytes", moved}};
+    }
+
+    double total_pj = 0.0, total_bytes = 0.0;
+    for (int s = 0; s < 6; s++) {
+        total_pj += pj[s];
+        total_bytes += bytes[s];
+    }
+    puts("========== Bandwidth and Energy ==========");
+    printf("%-16s %14s %12s %14s %9s\n", "Stage", "Bytes/Frame", "GB/s", "Energy (uJ)", "Share");
+    json stages;
+    for (int s = 0; s < 6; s++) {
+        printf("%-16s %14.0f %12.3f %14.3f %8.2f%%\n", names[s], bytes[s], bytes[s] / seconds / 1e9,
+            pj[s] * 1e-6, total_pj > 0 ? 100.0 * pj[s] / total_pj : 0.0);
+        stages[names[s]] = {
+            {"bytes", bytes[s]},
+            {"bandwidth_gbps", bytes[s] / seconds / 1e9},
+            {"energy_j", pj[s] * 1e-12}
+        };
+    }
+    double joules = total_pj * 1e-12;
+    printf("Energy per Frame: %.6f mJ, Average Power: %.3f W at %d MHz\n", joules * 1e3, joules / seconds, history.frequency);
+    printf("Bandwidth: %.3f GB/s average, %.0f bytes per frame\n", total_bytes / seconds / 1e9, total_bytes);
+    json report = {
+        {"table_pj", e.toJson()},
+        {"stages", stages},
+        {"hash_levels", hash_levels},
+        {"fifos", fifos},
+        {"operations", {
+            {"occupancy_reads", count[OCCUPANCY_READS]},
+            {"hash_interp_macs", count[HASH_INTERP_MACS]},
+            {"sh_evaluations", count[SH_EVALUATIONS]},
+            {"sigma_macs", count[SIGMA_MACS]},
+            {"color_macs", count[COLOR_MACS]},
+            {"sigma_weight_bytes", weight_bytes[0]},
+            {"color_weight_bytes", weight_bytes[1]},
+            {"exp", count[EXPS]},
+            {"sigmoid", count[SIGMOIDS]},
+            {"framebuffer_bytes", framebuffer_bytes}
+        }},
+        {"energy_per_frame_j", joules},
+        {"average_power_w", joules / seconds},
+        {"bytes_per_frame", total_bytes},
+        {"bandwidth_gbps", total_bytes / seconds / 1e9}
+    };
+    if (energy.target_fps > 0) {
+        double required = total_bytes * energy.target_fps / 1e9;
+        printf("Required at %.1f FPS: %.3f GB/s, %.3f W\n", energy.target_fps, required, joules * energy.target_fps);
+        report["target_fps"] = energy.target_fps;
+        report["required_bandwidth_gbps"] = required;
+        report["required_power_w"] = joules * energy.target_fps;
+    }
+    if (sampling.enabled) {
+        puts("Estimated from the sampled rays, per stratum like the cycle count");
+        report["sampled"] = true;
+    }
+    return report;
+}
+
+void Simulator::sampleOccupancy() {
+    size_t f = 0;
+    forEachFifo([this, &f](const char*, auto& fifo) {
+        if (bottleneck.occupancy.size() <= f) bottleneck.occupancy.emplace_back(fifo.getCapacity() + 1, 0);
+        long long count = std::min<long long>(fifo.getCount(), fifo.getCapacity());
+        bottleneck.occupancy[f++][count]++;
+    });
+    bottleneck.sampled_cycles++;
+}
+
+nlohmann::json Simulator::printBottleneck() {
+    if (!bottleneck.enabled) return nullptr;
+    using json = nlohmann::json;
+    const char* names[6] = {"rayMarching", "hashEncoding", "shEncoding", "sigmaMLP", "colorMLP", "volumeRendering"};
+    double cycles = std::max(history.cycleCount, 1);
+    double busy[6];
+    int critical = 0;
+    json stages;
+    puts("========== Bottleneck Analysis ==========");
+    printf("%-16s %10s %10s %10s %12s %12s\n", "Stage", "Busy", "Blocked", "Starved", "Executions", "Cycles/Exec");
+    for (int s = 0; s < 6; s++) {
+        busy[s] = std::max(0.0, cycles - stalls[s].blocked - stalls[s].starved);
+        if (busy[s] > busy[critical]) critical = s;
+        double service = lanes.packets[s] > 0 ? busy[s] / lanes.packets[s] : 0.0;
+        printf("%-16s %9.2f%% %9.2f%% %9.2f%% %12lld %12.2f\n", names[s], 100 * busy[s] / cycles,
+            100 * stalls[s].blocked / cycles, 100 * stalls[s].starved / cycles, lanes.packets[s], service);
+        stages[names[s]] = {
+            {"busy_cycles", busy[s]},
+            {"blocked_cycles", stalls[s].blocked},
+            {"starved_cycles", stalls[s].starved},
+            {"executions", lanes.packets[s]},
+            {"cycles_per_execution", service},
+            {"latency", latency[s]}
+        };
+    }
+
+    json fifos;
+    size_t f = 0;
+    forEachFifo([this, &f, &fifos](const char* name, auto& fifo) {
+        long long full_checks, full, empty_checks, empty;
+        fifo.getCheckCounts(full_checks, full, empty_checks, empty);
+        json entry = {
+            {"capacity", fifo.getCapacity()},
+            {"full_checks", full_checks},
+            {"full", full},
+            {"empty_checks", empty_checks},
+            {"empty", empty}
+        };
+        if (f < bottleneck.occupancy.size()) {
+            const std::vector<long long>& histogram = bottleneck.occupancy[f];
+            double mean = 0.0;
+            for (size_t k = 0; k < histogram.size(); k++) mean += static_cast<double>(k) * histogram[k];
+            entry["occupancy_histogram"] = histogram;
+            entry["mean_occupancy"] = mean / std::max(bottleneck.sampled_cycles, 1LL);
+            entry["full_fraction"] = static_cast<double>(histogram.back()) / std::max(bottleneck.sampled_cycles, 1LL);
+        }
+        fifos[name] = entry;
+        f++;
+    });
+    if (!bottleneck.occupancy.empty()) {
+        printf("%-12s %8s %10s %10s\n", "FIFO", "Capacity", "Mean Occ.", "Full");
+        forEachFifo([&fifos](const char* name, auto&) {
+            const json& entry = fifos[name];
+            printf("%-12s %8d %10.2f %9.2f%%\n", name, entry["capacity"].get<int>(),
+                entry["mean_occupancy"].get<double>(), 100 * entry["full_fraction"].get<double>());
+        });
+    }
+
+    // What-if: the frame takes the busiest stage's cycles plus the fill and
+    // drain overhead. Every stage executes the packets ray marching forms, so
+    // one more lane only widens packets when the whole datapath gets it; each
+    // stage then shrinks with the packets its upstream would supply. One cycle
+    // less latency saves a cycle per execution of that stage alone. Cycles per
+    // execution are measured, they include what approximate units, sparse MLPs
+    // or ray marching add to the configured latency.
+    double overhead = cycles - busy[critical];
+    struct WhatIf {
+        std::string change;
+        double cycles;
+    };
+    std::vector<WhatIf> what_ifs;
+    double packet_scale = 1.0;
+    if (lanes.width < MAX_LANES && lanes.packets[RAYMARCHING] > 0) {
+        packet_scale = static_cast<double>(bottleneck.wider_packets) / lanes.packets[RAYMARCHING];
+        double slowest = 0.0;
+        for (int s = 0; s < 6; s++) slowest = std::max(slowest, busy[s] * packet_scale);
+        what_ifs.push_back({"all stages: " + std::to_string(lanes.width + 1) + " lanes", overhead + slowest});
+    }
+    for (int s = 0; s < 6; s++) {
+        if (lanes.packets[s] == 0 || busy[s] / lanes.packets[s] <= 1.0) continue;
+        double others = 0.0;
+        for (int t = 0; t < 6; t++) {
+            if (t != s) others = std::max(others, busy[t]);
+        }
+        double with_latency = std::max(0.0, busy[s] - lanes.packets[s]);
+        what_ifs.push_back({std::string(names[s]) + ": -1 cycle latency", overhead + std::max(others, with_latency)});
+    }
+    std::stable_sort(what_ifs.begin(), what_ifs.end(), [](const WhatIf& a, const WhatIf& b) {
+        return a.cycles < b.cycles;
+    });
+    printf("Critical Stage: %s, busy %.2f%% of %d cycles\n", names[critical], 100 * busy[critical] / cycles, history.cycleCount);
+    puts("Recommendations (estimated):");
+    json ranked = json::array();
+    for (size_t i = 0; i < what_ifs.size(); i++) {
+        double speedup = cycles / std::max(what_ifs[i].cycles, 1.0);
+        if (i < 5 && speedup > 1.0005) {
+            printf("  %zu. %-36s %12.0f cycles, %.3fx\n", i + 1, what_ifs[i].change.c_str(), what_ifs[i].cycles, speedup);
+        }
+        ranked.push_back({
+            {"change", what_ifs[i].change},
+            {"estimated_cycles", what_ifs[i].cycles},
+            {"estimated_speedup", speedup}
+        });
+    }
+    if (what_ifs.empty() || cycles / std::max(what_ifs[0].cycles, 1.0) <= 1.0005) {
+        puts("  No single change is estimated to help");
+    }
+    return {
+        {"critical_stage", names[critical]},
+        {"wider_packet_scale", packet_scale},
+        {"cycle_count", history.cycleCount},
+        {"stages", stages},
+        {"fifos", fifos},
+        {"sampled_cycles", bottleneck.sampled_cycles},
+        {"what_if", ranked}
+    };
+}
+
+// FNV-1a over the options that shape the run and the work list of the prepass
+uint64_t Simulator::checkpointFingerprint() {
+    std::stringstream options;
+    Vec2i resolution = camera->getResolution();
+    options << history.scene_name << ' ' << resolution.x() << 'x' << resolution.y() << ' ' << MAX_T_COUNT
+        << ' ' << rayTable.capacity << ' ' << lanes.width << ' ' << sh_per_ray << ':' << latency[SHENCODING]
+        << ' ' << reorder.join_size << ':' << reorder.vr_size
+        << ' ' << hash_miss.enabled << ':' << hash_miss.rate << ':' << hash_miss.latency << ':'
+        << hash_miss.outstanding << ':' << hash_miss.seed
+        << ' ' << march.policy.name() << ':' << march.steps_per_cycle
+        << ' ' << quant.hash_table.name() << ',' << quant.hash_interp.name() << ',' << quant.mlp_weights.name()
+        << ',' << quant.mlp_accum.name() << ',' << quant.volume.name()
+        << ' ' << approx.density_exp.name() << ',' << approx.alpha_exp.name() << ',' << approx.sigmoid.name()
+        << ' ' << pruning.enabled << ':' << pruning.threshold << ':' << pruning.target_sparsity << ':'
+        << pruning.pe.num_pe << 'x' << pruning.pe.macs_per_pe
+        << ' ' << cost_maps.enabled << ' ' << bottleneck.enabled
+        << ' ' << (streaming.enabled ? streaming.tile_size : 0);
+    for (int l : latency) options << ' ' << l;
+    std::string text = options.str();
+    uint64_t hash = 1469598103934665603ull;
+    auto mix = [&hash](const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++) hash = (hash ^ bytes[i]) * 1099511628211ull;
+    };
+    mix(text.data(), text.size());
+    mix(featurePool.valid_pixel.data(), featurePool.valid_pixel.size() * sizeof(int));
+    mix(featurePool.valid_t.data(), featurePool.valid_t.size() * sizeof(float));
+    return hash;
+}
+
+// Everything the cycle loop changes. The work list is rebuilt by the
+// prepass and only covered by the fingerprint.
+void Simulator::saveState(CheckpointWriter& out) {
+    out.put(history.cycleCount);
+    out.put(history.simulatedCycles);
+    out.put(history.samplesIssued);
+    out.put(history.samplesRendered);
+    out.put(rayCount);
+    for (int i = 0; i < 6; i++) {
+        out.put(module_state[i]);
+        out.put(waitCounter[i]);
+        out.put(stalls[i].blocked);
+        out.put(stalls[i].starved);
+        out.put(clocks[i].cycle);
+        out.put(clocks[i].done.load(std::memory_order_relaxed));
+    }
+    forEachFifo([&out](const char*, auto& fifo) { fifo.save(out); });
+
+    out.put(featurePool.rayID);
+    out.put(featurePool.rayMarchingID);
+    out.put(featurePool.raySlot);
+    out.put(featurePool.tileBase);
+    out.put(featurePool.HashRayID);
+    out.put(featurePool.SHRayID);
+    out.put(featurePool.SigmaRayID);
+    out.put(featurePool.ColorRayID);
+    out.put(featurePool.VolumeRayID);
+    out.putVector(rayTable.slots);
+    out.putVector(rayTable.free_slots);
+    out.put(rayTable.occupied);
+    out.put(rayTable.peak_occupied);
+    out.put(rayTable.full_stall_cycles);
+    out.put(streaming.next_tile);
+    out.put(streaming.marching_tile);
+    out.put(streaming.valid_rays);
+    if (streaming.enabled) {
+        // Work list of the marching tile, earlier tiles are in the output file or open
+        out.putVector(featurePool.valid_pixel);
+        out.putVector(featurePool.valid_t);
+        out.put<uint64_t>(streaming.open_tiles.size());
+        for (const auto& [tile, buffer] : streaming.open_tiles) {
+            out.put(tile);
+            out.putValue(buffer);
+        }
+        out.put(streaming.tiles_written);
+        out.put(streaming.peak_open_tiles);
+        out.put(streaming.squared_error);
+        out.put(streaming.error_count);
+    }
+
+    if (reorder.join_size > 0) reorder.join.save(out);
+    if (reorder.vr_size > 0) reorder.vr.save(out);
+    out.put(reorder.next_tag);
+    out.put(reorder.join_occupancy);
+    out.put(reorder.vr_occupancy);
+    out.put(reorder.join_peak);
+    out.put(reorder.vr_peak);
+    out.put(reorder.join_stall_cycles);
+    out.put(reorder.vr_stall_cycles);
+    out.put(reorder.vr_order_stall_cycles);
+    std::stringstream rng;
+    rng << hash_miss.rng;
+    out.putString(rng.str());
+    out.putVector(hash_miss.pending);
+    out.put(hash_miss.lookups);
+    out.put(hash_miss.misses);
+
+    out.put(lanes.packets);
+    out.put(lanes.samples);
+    out.put(energy.accesses);
+    out.put(march.rays);
+    out.put(march.samples);
+    out.put(march.steps);
+    out.put(march.extra_cycles);
+    out.put(march.dt_sum);
+    out.put(sh_evaluations);
+    out.put(sh_reuses);
+    out.put(pruning.dense_cycles);
+    out.put(pruning.sparse_cycles);
+    if (bottleneck.enabled) {
+        out.put<uint64_t>(bottleneck.occupancy.size());
+        for (const std::vector<long long>& histogram : bottleneck.occupancy) out.putVector(histogram);
+        out.put(bottleneck.sampled_cycles);
+        out.put(bottleneck.wider_packets);
+    }
+
+    out.putVector(camera->getImage()->getData());
+    if (cost_maps.enabled) {
+        for (std::vector<float>* map : {&cost_maps.alpha, &cost_maps.depth, &cost_maps.samples,
+            &cost_maps.cycles, &cost_maps.termination, &cost_maps.sample_t}) {
+            out.putVector(*map);
+        }
+    }
+}
+
+void Simulator::loadState(CheckpointReader& in) {
+    in.get(history.cycleCount);
+    in.get(history.simulatedCycles);
+    in.get(history.samplesIssued);
+    in.get(history.samplesRendered);
+    in.get(rayCount);
+    for (int i = 0; i < 6; i++) {
+        long long done = 0;
+        in.get(module_state[i]);
+        in.get(waitCounter[i]);
+        in.get(stalls[i].blocked);
+        in.get(stalls[i].starved);
+        in.get(clocks[i].cycle);
+        in.get(done);
+        clocks[i].done.store(done, std::memory_order_relaxed);
+    }
+    forEachFifo([&in](const char*, auto& fifo) { fifo.load(in); });
+
+    in.get(featurePool.rayID);
+    in.get(featurePool.rayMarchingID);
+    in.get(featurePool.raySlot);
+    in.get(featurePool.tileBase);
+    in.get(featurePool.HashRayID);
+    in.get(featurePool.SHRayID);
+    in.get(featurePool.SigmaRayID);
+    in.get(featurePool.ColorRayID);
+    in.get(featurePool.VolumeRayID);
+    in.getVector(rayTable.slots);
+    in.getVector(rayTable.free_slots);
+    in.expect(static_cast<int>(rayTable.slots.size()) == rayTable.capacity);
+    in.get(rayTable.occupied);
+    in.get(rayTable.peak_occupied);
+    in.get(rayTable.full_stall_cycles);
+    in.get(streaming.next_tile);
+    in.get(streaming.marching_tile);
+    in.get(streaming.valid_rays);
+    if (streaming.enabled) {
+        in.getVector(featurePool.valid_pixel);
+        in.getVector(featurePool.valid_t);
+        in.expect(featurePool.valid_pixel.size() == featurePool.valid_t.size());
+        uint64_t tiles = 0;
+        in.get(tiles);
+        in.expect(tiles <= static_cast<uint64_t>(streaming.tiles_x) * streaming.tiles_y);
+        streaming.open_tiles.clear();
+        for (uint64_t i = 0; in.ok() && i < tiles; i++) {
+            int tile = -1;
+            in.get(tile);
+            Streaming::TileBuffer& buffer = streaming.open_tiles[tile];
+            in.getValue(buffer);
+            in.expect(buffer.w >= 0 && buffer.h >= 0 && buffer.rgb.size() == static_cast<size_t>(buffer.w) * buffer.h);
+        }
+        in.get(streaming.tiles_written);
+        in.get(streaming.peak_open_tiles);
+        in.get(streaming.squared_error);
+        in.get(streaming.error_count);
+    }
+
+    if (reorder.join_size > 0) reorder.join.load(in);
+    if (reorder.vr_size > 0) reorder.vr.load(in);
+    in.get(reorder.next_tag);
+    in.get(reorder.join_occupancy);
+    in.get(reorder.vr_occupancy);
+    in.get(reorder.join_peak);
+    in.get(reorder.vr_peak);
+    in.get(reorder.join_stall_cycles);
+    in.get(reorder.vr_stall_cycles);
+    in.get(reorder.vr_order_stall_cycles);
+    std::string rng;
+    in.getString(rng);
+    std::stringstream(rng) >> hash_miss.rng;
+    in.getVector(hash_miss.pending);
+    in.get(hash_miss.lookups);
+    in.get(hash_miss.misses);
+
+    in.get(lanes.packets);
+    in.get(lanes.samples);
+    in.get(energy.accesses);
+    in.get(march.rays);
+    in.get(march.samples);
+    in.get(march.steps);
+    in.get(march.extra_cycles);
+    in.get(march.dt_sum);
+    in.get(sh_evaluations);
+    in.get(sh_reuses);
+    in.get(pruning.dense_cycles);
+    in.get(pruning.sparse_cycles);
+    if (bottleneck.enabled) {
+        uint64_t fifos = 0;
+        in.get(fifos);
+        in.expect(fifos <= 64);
+        if (in.ok()) bottleneck.occupancy.resize(fifos);
+        for (std::vector<long long>& histogram : bottleneck.occupancy) in.getVector(histogram);
+        in.get(bottleneck.sampled_cycles);
+        in.get(bottleneck.wider_packets);
+    }
+
+    std::vector<Image::Color> pixels;
+    in.getVector(pixels);
+    in.expect(pixels.size() == camera->getImage()->getData().size());
+    if (in.ok()) camera->getImage()->setData(pixels);
+    if (cost_maps.enabled) {
+        for (std::vector<float>* map : {&cost_maps.alpha, &cost_maps.depth, &cost_maps.samples,
+            &cost_maps.cycles, &cost_maps.termination, &cost_maps.sample_t}) {
+            size_t size = map->size();
+            in.getVector(*map);
+            in.expect(map->size() == size);
+        }
+    }
+}
+
+namespace {
+    constexpr char CHECKPOINT_MAGIC[8] = {'N', 'G', 'P', 'C', 'K', 'P', 'T', '\0'};
+    constexpr uint32_t CHECKPOINT_VERSION = 1;
+}
+
+void Simulator::writeCheckpoint() {
+    // The previous file is still being written, try again at the next check
+    if (checkpoint.writing.load()) return;
+    if (checkpoint.writer.joinable()) checkpoint.writer.join();
+    CheckpointWriter out;
+    out.put(CHECKPOINT_MAGIC);
+    out.put(CHECKPOINT_VERSION);
+    out.put(checkpoint.fingerprint);
+    saveState(out);
+    checkpoint.writing.store(true);
+    checkpoint.writer = std::thread([this, data = out.release(), cycle = history.cycleCount]() {
+        // Written next to the target and renamed, a preempted write keeps the last checkpoint
+        std::string temp = checkpoint.path + ".tmp";
+        std::ofstream fout(temp, std::ios::binary);
+        fout.write(data.data(), data.size());
+        fout.close();
+        if (fout.good() && std::rename(temp.c_str(), checkpoint.path.c_str()) == 0) {
+            checkpoint.written++;
+            checkpoint.last_cycle = cycle;
+        }
+        else {
+            printf("Cannot write checkpoint [%s]\n", checkpoint.path.c_str());
+        }
+        checkpoint.writing.store(false);
+    });
+}
+
+bool Simulator::resumeCheckpoint() {
+    std::ifstream fin(checkpoint.resume_path, std::ios::binary);
+    if (!fin) {
+        printf("Cannot open checkpoint [%s]\n", checkpoint.resume_path.c_str());
+        return false;
+    }
+    CheckpointReader in(std::vector<char>((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>()));
+    char magic[8];
+    uint32_t version = 0;
+    uint64_t fingerprint = 0;
+    in.get(magic);
+    in.get(version);
+    in.get(fingerprint);
+    if (!in.ok() || std::memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0 || version != CHECKPOINT_VERSION) {
+        printf("Not a checkpoint [%s]\n", checkpoint.resume_path.c_str());
+        return false;
+    }
+    if (fingerprint != checkpoint.fingerprint) {
+        printf("Checkpoint [%s] was written by a different scene or options\n", checkpoint.resume_path.c_str());
+        return false;
+    }
+    loadState(in);
+    if (!in.ok() || !in.atEnd()) {
+        printf("Corrupted checkpoint [%s]\n", checkpoint.resume_path.c_str());
+        return false;
+    }
+    checkpoint.resumed_cycle = history.cycleCount;
+    printf("Resumed from [%s] at cycle %d\n", checkpoint.resume_path.c_str(), history.cycleCount);
+    return true;
+}
+
+nlohmann::json Simulator::printCheckpoint() {
+    if (checkpoint.path.empty() && checkpoint.resumed_cycle < 0) return nullptr;
+    if (checkpoint.resumed_cycle >= 0) printf("Resumed at Cycle: %lld\n", checkpoint.resumed_cycle);
+    if (!checkpoint.path.empty()) {
+        printf("Checkpoints: %d written to %s, last at cycle %lld\n",
+            checkpoint.written, checkpoint.path.c_str(), checkpoint.last_cycle);
+    }
+    return {
+        {"path", checkpoint.path},
+        {"interval_s", checkpoint.interval_s},
+        {"written", checkpoint.written},
+        {"last_cycle", checkpoint.last_cycle},
+        {"resumed_from", checkpoint.resume_path},
+        {"resumed_cycle", checkpoint.resumed_cycle}
+    };
+}
+
+nlohmann::json Simulator::printLanes() {
+    if (lanes.width == 1) return nullptr;
+    const char* names[6] = {"rayMarching", "hashEncoding", "shEncoding", "sigmaMLP", "colorMLP", "volumeRendering"};
+    puts("========== Packet Datapath ==========");
+    printf("Lanes: %d\n", lanes.width);
+    printf("%-16s %12s %12s %12s\n", "Stage", "Packets", "Samples", "Utilization");
+    nlohmann::json stages;
+    for (int s = 0; s < 6; s++) {
+        double utilization = lanes.packets[s] > 0 ?
+            static_cast<double>(lanes.samples[s]) / (lanes.packets[s] * lanes.width) : 0.0;
+        printf("%-16s %12lld %12lld %11.2f%%\n", names[s], lanes.packets[s], lanes.samples[s], utilization * 100);
+        stages[names[s]] = {
+            {"packets", lanes.packets[s]},
+            {"samples", lanes.samples[s]},
+            {"utilization", utilization}
+        };
+    }
+    return {
+        {"width", lanes.width},
+        {"stages", stages}
+    };
+}
+
+nlohmann::json Simulator::printParallel() {
+    if (!parallel.enabled) return nullptr;
+    const char* names[6] = {"rayMarching", "hashEncoding", "shEncoding", "sigmaMLP", "colorMLP", "volumeRendering"};
+    double cycles = std::max(history.cycleCount, 1);
+    puts("========== Parallel Simulation ==========");
+    printf("Stage Threads: %d, Hardware Threads: %u\n", 6, std::thread::hardware_concurrency());
+    printf("Host Time: %.3f s, %.0f cycles/s\n", parallel.host_time_s, cycles / parallel.host_time_s);
+    printf("%-16s %12s %12s\n", "Stage", "Waits/cycle", "Skipped");
+    nlohmann::json stages;
+    for (int s = 0; s < 6; s++) {
+        printf("%-16s %12.3f %11.2f%%\n", names[s], parallel.waits[s] / cycles, parallel.skipped[s] / cycles * 100);
+        stages[names[s]] = {
+            {"waits", parallel.waits[s]},
+            {"skipped_cycles", parallel.skipped[s]}
+        };
+    }
+    nlohmann::json report = {
+        {"threads", 6},
+        {"hardware_threads", std::thread::hardware_concurrency()},
+        {"host_time_s", parallel.host_time_s},
+        {"stages", stages}
+    };
+    if (parallel.validated) {
+        double speedup = parallel.sequential_host_time_s / parallel.host_time_s;
+        printf("Sequential: %.3f s, Speedup: %.2fx over %d stages (%.1f%% efficiency), Results %s\n",
+            parallel.sequential_host_time_s, speedup, 6, speedup / 6 * 100,
+            parallel.matched ? "match" : "MISMATCH");
+        report["sequential_host_time_s"] = parallel.sequential_host_time_s;
+        report["sequential_cycle_count"] = parallel.sequential_cycle_count;
+        report["speedup"] = speedup;
+        report["efficiency"] = speedup / 6;
+        report["matched"] = parallel.matched;
+    }
+    return report;
+}
+
+void Simulator::applyPruning() {
+    pruning.sig_threshold = pruning.threshold;
+    pruning.col_threshold = pruning.threshold;
+    if (pruning.target_sparsity > 0.0f) {
+        pruning.sig_threshold = unloaded.sig_mlp->thresholdForSparsity(pruning.target_sparsity);
+        pruning.col_threshold = unloaded.col_mlp->thresholdForSparsity(pruning.target_sparsity);
+    }
+    unloaded.sig_mlp->prune(pruning.sig_threshold);
+    unloaded.col_mlp->prune(pruning.col_threshold);
+}
+
+nlohmann::json Simulator::printPruning() {
+    if (!pruning.enabled) return nullptr;
+    long long dense = pruning.dense_cycles[0] + pruning.dense_cycles[1];
+    long long sparse = pruning.sparse_cycles[0] + pruning.sparse_cycles[1];
+    double reduction = dense > 0 ? 1.0 - static_cast<double>(sparse) / dense : 0.0;
+    puts("=============== Sparse MLP ===============");
+    printf("PE Array: %d PEs x %d MACs%s\n", pruning.pe.num_pe, pruning.pe.macs_per_pe,
+        pruning.pe.skip_zero_activations ? ", skipping zero activations" : "");
+    printf("Sigma MLP: threshold %.6f, sparsity %.2f%%, %d dense cycles per sample\n",
+        pruning.sig_threshold, pruning.sig_sparsity * 100, pruning.sig_dense_cycles);
+    printf("Color MLP: threshold %.6f, sparsity %.2f%%, %d dense cycles per sample\n",
+        pruning.col_threshold, pruning.col_sparsity * 100, pruning.col_dense_cycles);
+    printf("MLP Busy Cycles: %lld sparse vs %lld dense (%.2f%% reduction)\n", sparse, dense, reduction * 100);
+
+    return {
+        {"pe_array", {
+            {"num_pe", pruning.pe.num_pe},
+            {"macs_per_pe", pruning.pe.macs_per_pe},
+            {"skip_zero_activations", pruning.pe.skip_zero_activations}
+        }},
+        {"sigma_mlp", {
+            {"threshold", pruning.sig_threshold},
+            {"sparsity", pruning.sig_sparsity},
+            {"dense_cycles_per_sample", pruning.sig_dense_cycles},
+            {"busy_cycles", pruning.sparse_cycles[0]},
+            {"dense_busy_cycles", pruning.dense_cycles[0]}
+        }},
+        {"color_mlp", {
+            {"threshold", pruning.col_threshold},
+            {"sparsity", pruning.col_sparsity},
+            {"dense_cycles_per_sample", pruning.col_dense_cycles},
+            {"busy_cycles", pruning.sparse_cycles[1]},
+            {"dense_busy_cycles", pruning.dense_cycles[1]}
+        }},
+        {"busy_cycle_reduction", reduction}
+    };
+}
+
+nlohmann::json Simulator::printQuantization() {
+    // Memory footprint of the parameters and the modeled bandwidth at the
+    // simulated rate. Every sample fetches 8 corners per hash level. MLP
+    // weights are held on chip: every MLP execution (a packet, shared by its
+    // lanes) reads all weights of its MLP from the weight buffer once, and
+    // DRAM only supplies one copy of them per frame.
+    long long hash_params = hash_enc->getNumParams();
+    long long sig_params = sig_mlp->getNumParams(), col_params = col_mlp->getNumParams();
+    long long mlp_params = sig_params + col_params;
+    double hash_bytes = hash_params * quant.hash_table.bits() / 8.0;
+    double mlp_bytes = mlp_params * quant.mlp_weights.bits() / 8.0;
+    double ref_hash_bytes = hash_params * 4.0, ref_mlp_bytes = mlp_params * 4.0;
+    long long fetch_values = 8LL * hash_enc->getNumLevels() * hash_enc->getNumFeaturesPerLevel();
+    double seconds = history.simulatedCycles / (history.frequency * 1e6);
+    double samples_per_second = seconds > 0 ? history.samplesIssued / seconds : 0.0;
+    double weight_reads_per_second = seconds > 0 ?
+        (sig_params * lanes.packets[SIGMAMLP] + col_params * lanes.packets[COLORMLP]) / seconds : 0.0;
+    double frames_per_second = history.cycleCount > 0 ? history.frequency * 1e6 / history.cycleCount : 0.0;
+    double hash_bw = samples_per_second * fetch_values * quant.hash_table.bits() / 8.0;
+    double mlp_bw = weight_reads_per_second * quant.mlp_weights.bits() / 8.0;
+    double mlp_dram_bw = frames_per_second * mlp_bytes;
+    double ref_hash_bw = samples_per_second * fetch_values * 4.0;
+    double ref_mlp_bw = weight_reads_per_second * 4.0;
+    double ref_mlp_dram_bw = frames_per_second * ref_mlp_bytes;
+
+    bool quantized = !quant.hash_table.isExact() || !quant.hash_interp.isExact() ||
+        !quant.mlp_weights.isExact() || !quant.mlp_accum.isExact() || !quant.volume.isExact();
+    if (quantized) {
+        puts("============= Quantization =============");
+        printf("Formats: hash_table %s, hash_interp %s, mlp_weights %s, mlp_accum %s, volume %s\n",
+            quant.hash_table.name().c_str(), quant.hash_interp.name().c_str(),
+            quant.mlp_weights.name().c_str(), quant.mlp_accum.name().c_str(), quant.volume.name().c_str());
+        printf("%-26s %14s %14s\n", "", "fp32", "quantized");
+        printf("%-26s %14.1f %14.1f\n", "Hash Table (KB)", ref_hash_bytes / 1024, hash_bytes / 1024);
+        printf("%-26s %14.1f %14.1f\n", "MLP Weights (KB)", ref_mlp_bytes / 1024, mlp_bytes / 1024);
+        printf("%-26s %14.3f %14.3f\n", "Hash Bandwidth (GB/s)", ref_hash_bw / 1e9, hash_bw / 1e9);
+        printf("%-26s %14.3f %14.3f\n", "MLP Weight Reads (GB/s)", ref_mlp_bw / 1e9, mlp_bw / 1e9);
+        printf("%-26s %14.3f %14.3f\n", "MLP Weight DRAM (GB/s)", ref_mlp_dram_bw / 1e9, mlp_dram_bw / 1e9);
+        if (history.has_quality && quant_reference_psnr >= 0.0f) {
+            printf("%-26s %14.3f %14.3f\n", "PSNR (dB)", quant_reference_psnr, history.psnr);
+        }
+        else if (history.has_quality) {
+            printf("PSNR: %.3f dB quantized, add --quant-reference for the fp32 PSNR\n", history.psnr);
+        }
+    }
+
+    nlohmann::json report = {
+        {"formats", {
+            {"hash_table", quant.hash_table.name()},
+            {"hash_interp", quant.hash_interp.name()},
+            {"mlp_weights", quant.mlp_weights.name()},
+            {"mlp_accum", quant.mlp_accum.name()},
+            {"volume", quant.volume.name()}
+        }},
+        {"footprint_bytes", {{"hash_table", hash_bytes}, {"mlp_weights", mlp_bytes}}},
+        {"footprint_bytes_fp32", {{"hash_table", ref_hash_bytes}, {"mlp_weights", ref_mlp_bytes}}},
+        {"bandwidth_gbps", {{"hash_table", hash_bw / 1e9}, {"mlp_weights", mlp_bw / 1e9},
+            {"mlp_weights_dram", mlp_dram_bw / 1e9}}},
+        {"bandwidth_gbps_fp32", {{"hash_table", ref_hash_bw / 1e9}, {"mlp_weights", ref_mlp_bw / 1e9},
+            {"mlp_weights_dram", ref_mlp_dram_bw / 1e9}}}
+    };
+    if (history.has_quality) report["psnr_db"] = history.psnr;
+    if (quant_reference_psnr >= 0.0f) report["psnr_db_fp32"] = quant_reference_psnr;
+    return report;
+}
+
+void Simulator::evaluateQuality() {
+    Profiler::ScopedTimer timer(profiler, PROF_QUALITY);
+    history.has_quality = false;
+    history.has_ssim = false;
+    if (streaming.enabled) {
+        // Accumulated while tiles were written, SSIM needs the whole frame
+        if (streaming.error_count == 0) return;
+        history.psnr = metrics::psnrFromMSE(streaming.squared_error / streaming.error_count);
+        history.has_quality = true;
+        return;
+    }
+    if (ground_truth_path.empty()) return;
+    // A sampled frame only holds the sampled pixels
+    if (sampling.enabled && !sampling.validated) return;
+
+    std::shared_ptr<Image> img = camera->getImage();
+    Image ground_truth(img->getResolution().x(), img->getResolution().y());
+    if (!ground_truth.readImgFromFile(ground_truth_path)) return;
+
+    history.psnr = metrics::computePSNR(*img, ground_truth);
+    history.ssim = metrics::computeSSIM(*img, ground_truth);
+    history.has_quality = true;
+    history.has_ssim = true;
 }
 
 void Simulator::initialize() {
+    history.cycleCount = 0;
+    rayCount = 0;
+    for (int i = 0; i < 6; i++) {
+        module_state[i] = WAIT_FOR_INPUT;
+        waitCounter[i] = 0;
+    }
+    fifos.reset();
+    for (StageStalls& stage : stalls) stage = StageStalls();
+    if (bottleneck.enabled) {
+        bottleneck.occupancy.clear();
+        bottleneck.sampled_cycles = 0;
+        bottleneck.wider_packets = 0;
+    }
+    connectStages();
+    for (int i = 0; i < 6; i++) {
+        clocks[i].cycle = 0;
+        clocks[i].done.store(0, std::memory_order_relaxed);
+    }
+    sampling.ray_cycles.clear();
+
     waitCounter[RAYMARCHING] = latency[RAYMARCHING] - 1;
     featurePool.rayID = 0;
 
     // Ray Marching
-    featurePool.rayMarchingID = 0;
-    featurePool.t_count = std::vector<int>(MAX_RAY_COUNT, 0);
-    featurePool.ts = std::vector<float>(MAX_RAY_COUNT, RAY_DEFAULT_MIN);
-    init_valid_pixel();
+    featurePool.rayMarchingID = -1;
+    featurePool.tileBase = 0;
+    featurePool.valid_pixel.clear();
+    featurePool.valid_t.clear();
     // Hash Encoding
     featurePool.HashRayID = -1;
     // SH Encoding
@@ -198,27 +1912,223 @@ void Simulator::initialize() {
     featurePool.ColorRayID = -1;
     // Volume Rendering
     featurePool.VolumeRayID = -1;
-    featurePool.colors = std::vector<Vec3f>(MAX_RAY_COUNT, Vec3f::Zero());
-    featurePool.opacities = std::vector<float>(MAX_RAY_COUNT, 0.0);
-}
+    featurePool.raySlot = -1;
+    rayTable.reset();
+    // Reorder buffers
+    if (reorder.join_size > 0) reorder.join.reset(reorder.join_size);
+    if (reorder.vr_size > 0) reorder.vr.reset(reorder.vr_size);
+    reorder.next_tag = 0;
+    reorder.join_occupancy = reorder.vr_occupancy = 0;
+    reorder.join_peak = reorder.vr_peak = 0;
+    reorder.join_stall_cycles = reorder.vr_stall_cycles = reorder.vr_order_stall_cycles = 0;
+    hash_miss.rng.seed(hash_miss.seed);
+    hash_miss.pending.clear();
+    hash_miss.lookups = hash_miss.misses = 0;
 
-void Simulator::init_valid_pixel() {
+    // Tiles
     Vec2i resolution = camera->getResolution();
-    for (int i = 0; i < resolution.x(); i++) {
-        for (int j = 0; j < resolution.y(); j++) {
-            Ray ray = camera->generateRay(i, j);
-            float t = RAY_DEFAULT_MIN;
-            while (!occupancy_grid->isOccupy(ray(t)) && t < RAY_DEFAULT_MAX + EPS) {
-                t += NGP_STEP_SIZE;
+    int tile = streaming.enabled ? streaming.tile_size : std::max(resolution.x(), resolution.y());
+    streaming.tiles_x = (resolution.x() + tile - 1) / tile;
+    streaming.tiles_y = (resolution.y() + tile - 1) / tile;
+    streaming.next_tile = 0;
+    streaming.marching_tile = -1;
+    streaming.open_tiles.clear();
+    streaming.valid_rays = 0;
+    streaming.tiles_written = 0;
+    streaming.peak_open_tiles = 0;
+    streaming.squared_error = 0.0;
+    streaming.error_count = 0;
+    if (streaming.enabled) {
+        // A resumed run keeps the tiles flushed before its checkpoint
+        bool resuming = !checkpoint.resume_path.empty();
+        if (!streaming.writer.open(streaming.output_path, resolution.x(), resolution.y(), resuming) && resuming) {
+            throw std::runtime_error("Cannot resume the stream output [" + streaming.output_path + "]");
+        }
+        if (!ground_truth_path.empty() && !streaming.ground_truth.isOpen()) {
+            std::string path = std::filesystem::path(ground_truth_path).replace_extension(".ppm").string();
+            if (!streaming.ground_truth.open(path)) {
+                printf("No PSNR: streaming reads the reference as a binary PPM [%s]\n", path.c_str());
             }
+            else if (streaming.ground_truth.getResolution() != resolution) {
+                printf("No PSNR: reference [%s] is %dx%d, expect %dx%d\n", path.c_str(),
+                    streaming.ground_truth.getResolution().x(), streaming.ground_truth.getResolution().y(),
+                    resolution.x(), resolution.y());
+                streaming.ground_truth.close();
+            }
+        }
+    }
+    else {
+        camera->getImage()->clear();
+    }
+    if (cost_maps.enabled) {
+        size_t pixels = static_cast<size_t>(resolution.x()) * resolution.y();
+        for (std::vector<float>* map : {&cost_maps.alpha, &cost_maps.depth, &cost_maps.samples,
+            &cost_maps.cycles, &cost_maps.termination}) {
+            map->assign(pixels, 0.0f);
+        }
+        cost_maps.sample_t.assign(static_cast<size_t>(rayTable.capacity) * MAX_T_COUNT, 0.0f);
+    }
+    loadTile(0);
+    if (!streaming.enabled) {
+        float valid_pixel_ratio = static_cast<float>(featurePool.valid_pixel.size()) / static_cast<float>(MAX_RAY_COUNT);
+        printf("Valid Pixel Ratio: %.6f\n", valid_pixel_ratio);
+    }
+}
+
+void Simulator::init_valid_pixel(int x0, int y0, int w, int h) {
+    Vec2i resolution = camera->getResolution();
+    // First occupied t of every pixel, the scan below keeps the pixel order
+    std::vector<float> first_t(w * h);
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (int i = 0; i < w; i++) {
+        for (int j = 0; j < h; j++) {
+            first_t[i * h + j] = firstOccupied(*occupancy_grid, camera->generateRay(x0 + i, y0 + j));
+        }
+    }
+    for (int i = 0; i < w; i++) {
+        for (int j = 0; j < h; j++) {
+            float t = first_t[i * h + j];
             if (t < RAY_DEFAULT_MAX) {
-                featurePool.valid_pixel.push_back(i * resolution.y() + j);
-                featurePool.ts[i * resolution.y() + j] = t - NGP_STEP_SIZE;
+                featurePool.valid_pixel.push_back((x0 + i) * resolution.y() + y0 + j);
+                featurePool.valid_t.push_back(t - NGP_STEP_SIZE);
             }
         }
     }
-    float valid_pixel_ratio = static_cast<float>(featurePool.valid_pixel.size()) / static_cast<float>(MAX_RAY_COUNT);
-    printf("Valid Pixel Ratio: %.6f\n", valid_pixel_ratio);
+}
+
+void Simulator::loadTile(int tile) {
+    Vec2i resolution = camera->getResolution();
+    int size = streaming.enabled ? streaming.tile_size : std::max(resolution.x(), resolution.y());
+    int x0 = tile / streaming.tiles_y * size, y0 = tile % streaming.tiles_y * size;
+    int w = std::min(size, resolution.x() - x0), h = std::min(size, resolution.y() - y0);
+
+    featurePool.tileBase += featurePool.valid_pixel.size();
+    featurePool.valid_pixel.clear();
+    featurePool.valid_t.clear();
+    featurePool.rayID = 0;
+    init_valid_pixel(x0, y0, w, h);
+    streaming.valid_rays += featurePool.valid_pixel.size();
+
+    int previous = streaming.marching_tile;
+    streaming.marching_tile = tile;
+    streaming.next_tile = tile + 1;
+    if (streaming.enabled) {
+        Streaming::TileBuffer& buffer = streaming.open_tiles[tile];
+        buffer.x0 = x0;
+        buffer.y0 = y0;
+        buffer.w = w;
+        buffer.h = h;
+        buffer.rgb.assign(w * h, Vec3f::Zero());
+        if (static_cast<int>(streaming.open_tiles.size()) > streaming.peak_open_tiles) {
+            streaming.peak_open_tiles = streaming.open_tiles.size();
+        }
+        // The previous tile may have no ray left in flight
+        auto it = streaming.open_tiles.find(previous);
+        if (it != streaming.open_tiles.end() && it->second.inflight == 0) {
+            flushTile(previous);
+        }
+    }
+}
+
+void Simulator::flushTile(int tile) {
+    Profiler::ScopedTimer timer(profiler, PROF_OUTPUT);
+    Streaming::TileBuffer& buffer = streaming.open_tiles.at(tile);
+    // Tile buffers are kept in file order: pixel (i, j) is column i, row j
+    streaming.writer.writeBlock(buffer.x0, buffer.y0, buffer.w, buffer.h, buffer.rgb);
+    if (streaming.ground_truth.readBlock(buffer.x0, buffer.y0, buffer.w, buffer.h, streaming.ground_truth_block)) {
+        for (size_t i = 0; i < buffer.rgb.size(); i++) {
+            const Vec3f& c = buffer.rgb[i];
+            const Vec3f& gt = streaming.ground_truth_block[i];
+            for (int k = 0; k < 3; k++) {
+                float d = utils::trans(c[k]) / 255.f - gt[k];
+                streaming.squared_error += d * d;
+            }
+        }
+        streaming.error_count += 3LL * buffer.w * buffer.h;
+    }
+    streaming.open_tiles.erase(tile);
+    streaming.tiles_written++;
+}
+
+void Simulator::finishFrame() {
+    // Samples still in the pipeline are dropped, rays keep what they accumulated
+    std::vector<std::pair<int, int>> remaining;
+    for (size_t slot = 0; slot < rayTable.slots.size(); slot++) {
+        if (rayTable.slots[slot].id >= 0) {
+            remaining.push_back({rayTable.slots[slot].id, static_cast<int>(slot)});
+        }
+    }
+    std::sort(remaining.begin(), remaining.end());
+    for (const auto& ray: remaining) {
+        retireRay(ray.second, history.cycleCount);
+    }
+    if (streaming.enabled) {
+        while (!streaming.open_tiles.empty()) {
+            flushTile(streaming.open_tiles.begin()->first);
+        }
+        streaming.writer.close();
+    }
+}
+
+void Simulator::startRay(int seq, int index, int slot) {
+    featurePool.rayMarchingID = seq;
+    featurePool.raySlot = slot;
+
+    RayState& state = rayTable.slots[slot];
+    state.id = seq;
+    state.pixel = featurePool.valid_pixel[index];
+    state.tile = streaming.marching_tile;
+    state.t = featurePool.valid_t[index];
+    state.t_count = 0;
+    state.outstanding = 0;
+    state.marched = false;
+    state.color = Vec3f::Zero();
+    state.opacity = 0.0f;
+    state.committed_color = Vec3f::Zero();
+    state.committed_opacity = 0.0f;
+    state.sh_valid = false;
+    state.start_cycle = clocks[RAYMARCHING].cycle;
+    state.rendered = 0;
+    state.termination = NOT_MARCHED;
+    state.depth = 0.0f;
+    state.committed_depth = 0.0f;
+    std::fill(std::begin(state.accesses), std::end(state.accesses), 0);
+    if (streaming.enabled) {
+        streaming.open_tiles.at(state.tile).inflight++;
+    }
+}
+
+void Simulator::retireRay(int slot, long long cycle) {
+    RayState& state = rayTable.slots[slot];
+    writeBack(state);
+
+    // Commit straight to the framebuffer
+    int height = camera->getResolution().y();
+    int i = state.pixel / height, j = state.pixel % height;
+    if (streaming.enabled) {
+        Streaming::TileBuffer& buffer = streaming.open_tiles.at(state.tile);
+        buffer.rgb[(j - buffer.y0) * buffer.w + (i - buffer.x0)] = state.committed_color;
+        buffer.inflight--;
+        if (buffer.inflight == 0 && state.tile != streaming.marching_tile) {
+            flushTile(state.tile);
+        }
+    }
+    else {
+        camera->getImage()->setPixel(i, height - 1 - j, state.committed_color);
+        if (cost_maps.enabled) {
+            int pixel = i + camera->getResolution().x() * (height - 1 - j);
+            cost_maps.alpha[pixel] = state.committed_opacity;
+            cost_maps.depth[pixel] = state.committed_depth;
+            cost_maps.samples[pixel] = state.t_count;
+            cost_maps.cycles[pixel] = cycle - state.start_cycle;
+            cost_maps.termination[pixel] = state.termination;
+        }
+    }
+    if (energy.enabled && sampling.enabled) {
+        std::copy(std::begin(state.accesses), std::end(state.accesses),
+            energy.ray_accesses.begin() + static_cast<size_t>(state.id) * NUM_ACCESSES);
+    }
+    rayTable.release(slot);
 }
 
 void Simulator::rayMarching() {
@@ -235,8 +2145,16 @@ void Simulator::rayMarching() {
                 ET_Data et_data = etFifo.read();
                 if (et_data.rayID == featurePool.rayMarchingID) {
                     // Terminate this ray. Jump to next ray at next cycle. reset t
-                    
+                    int slot = featurePool.raySlot;
+                    if (slot >= 0 && rayTable.slots[slot].id == featurePool.rayMarchingID) {
+                        rayTable.slots[slot].marched = true;
+                        rayTable.slots[slot].termination = EARLY;
+                        countAccess(slot, PIXEL_WRITES, 1);
+                        countWiderPackets(rayTable.slots[slot].t_count);
+                        if (rayTable.slots[slot].outstanding == 0) retireRay(slot, clocks[RAYMARCHING].cycle);
+                    }
                     featurePool.rayID++;
+                    march.rays++;
                     waitCounter[RAYMARCHING] = latency[RAYMARCHING] - 1;
                     return;
                 }
@@ -251,243 +2169,506 @@ void Simulator::rayMarching() {
 
                 // Do Ray Marching
                 int ray_id = featurePool.rayID;
-                if (ray_id >= featurePool.valid_pixel.size()) {
+                // Move on to the next tile once this one is exhausted
+                while (ray_id >= static_cast<int>(featurePool.valid_pixel.size()) &&
+                    streaming.next_tile < streaming.tiles_x * streaming.tiles_y) {
+                    loadTile(streaming.next_tile);
+                    ray_id = featurePool.rayID;
+                }
+                if (ray_id >= static_cast<int>(featurePool.valid_pixel.size())) {
                     featurePool.rayMarchingID = MAX_RAY_COUNT;
+                    stalls[RAYMARCHING].starved++;
                     return;
                 }
-                int rm_id = featurePool.valid_pixel[ray_id];
-                featurePool.rayMarchingID = rm_id;
+                int seq = featurePool.tileBase + ray_id;
+                if (seq != featurePool.rayMarchingID) {
+                    int slot = rayTable.allocate();
+                    if (slot < 0) {
+                        // Ray buffer is full, wait for a ray to retire
+                        rayTable.full_stall_cycles++;
+                        stalls[RAYMARCHING].blocked++;
+                        return;
+                    }
+                    startRay(seq, ray_id, slot);
+                }
+                int slot = featurePool.raySlot;
+                RayState& state = rayTable.slots[slot];
+                int rm_id = state.pixel;
 
                 Vec2i resolution = camera->getResolution();
                 float ray_id_x = rm_id / resolution.y(), ray_id_y = rm_id % resolution.y();
                 Ray ray = camera->generateRay(ray_id_x, ray_id_y);
                 
-                float t = featurePool.ts[rm_id];
-                do {
-                    t += NGP_STEP_SIZE;
+                // March up to a packet of occupied samples
+                Packet<3> pos(3, lanes.width);
+                Packet<1> dt(1, lanes.width);
+                int n = 0, steps = 0;
+                float t = state.t;
+                while (n < lanes.width) {
+                    t = march.policy.next(*occupancy_grid, ray, t, dt(n), steps);
+                    if (t >= RAY_DEFAULT_MAX || state.t_count >= MAX_T_COUNT) break;
+                    if (cost_maps.enabled) cost_maps.sample_t[slot * MAX_T_COUNT + state.t_count] = t;
+                    state.t_count++;
+                    march.dt_sum += dt(n);
+                    pos.col(n++) = ray(t);
+                    state.t = t;// + NGP_STEP_SIZE;
                 }
-                while (!occupancy_grid->isOccupy(ray(t)) && t < RAY_DEFAULT_MAX + EPS);
+                int extra = marchCycles(steps);
+                march.steps += steps;
+                march.extra_cycles += extra;
+                countAccess(slot, OCCUPANCY_READS, steps);
 
                 // If t > RAY_DEFAULT_MAX, then skip this ray
-                if (t >= RAY_DEFAULT_MAX || featurePool.t_count[rm_id] >= MAX_T_COUNT) {
-                    // Write data to history
-                    if (history.opacities [featurePool.rayMarchingID] < featurePool.opacities[featurePool.rayMarchingID]) {
-                        history.rgbs[featurePool.rayMarchingID] = featurePool.colors[featurePool.rayMarchingID];
-                        history.opacities[featurePool.rayMarchingID] = featurePool.opacities[featurePool.rayMarchingID];
-                    }
+                if (n == 0) {
+                    // Write data back
+                    writeBack(state);
+                    state.marched = true;
+                    state.termination = state.t_count >= MAX_T_COUNT ? MAX_T : LEFT_GRID;
+                    countAccess(slot, PIXEL_WRITES, 1);
+                    countWiderPackets(state.t_count);
+                    if (state.outstanding == 0) retireRay(slot, clocks[RAYMARCHING].cycle);
                     featurePool.rayID++;
+                    march.rays++;
+                    // Only the steps through empty space take time here
+                    waitCounter[RAYMARCHING] = extra;
                     //t = RAY_DEFAULT_MIN;
                     return;
                 }
 
-                featurePool.t_count[rm_id]++;
-                Vec3f pos = ray(t), dir = ray.getDirection();
+                state.outstanding += n;
+                history.samplesIssued += n;
+                march.samples += n;
+                lanes.packets[RAYMARCHING]++;
+                lanes.samples[RAYMARCHING] += n;
+                countAccess(slot, MARCH_PACKETS, 1);
+                countAccess(slot, MARCH_SAMPLES, n);
+                Vec3f dir = ray.getDirection();
 
                 Hash_in_Reg hash;
                 SH_in_Reg sh;
-                hash.rayID = featurePool.rayMarchingID;
-                hash.input = pos;
-                sh.rayID = featurePool.rayMarchingID;
-                sh.input = (dir + Vec3f(1, 1, 1)) / 2;
+                hash.rayID = slot;
+                hash.tag = reorder.next_tag;
+                hash.input = pos.leftCols(n);
+                sh.rayID = slot;
+                sh.tag = reorder.next_tag++;
+                sh.input = ((dir + Vec3f(1, 1, 1)) / 2).replicate(1, n);
+                sh.dt = dt.leftCols(n);
                 
                 hash_in_Fifo.write(hash);
                 sh_in_Fifo.write(sh);
                 
-                featurePool.ts[rm_id] = t;// + NGP_STEP_SIZE;
-                waitCounter[RAYMARCHING] = latency[RAYMARCHING] - 1;
-            } 
+                waitCounter[RAYMARCHING] = latency[RAYMARCHING] + extra - 1;
+            }
+            else {
+                stalls[RAYMARCHING].blocked++;
+            }
         }
     }
 }
 
+// Cycles beyond the packet latency to test `steps` positions
+int Simulator::marchCycles(int steps) const {
+    if (march.steps_per_cycle <= 0 || steps == 0) return 0;
+    return (steps - 1) / march.steps_per_cycle;
+}
+
 void Simulator::hashEncoding() {
-    if (waitCounter[HASHENCODING] > 0) {
-        waitCounter[HASHENCODING]--;
+    if (hash_miss.enabled) {
+        hashEncodingVariable();
         return;
     }
-    else {
-        if (module_state[HASHENCODING] == DONE_AN_EXECUTION) {
-            if (!sigmlp_in_Fifo.isFull() && !hash_out_Fifo.isEmpty()) {
-                Hash_out_Reg hash = hash_out_Fifo.read();
-                
-                sigmlp_in_Fifo.write(SigMLP_in_Reg{hash.rayID, hash.output});
+    hash_stage.tick();
+}
 
-                module_state[HASHENCODING] = WAIT_FOR_INPUT;
+void Simulator::hashEncodingVariable() {
+    long long cycle = clocks[HASHENCODING].cycle;
+    // Pass a finished result on, as in DONE_AN_EXECUTION
+    if (!sigmlp_in_Fifo.isFull() && !hash_out_Fifo.isEmpty()) {
+        Hash_out_Reg hash = hash_out_Fifo.read();
+        sigmlp_in_Fifo.write(SigMLP_in_Reg{hash.rayID, hash.tag, hash.output});
+    }
+    std::vector<HashMiss::Lookup>& pending = hash_miss.pending;
+    bool started = false;
+    // Start a lookup unless it would run more than `outstanding` tags ahead of the oldest one
+    if (!hash_in_Fifo.isEmpty() && pending.size() < hash_miss.outstanding) {
+        Tag tag = hash_in_Fifo.peek().tag;
+        Tag behind = 0;  // How far the oldest pending lookup is behind
+        for (const HashMiss::Lookup& lookup : pending) behind = std::max(behind, tag - lookup.result.tag);
+        if (behind < hash_miss.outstanding) {
+            Hash_in_Reg hash = hash_in_Fifo.read();
+            int n = hash.input.cols();
+            Packet<32> output(32, n);
+            hash_enc->encodeBatch(hash.input.data(), n, output.data());
+            if (hash_analysis) hash_analysis->record(hash.input.data(), n);
+            lanes.packets[HASHENCODING]++;
+            lanes.samples[HASHENCODING] += n;
+            countHashAccesses(hash.rayID, n);
+            // The packet waits for its slowest lane
+            bool miss = false;
+            for (int l = 0; l < n; l++) {
+                if (std::uniform_real_distribution<float>(0.0f, 1.0f)(hash_miss.rng) < hash_miss.rate) miss = true;
             }
-            // ELSE: WAIT FOR WRITING
+            int cycles = miss ? hash_miss.latency : latency[HASHENCODING];
+            pending.push_back(HashMiss::Lookup{cycle + cycles - 1, Hash_out_Reg{hash.rayID, hash.tag, output}});
+            hash_miss.lookups++;
+            if (miss) hash_miss.misses++;
+            started = true;
         }
-        if (module_state[HASHENCODING] == WAIT_FOR_INPUT) {
-            if (!hash_in_Fifo.isEmpty() && !hash_out_Fifo.isFull()) {
-                Hash_in_Reg hash = hash_in_Fifo.read();
-
-                Vec3f input_point = hash.input;
-                Vec32f output = hash_enc->encode(input_point);
-
-                // Read Hash Input
-                hash_out_Fifo.write(Hash_out_Reg{hash.rayID, output});
-                
-                waitCounter[HASHENCODING] = latency[HASHENCODING] - 1;
-                module_state[HASHENCODING] = DONE_AN_EXECUTION;
-            }
+    }
+    // The lookup that became ready first leaves the unit
+    int done = -1;
+    for (int i = 0; i < static_cast<int>(pending.size()); i++) {
+        if (pending[i].ready > cycle) continue;
+        bool older = static_cast<int32_t>(pending[i].result.tag - pending[done < 0 ? i : done].result.tag) < 0;
+        if (done < 0 || pending[i].ready < pending[done].ready || (pending[i].ready == pending[done].ready && older)) {
+            done = i;
         }
     }
+    if (done >= 0 && !hash_out_Fifo.isFull()) {
+        hash_out_Fifo.write(pending[done].result);
+        pending.erase(pending.begin() + done);
+    }
+    else if (done >= 0) {
+        stalls[HASHENCODING].blocked++;
+    }
+    else if (!started && pending.empty()) {
+        stalls[HASHENCODING].starved++;
+    }
 }
 
-void Simulator::shEncoding() {
-    if (waitCounter[SHENCODING] > 0) {
-        waitCounter[SHENCODING]--;
-        return;
+bool Simulator::HashKernel::fetch(Hash_in_Reg& input) {
+    if (!sim->hash_in_Fifo.isEmpty() && !sim->hash_out_Fifo.isFull()) {
+        input = sim->hash_in_Fifo.read();
+        return true;
     }
-    else {
-        if (module_state[SHENCODING] == DONE_AN_EXECUTION) {
-            if (!colmlpFifo_SH.isFull() && !sh_out_Fifo.isEmpty()) {
-                SH_out_Reg sh = sh_out_Fifo.read();
-                colmlpFifo_SH.write(Col_MLP_From_SH{sh.rayID, sh.output});
+    return false;
+}
 
-                module_state[SHENCODING] = WAIT_FOR_INPUT;
-            }
-        }
-        if (module_state[SHENCODING] == WAIT_FOR_INPUT) {
-            if (!sh_in_Fifo.isEmpty() && !sh_out_Fifo.isFull()) {
-                SH_in_Reg sh = sh_in_Fifo.read();
-                
+Simulator::Hash_out_Reg Simulator::HashKernel::run(const Hash_in_Reg& hash, int& /* cycles */) {
+    int n = hash.input.cols();
+    Packet<32> output(32, n);
+    sim->hash_enc->encodeBatch(hash.input.data(), n, output.data());
+    if (sim->hash_analysis) sim->hash_analysis->record(hash.input.data(), n);
+    sim->lanes.packets[HASHENCODING]++;
+    sim->lanes.samples[HASHENCODING] += n;
+    sim->countHashAccesses(hash.rayID, n);
+    return Hash_out_Reg{hash.rayID, hash.tag, output};
+}
 
-                //Vec3f input_dir = featurePool.SHInput;
-                Vec3f input_dir = sh.input;
-                Vec16f output = sh_enc->encode(input_dir);
-                
-                sh_out_Fifo.write(SH_out_Reg{sh.rayID, output});
+Drain Simulator::HashKernel::drain(FIFO<Hash_out_Reg>& out) {
+    return forward(out, sim->sigmlp_in_Fifo, [](const Hash_out_Reg& hash) {
+        return SigMLP_in_Reg{hash.rayID, hash.tag, hash.output};
+    });
+}
 
-                waitCounter[SHENCODING] = latency[SHENCODING] - 1;
-                module_state[SHENCODING] = DONE_AN_EXECUTION;
-            }
+bool Simulator::SHKernel::fetch(SH_in_Reg& input) {
+    if (!sim->sh_in_Fifo.isEmpty() && !sim->sh_out_Fifo.isFull()) {
+        input = sim->sh_in_Fifo.read();
+        return true;
+    }
+    return false;
+}
+
+Simulator::SH_out_Reg Simulator::SHKernel::run(const SH_in_Reg& sh, int& cycles) {
+    // All lanes hold the direction of the same ray
+    int n = sh.input.cols();
+    Vec3f input_dir = sh.input.col(0);
+    Packet<16> output(16, n);
+    if (sim->sh_per_ray) {
+        RayState& state = sim->rayTable.slots[sh.rayID];
+        if (state.sh_valid) {
+            // Read from the ray's slot, the SH unit is skipped
+            output = state.sh.replicate(1, n);
+            sim->sh_reuses += n;
+            cycles = 1;
+        }
+        else {
+            state.sh = sim->sh_enc->encode(input_dir);
+            state.sh_valid = true;
+            output = state.sh.replicate(1, n);
+            sim->sh_evaluations++;
+            sim->countAccess(sh.rayID, SH_EVALUATIONS, 1);
+            sim->sh_reuses += n - 1;
         }
+    }
+    else if (n == 1) {
+        output = sim->sh_enc->encode(input_dir);
+        sim->sh_evaluations++;
+        sim->countAccess(sh.rayID, SH_EVALUATIONS, 1);
+    }
+    else {
+        Eigen::Matrix<float, 3, Eigen::Dynamic, Eigen::RowMajor, 3, MAX_LANES> planar = sh.input;
+        Eigen::Matrix<float, 16, Eigen::Dynamic, Eigen::RowMajor, 16, MAX_LANES> encoded(16, n);
+        sim->sh_enc->encodeBatch(planar.row(0).data(), planar.row(1).data(), planar.row(2).data(), n, encoded.data());
+        output = encoded;
+        sim->sh_evaluations += n;
+        sim->countAccess(sh.rayID, SH_EVALUATIONS, n);
+    }
+    sim->lanes.packets[SHENCODING]++;
+    sim->lanes.samples[SHENCODING] += n;
+    sim->countAccess(sh.rayID, SH_PACKETS, 1);
+    sim->countAccess(sh.rayID, SH_SAMPLES, n);
+    return SH_out_Reg{sh.rayID, sh.tag, output, sh.dt};
+}
 
+Drain Simulator::SHKernel::drain(FIFO<SH_out_Reg>& out) {
+    return forward(out, sim->colmlpFifo_SH, [](const SH_out_Reg& sh) {
+        return Col_MLP_From_SH{sh.rayID, sh.tag, sh.output, sh.dt};
+    });
+}
+
+bool Simulator::SigmaKernel::fetch(SigMLP_in_Reg& input) {
+    if (!sim->sigmlp_in_Fifo.isEmpty() && !sim->sigmlp_out_Fifo.isFull()) {
+        input = sim->sigmlp_in_Fifo.read();
+        return true;
     }
+    return false;
 }
 
-void Simulator::sigmaMLP() {
-    if (waitCounter[SIGMAMLP] > 0) {
-        waitCounter[SIGMAMLP]--;
-        return;
+Simulator::SigMLP_out_Reg Simulator::SigmaKernel::run(const SigMLP_in_Reg& sigmlp, int& cycles) {
+    int n = sigmlp.input.cols();
+    Packet<16> output(16, n);
+    Pruning& pruning = sim->pruning;
+    if (pruning.enabled) {
+        // Each lane has its own PE array, the packet waits for the slowest
+        cycles = 0;
+        for (int l = 0; l < n; l++) {
+            int lane_cycles;
+            output.col(l) = sim->sig_mlp->inference(sigmlp.input.col(l), pruning.pe, lane_cycles);
+            cycles = std::max(cycles, lane_cycles);
+        }
+        pruning.dense_cycles[0] += pruning.sig_dense_cycles;
+        pruning.sparse_cycles[0] += cycles;
     }
     else {
-        if (module_state[SIGMAMLP] == DONE_AN_EXECUTION) {
-            if (!colmlpFifo_Hash.isFull() && !sigmlp_out_Fifo.isEmpty()) {
-                SigMLP_out_Reg color = sigmlp_out_Fifo.read();
-                colmlpFifo_Hash.write(Col_MLP_From_Hash{color.rayID, color.output});
+        output = sim->sig_mlp->inferenceBatch(sigmlp.input);
+    }
+    sim->lanes.packets[SIGMAMLP]++;
+    sim->lanes.samples[SIGMAMLP] += n;
+    // Weights are read once per packet and shared by its lanes
+    long long weights = sim->energy.mlp_weights[0];
+    sim->countAccess(sigmlp.rayID, SIGMA_PACKETS, 1);
+    sim->countAccess(sigmlp.rayID, SIGMA_SAMPLES, n);
+    sim->countAccess(sigmlp.rayID, SIGMA_MACS, n * weights);
+    sim->countAccess(sigmlp.rayID, SIGMA_WEIGHT_READS, weights);
+    return SigMLP_out_Reg{sigmlp.rayID, sigmlp.tag, output};
+}
 
-                module_state[SIGMAMLP] = WAIT_FOR_INPUT;
-            }
+Drain Simulator::SigmaKernel::drain(FIFO<SigMLP_out_Reg>& out) {
+    return forward(out, sim->colmlpFifo_Hash, [](const SigMLP_out_Reg& color) {
+        return Col_MLP_From_Hash{color.rayID, color.tag, color.output};
+    });
+}
+
+void Simulator::acceptJoin() {
+    bool stalled = false;
+    if (!colmlpFifo_Hash.isEmpty()) {
+        if (reorder.join.inWindow(colmlpFifo_Hash.peek().tag)) {
+            Col_MLP_From_Hash in = colmlpFifo_Hash.read();
+            JoinEntry& entry = reorder.join.get(in.tag);
+            entry.rayID = in.rayID;
+            entry.hash = in.input;
+            entry.has_hash = true;
+        }
+        else stalled = true;
+    }
+    if (!colmlpFifo_SH.isEmpty()) {
+        if (reorder.join.inWindow(colmlpFifo_SH.peek().tag)) {
+            Col_MLP_From_SH in = colmlpFifo_SH.read();
+            JoinEntry& entry = reorder.join.get(in.tag);
+            entry.rayID = in.rayID;
+            entry.sh = in.input;
+            entry.dt = in.dt;
+            entry.has_sh = true;
         }
-        if (module_state[SIGMAMLP] == WAIT_FOR_INPUT) {
-            if (!sigmlp_in_Fifo.isEmpty() && !sigmlp_out_Fifo.isFull()) {
-                SigMLP_in_Reg sigmlp = sigmlp_in_Fifo.read();
+        else stalled = true;
+    }
+    if (stalled) reorder.join_stall_cycles++;
+}
 
-                //Vec32f input = featurePool.HashOutput;
-                Vec32f input = sigmlp.input;
-                Vec16f output = sig_mlp->inference(input);
-                
-                sigmlp_out_Fifo.write(SigMLP_out_Reg{sigmlp.rayID, output});
-                
-                waitCounter[SIGMAMLP] = latency[SIGMAMLP] - 1;
-                module_state[SIGMAMLP] = DONE_AN_EXECUTION;
+void Simulator::ColorKernel::beginCycle() {
+    if (sim->reorder.join_size > 0) sim->acceptJoin();
+}
+
+bool Simulator::ColorKernel::fetch(ColorInput& input) {
+    Reorder& reorder = sim->reorder;
+    bool ready = false;
+    if (reorder.join_size > 0) {
+        // Oldest sample with both halves
+        Tag base = reorder.join.getBase();
+        for (Tag tag = base; tag - base < static_cast<Tag>(reorder.join_size); tag++) {
+            if (!reorder.join.contains(tag)) continue;
+            JoinEntry& entry = reorder.join.get(tag);
+            if (entry.has_hash && entry.has_sh) {
+                input.hash = Col_MLP_From_Hash{entry.rayID, tag, entry.hash};
+                input.sh = Col_MLP_From_SH{entry.rayID, tag, entry.sh, entry.dt};
+                reorder.join.release(tag);
+                ready = true;
+                break;
             }
         }
     }
+    else if (!sim->colmlpFifo_Hash.isEmpty() && !sim->colmlpFifo_SH.isEmpty()) {
+        input.hash = sim->colmlpFifo_Hash.read();
+        input.sh = sim->colmlpFifo_SH.read();
+        ready = true;
+    }
+    if (ready && (input.hash.rayID != input.sh.rayID || input.hash.tag != input.sh.tag)) {
+        puts("Error: Ray ID Mismatch");
+        exit(1);
+    }
+    return ready;
 }
 
-void Simulator::colorMLP() {
-    if (waitCounter[COLORMLP] > 0) {
-        waitCounter[COLORMLP]--;
-        return;
+Simulator::Col_MLP_out_Reg Simulator::ColorKernel::run(const ColorInput& color, int& cycles) {
+    int n = color.hash.input.cols();
+    MatXf input(32, n);
+    input.topRows(16) = color.hash.input;
+    input.bottomRows(16) = color.sh.input;
+    Packet<4> output(4, n);
+    Pruning& pruning = sim->pruning;
+    if (pruning.enabled) {
+        cycles = 0;
+        for (int l = 0; l < n; l++) {
+            int lane_cycles;
+            output.col(l).head(3) = sim->col_mlp->inference(input.col(l), pruning.pe, lane_cycles).head(3);
+            cycles = std::max(cycles, lane_cycles);
+        }
+        pruning.dense_cycles[1] += pruning.col_dense_cycles;
+        pruning.sparse_cycles[1] += cycles;
     }
     else {
-        if (module_state[COLORMLP] == DONE_AN_EXECUTION) {
-            if (!vr_in_Fifo.isFull() && !colmlp_out_Fifo.isEmpty()) {
-                Col_MLP_out_Reg feature = colmlp_out_Fifo.read();
-                
-                vr_in_Fifo.write(VR_in_Reg{feature.rayID, feature.output});
-
-                module_state[COLORMLP] = WAIT_FOR_INPUT;
-            }
-        }
-        if (module_state[COLORMLP] == WAIT_FOR_INPUT) {
-            if (!colmlpFifo_Hash.isEmpty() && !colmlpFifo_SH.isEmpty() ) {
-                Col_MLP_From_Hash color1 = colmlpFifo_Hash.read();
-                Col_MLP_From_SH color2 = colmlpFifo_SH.read();
+        output.topRows(3) = sim->col_mlp->inferenceBatch(input).topRows(3);
+    }
+    // Density from the sigma MLP
+    output.row(3) = color.hash.input.row(0);
+    sim->lanes.packets[COLORMLP]++;
+    sim->lanes.samples[COLORMLP] += n;
+    long long weights = sim->energy.mlp_weights[1];
+    sim->countAccess(color.hash.rayID, COLOR_PACKETS, 1);
+    sim->countAccess(color.hash.rayID, COLOR_SAMPLES, n);
+    sim->countAccess(color.hash.rayID, COLOR_MACS, n * weights);
+    sim->countAccess(color.hash.rayID, COLOR_WEIGHT_READS, weights);
+    return Col_MLP_out_Reg{color.hash.rayID, color.hash.tag, output, color.sh.dt};
+}
 
-                // Read Color Input
-                int color1RayID = color1.rayID, color2RayID = color2.rayID;
-                if (color1RayID != color2RayID) {
-                    puts("Error: Ray ID Mismatch");
-                    exit(1);
-                }
+Drain Simulator::ColorKernel::drain(FIFO<Col_MLP_out_Reg>& out) {
+    return forward(out, sim->vr_in_Fifo, [](const Col_MLP_out_Reg& feature) {
+        return VR_in_Reg{feature.rayID, feature.tag, feature.output, feature.dt};
+    });
+}
 
-                Vec16f input1 = color1.input, input2 = color2.input;
-                Vec32f input = Vec32f::Zero();
-                for (int i = 0; i < 16; i++) {
-                    input[i] = input1[i];
-                    input[i + 16] = input2[i];
-                }
-                Vec3f output = col_mlp->inference(input);
-                float alpha = input1[0];
+void Simulator::acceptVR() {
+    if (vr_in_Fifo.isEmpty()) return;
+    if (reorder.vr.inWindow(vr_in_Fifo.peek().tag)) {
+        VR_in_Reg in = vr_in_Fifo.read();
+        reorder.vr.get(in.tag) = in;
+    }
+    else {
+        reorder.vr_stall_cycles++;
+    }
+}
 
-                colmlp_out_Fifo.write(Col_MLP_out_Reg{color1RayID, Vec4f(output[0], output[1], output[2], alpha)});
+void Simulator::VRKernel::beginCycle() {
+    if (sim->reorder.vr_size > 0) sim->acceptVR();
+}
 
-                waitCounter[COLORMLP] = latency[COLORMLP] - 1;
-                module_state[COLORMLP] = DONE_AN_EXECUTION;
+// Unlike the other stages this always goes back to WAIT_FOR_INPUT, and an
+// early terminated ray ends the cycle
+Drain Simulator::VRKernel::drain(FIFO<VR_out_Reg>& out) {
+    if (!out.isEmpty() && !sim->etFifo.isFull()) {
+        VR_out_Reg vr = out.read();
+        int rayID = vr.rayID;
+        RayState& state = sim->rayTable.slots[rayID];
+        state.outstanding -= vr.lanes;
+        bool done = state.marched && state.outstanding == 0;
+        if (state.opacity >= 0.99) {
+            // Write data back
+            if (writeBack(state)) {
+                // Write data to rayMarching
+                sim->etFifo.write(ET_Data{state.id});
+                sim->countAccess(rayID, ET_WRITES, 1);
             }
+            if (done) sim->retireRay(rayID, sim->clocks[VOLUMERENDERING].cycle);
+            return Drain::DONE_END_CYCLE;
         }
+        if (done) sim->retireRay(rayID, sim->clocks[VOLUMERENDERING].cycle);
     }
+    return Drain::DONE;
 }
 
-void Simulator::volumeRendering() {
-    if (waitCounter[VOLUMERENDERING] > 0) {
-        waitCounter[VOLUMERENDERING]--;
-        return;
-    }
-    else {
-        if (module_state[VOLUMERENDERING] == DONE_AN_EXECUTION) {
-            if (!vr_out_Fifo.isEmpty() && !etFifo.isFull()) {
-                VR_out_Reg vr = vr_out_Fifo.read();
-                int rayID = vr.rayID;
-                if (featurePool.opacities[rayID] >= 0.99) {
-                    // Write data to history
-                    if (history.opacities[rayID] < featurePool.opacities[rayID]) {
-                        history.rgbs[rayID] = featurePool.colors[rayID];
-                        history.opacities[rayID] = featurePool.opacities[rayID];
-                        // Write data to rayMarching
-                        etFifo.write(ET_Data{rayID});
-                    }
-                    module_state[VOLUMERENDERING] = WAIT_FOR_INPUT;
-                    return;
-                }
-            }
-            
-            module_state[VOLUMERENDERING] = WAIT_FOR_INPUT;
+bool Simulator::VRKernel::fetch(VR_in_Reg& input) {
+    Reorder& reorder = sim->reorder;
+    if (reorder.vr_size > 0) {
+        // Samples are composited in issue order
+        Tag tag = reorder.vr.getBase();
+        if (reorder.vr.contains(tag)) {
+            input = reorder.vr.get(tag);
+            reorder.vr.release(tag);
+            return true;
         }
-        if (module_state[VOLUMERENDERING] == WAIT_FOR_INPUT) {
-            if (!vr_in_Fifo.isEmpty()) {
-                VR_in_Reg vr = vr_in_Fifo.read();
-                int rayID = vr.rayID;
-                float opacity = featurePool.opacities[rayID]; // TODO: FIND WHY THIS MAKE SENSE
-
-                Vec4f rgba_raw = vr.input;
-                float T = 1 - opacity;
-                float alpha = 1 - expf(-expf(rgba_raw[3]) * NGP_STEP_SIZE);
-                float weight = alpha * T;
-                Vec3f color = utils::sigmoid(rgba_raw.head(3));
+        else if (reorder.vr.getCount() > 0) {
+            reorder.vr_order_stall_cycles++;
+        }
+    }
+    else if (!sim->vr_in_Fifo.isEmpty()) {
+        input = sim->vr_in_Fifo.read();
+        return true;
+    }
+    return false;
+}
 
+Simulator::VR_out_Reg Simulator::VRKernel::run(const VR_in_Reg& vr, int& cycles) {
+    int rayID = vr.rayID;
+    RayState& state = sim->rayTable.slots[rayID];
+    int n = vr.input.cols();
+    if (sim->approx_enabled) cycles += sim->approx_latency;
+    // Lanes are composited front to back
+    for (int l = 0; l < n; l++) {
+        float opacity = state.opacity; // TODO: FIND WHY THIS MAKE SENSE
 
-                featurePool.opacities[rayID] += weight;
-                featurePool.colors[rayID] += weight * color;
+        Vec4f rgba_raw = vr.input.col(l);
+        float T = 1 - opacity;
+        float alpha;
+        Vec3f color;
+        if (sim->approx_enabled) {
+            const Approximation& approx = sim->approx;
+            alpha = 1 - approx.alpha_exp(-approx.density_exp(rgba_raw[3]) * vr.dt(l));
+            color = rgba_raw.head(3);
+            approx.sigmoid.apply(color.data(), 3);
+        }
+        else {
+            alpha = 1 - expf(-expf(rgba_raw[3]) * vr.dt(l));
+            color = utils::sigmoid(rgba_raw.head(3));
+        }
+        float weight = alpha * T;
 
-                vr_out_Fifo.write(VR_out_Reg{rayID});
-                
-                waitCounter[VOLUMERENDERING] = latency[VOLUMERENDERING] - 1;
-                module_state[VOLUMERENDERING] = DONE_AN_EXECUTION;
-            }
+        if (!sim->quant.volume.isExact()) {
+            const Quantizer& q = sim->quant.volume;
+            weight = q(q(alpha) * q(T));
+            q.apply(color);
+            state.opacity = q(state.opacity + weight);
+            Vec3f accum = state.color + weight * color;
+            q.apply(accum);
+            state.color = accum;
+        }
+        else {
+            state.opacity += weight;
+            state.color += weight * color;
+        }
+        if (sim->cost_maps.enabled) {
+            // Samples of a ray are composited in issue order
+            state.depth += weight * sim->cost_maps.sample_t[rayID * sim->MAX_T_COUNT + state.rendered++];
         }
     }
-}
\ No newline at end of file
+    sim->history.samplesRendered += n;
+    sim->lanes.packets[VOLUMERENDERING]++;
+    sim->lanes.samples[VOLUMERENDERING] += n;
+    // Two exponentials for alpha and three sigmoids per sample
+    sim->countAccess(rayID, VR_PACKETS, 1);
+    sim->countAccess(rayID, VR_SAMPLES, n);
+    sim->countAccess(rayID, EXPS, 2 * n);
+    sim->countAccess(rayID, SIGMOIDS, 3 * n);
+
+    return VR_out_Reg{rayID, n};
+}
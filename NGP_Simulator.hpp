@@ -2,18 +2,48 @@
 #define NGP_SIMULATOR_HPP
 
 
+#include <cassert>
 #include <vector>
 #include <string>
+#include <map>
+#include <random>
+#include <atomic>
+#include <functional>
+#include <thread>
 
 #include "utils.hpp"
+#include "pipeline.hpp"
+#include "profiler.hpp"
+#include "quant.hpp"
+#include "approx.hpp"
+#include "energy.hpp"
+#include "checkpoint.hpp"
 
 #include <camera.hpp>
+#include <march.hpp>
 #include <hash.hpp>
+#include <hash_analysis.hpp>
 #include <sh.hpp>
 #include <mlp.hpp>
 
 class Simulator {
 public:
+    // Numeric formats of the datapath, fp32 everywhere is the reference model
+    struct Quantization {
+        Quantizer hash_table;   // Hash table storage
+        Quantizer hash_interp;  // Trilinear weights and interpolated features
+        Quantizer mlp_weights;
+        Quantizer mlp_accum;    // Layer outputs of both MLPs
+        Quantizer volume;       // Alpha, transmittance and the accumulated color/opacity
+    };
+
+    // Transcendental units of volume rendering, exact by default
+    struct Approximation {
+        ApproxUnit density_exp = ApproxUnit(ApproxFunc::EXP);    // exp(sigma)
+        ApproxUnit alpha_exp = ApproxUnit(ApproxFunc::EXP);      // exp(-density * step)
+        ApproxUnit sigmoid = ApproxUnit(ApproxFunc::SIGMOID);    // Color activation
+    };
+
     Simulator();
     Simulator(
         std::string Scene_Name,
@@ -23,25 +53,487 @@ public:
         std::shared_ptr<HashEncoding> hash_encoding, std::shared_ptr<SHEncoding> sh_encoding,
         int MAX_T_COUNT = 1024
     );
+    // The pipeline stages refer to the simulator's own FIFOs and counters
+    Simulator(const Simulator&) = delete;
+    Simulator& operator=(const Simulator&) = delete;
+    ~Simulator();
+
+    // Decoded parameters and occupancy of a scene, shared between simulators
+    // of the same configs. Quantization and pruning are applied to a copy.
+    struct Snapshot {
+        std::vector<float> sig_mlp, color_mlp, hash_grid;
+        std::vector<int> occupancy;
+    };
 
     void loadParameters(std::string path);
+    // Prints the error and returns false if the snapshot does not match the configs
+    bool readSnapshot(std::string path, Snapshot& snapshot);
+    void loadParameters(const Snapshot& snapshot);
+
+    // Loaded modules, read-only from then on. Simulators of the same configs,
+    // quantization and pruning can share them instead of loading.
+    struct Modules {
+        std::shared_ptr<const OccupancyGrid> occupancy_grid;
+        std::shared_ptr<const MLP> sig_mlp, col_mlp;
+        std::shared_ptr<const HashEncoding> hash_enc;
+        float sig_threshold = 0.0f, col_threshold = 0.0f;   // Pruning thresholds applied
+    };
+    // After loadParameters
+    Modules getModules() const;
+    // Instead of loadParameters, on a simulator built without modules
+    void useModules(const Modules& modules);
 
     void render();
-    void printHistory();
+    // Also returned as the structured run report
+    nlohmann::json printHistory();
+    // Quality of the rendered frame, false without a reference image
+    bool getPSNR(float& psnr) {
+        evaluateQuality();
+        psnr = history.psnr;
+        return history.has_quality;
+    }
 
     void setSimulationFrequency(int frequency) {
         history.frequency = frequency;
     }
+    // Fine timing measures every stage call, progress is printed every interval seconds
+    void setProfiling(bool fine_timing, double progress_interval = 5.0) {
+        profiler.setFineTiming(fine_timing);
+        progress_interval_s = progress_interval;
+    }
+    // Stop the run with std::runtime_error once it passes max_cycles cycles or
+    // max_seconds host seconds of simulation, 0 for no limit. Checked every 64K cycles.
+    void setLimits(long long max_cycles, double max_seconds) {
+        limits.max_cycles = max_cycles;
+        limits.max_seconds = max_seconds;
+    }
+    // Progress is also passed to callback, e.g. to stream it to a client
+    void setProgressCallback(std::function<void(const nlohmann::json&)> callback) {
+        progress_callback = std::move(callback);
+    }
+    void addConfigLoadTime(double seconds) {
+        profiler.addTime(PROF_LOAD_CONFIGS, seconds);
+    }
+    void setGroundTruth(std::string path) {
+        ground_truth_path = path;
+    }
+    // Simulate only a stratified subset (ratio) of the valid pixels and
+    // extrapolate the frame cycles. Strata are screen tiles of tile_size
+    // crossed with bins of the sample count estimated by the occupancy pre-pass.
+    void setSampling(float ratio, int tile_size = 64, unsigned seed = 0, bool validate = false) {
+        sampling.enabled = ratio > 0.0f && ratio < 1.0f;
+        sampling.ratio = ratio;
+        sampling.tile_size = tile_size;
+        sampling.seed = seed;
+        sampling.validate = validate;
+    }
+    // Storage formats are applied while loading, so call this before loadParameters
+    void setQuantization(const Quantization& formats) {
+        quant = formats;
+        if (unloaded.hash_enc) unloaded.hash_enc->setInterpolationFormat(quant.hash_interp);
+        if (unloaded.sig_mlp) unloaded.sig_mlp->setAccumulatorFormat(quant.mlp_accum);
+        if (unloaded.col_mlp) unloaded.col_mlp->setAccumulatorFormat(quant.mlp_accum);
+    }
+    // PSNR of the same run with fp32 formats, shown next to the quantized one
+    void setReferencePSNR(float psnr) {
+        quant_reference_psnr = psnr;
+    }
+    // Their latencies are added to the volume rendering stage
+    void setApproximation(const Approximation& units) {
+        approx = units;
+        approx_enabled = !approx.density_exp.isExact() || !approx.alpha_exp.isExact() || !approx.sigmoid.isExact();
+        approx_latency = approx.density_exp.getLatency() + approx.alpha_exp.getLatency() + approx.sigmoid.getLatency();
+    }
+    // Magnitude-prune both MLPs, by threshold or to a target sparsity when it
+    // is positive, and run the MLP stages on a zero-skipping PE array.
+    // Call before loadParameters.
+    void setPruning(float threshold, float target_sparsity = 0.0f, MLP::PEArray pe = MLP::PEArray()) {
+        pruning.enabled = true;
+        pruning.threshold = threshold;
+        pruning.target_sparsity = target_sparsity;
+        pruning.pe = pe;
+    }
+    // Encode the SH of a ray's direction once and keep it with the ray's slot,
+    // later samples of the ray reuse it instead of running the SH unit again.
+    // An evaluation takes `latency` cycles, reading a reused one takes one.
+    void setSHPerRay(bool per_ray, int latency = 1) {
+        sh_per_ray = per_ray;
+        this->latency[SHENCODING] = latency;
+    }
+    // Tag-matched join at the color MLP and in-order retirement at volume
+    // rendering through reorder buffers of the given sizes, so stages may
+    // complete out of order. 0 keeps the lockstep join.
+    void setReorderBuffers(int join_size, int vr_size) {
+        reorder.join_size = join_size;
+        reorder.vr_size = vr_size;
+    }
+    // Variable hash latency: a lookup misses with the given rate and takes
+    // miss_latency cycles. Up to `outstanding` lookups are in flight and may
+    // complete out of order; needs reorder buffers of at least that size.
+    void setHashMissModel(float rate, int miss_latency, int outstanding, unsigned seed = 0) {
+        hash_miss.enabled = rate > 0.0f;
+        hash_miss.rate = rate;
+        hash_miss.latency = miss_latency;
+        hash_miss.outstanding = outstanding;
+        hash_miss.seed = seed;
+    }
+    // Ray marching emits packets of up to `width` samples of a ray per
+    // cycle, and the downstream units process a packet per execution in
+    // vector lanes. 1 is the scalar datapath.
+    void setLanes(int width) {
+        lanes.width = width;
+    }
+    // Step size policy of ray marching. steps_per_cycle bounds the positions
+    // tested against the occupancy grid per cycle, 0 leaves marching free as
+    // in the original model. The step size logic itself is pipelined.
+    void setMarching(const MarchPolicy& policy, int steps_per_cycle = 0) {
+        march.policy = policy;
+        march.steps_per_cycle = steps_per_cycle;
+    }
+    // Record every hash grid lookup and report collisions, reuse, strides
+    // and bank conflicts per level for each index function. Analysis only,
+    // the lookups themselves and the timing are unchanged.
+    void setHashAnalysis(int banks, const std::vector<HashFunction>& functions) {
+        hash_analysis_banks = banks;
+        hash_analysis_functions = functions;
+    }
+    // Write per-pixel float maps to `directory` next to output.png: RGB,
+    // alpha, depth, samples, cycles from ray start to retirement and how the
+    // ray ended. PFM by default, headerless float32 otherwise.
+    void setCostMaps(const std::string& directory, bool pfm = true) {
+        cost_maps.enabled = !directory.empty();
+        cost_maps.directory = directory;
+        cost_maps.pfm = pfm;
+    }
+    // Report traffic and energy per stage from the operation counts of the
+    // frame: hash table and weight reads, FIFO bytes, MACs, SH evaluations
+    // and transcendentals. target_fps > 0 also reports the bandwidth needed
+    // to reach it.
+    void setEnergy(const EnergyTable& table, double target_fps = 0.0) {
+        energy.enabled = true;
+        energy.table = table;
+        energy.target_fps = target_fps;
+    }
+    // Find the stage limiting the frame from the busy, blocked and starved
+    // cycles of every stage and the FIFO occupancy, and rank what-if changes
+    // (one more lane, one cycle less latency) by their estimated speedup
+    void setBottleneckAnalysis(bool enabled) {
+        bottleneck.enabled = enabled;
+    }
+    // Capacity of the on-chip ray buffer, ray marching stalls when it is full
+    void setRayBufferSize(int size) {
+        // Without a slot no ray can ever start
+        assert(size >= 1);
+        rayTable.capacity = size;
+    }
+    // Run every pipeline stage on its own thread. Stages exchange samples
+    // through the cycle-stamped FIFOs and only wait for the stages whose
+    // state they can observe, so the results match the sequential run
+    // exactly. validate reruns the frame sequentially to check and time it.
+    void setParallel(bool enabled, bool validate = false) {
+        parallel.enabled = enabled;
+        parallel.validate = validate;
+    }
+    // Render the frame tile by tile and stream finished tiles to a PPM file.
+    // Per-ray state only exists for rays in flight, so memory is bounded by
+    // the tile size instead of the resolution.
+    void setStreaming(int tile_size, std::string output_path = "output.ppm") {
+        streaming.enabled = tile_size > 0;
+        streaming.tile_size = tile_size;
+        streaming.output_path = output_path;
+    }
+    // Frame written at the end of a whole-frame render, "" skips it.
+    // History_<frequency>MHz_<scene>.txt/.json are skipped without write_history.
+    void setOutput(std::string image_path, bool write_history = true) {
+        output_image_path = image_path;
+        write_history_files = write_history;
+    }
+    // Save the whole simulation state to `path` every interval_s seconds of
+    // host time, checked every 64K cycles and written on a background thread.
+    // A run started with resume_path continues from such a file and ends
+    // exactly as the uninterrupted run; the scene and options must match.
+    // Sequential whole-frame runs only.
+    void setCheckpoint(std::string path, double interval_s = 600.0, std::string resume_path = "") {
+        checkpoint.path = path;
+        checkpoint.interval_s = interval_s;
+        checkpoint.resume_path = resume_path;
+    }
 private:
     // Statistics
     struct History {
         std::string scene_name;
         int frequency; // Frequency of the simulation. MHz
         int cycleCount;
-        std::vector<Vec3f> rgbs;
-        std::vector<float> opacities;
+        long long simulatedCycles = 0;  // Every simulated cycle, without validation reruns
+        long long samplesIssued = 0;    // Samples sent out by ray marching
+        long long samplesRendered = 0;  // Samples composited by volume rendering
+        // Image Quality, only valid when has_quality is set
+        bool has_quality = false;
+        bool has_ssim = false;
+        float psnr;
+        float ssim;
     } history;
 
+    // Tiled Rendering. Without streaming the whole frame is a single tile
+    // and finished rays are written to the camera's image.
+    struct Streaming {
+        bool enabled = false;
+        int tile_size = 64;
+        std::string output_path;
+
+        int tiles_x = 1, tiles_y = 1;
+        int next_tile = 0;       // Next tile to load into the work list
+        int marching_tile = -1;  // Tile whose rays are being marched
+        struct TileBuffer {
+            int x0, y0, w, h;
+            int inflight = 0;    // Rays started but not retired yet
+            std::vector<Vec3f> rgb;
+            CHECKPOINT_FIELDS(x0, y0, w, h, inflight, rgb)
+        };
+        std::map<int, TileBuffer> open_tiles;
+        StreamImageWriter writer;
+        // Quality is accumulated tile by tile against a P6 reference read
+        // the same way, the PNG next to it would need the whole frame
+        StreamImageReader ground_truth;
+        std::vector<Vec3f> ground_truth_block;
+        double squared_error = 0.0;
+        long long error_count = 0;
+        // Statistics
+        long long valid_rays = 0;
+        int tiles_written = 0;
+        int peak_open_tiles = 0;
+    } streaming;
+    void loadTile(int tile);
+    void flushTile(int tile);
+    void finishFrame();
+
+    // Statistical Sampling
+    struct Sampling {
+        bool enabled = false;
+        float ratio = 1.0f;
+        int tile_size = 64;
+        unsigned seed = 0;
+        bool validate = false;
+        static constexpr int NUM_COUNT_BINS = 4;
+        // Sample counts are estimated by marching one ray per block of pixels
+        static constexpr int ESTIMATE_BLOCK = 4;
+
+        std::vector<int> stratum_size;   // Valid pixels per stratum (N_h)
+        std::vector<int> ray_stratum;    // Stratum of each simulated ray
+        std::vector<int> ray_cycles;     // Cycles spent on each simulated ray
+        int num_valid_pixel = 0;
+        int num_sampled_pixel = 0;
+        int current_ray = 0, ray_start_cycle = 0;
+        // Results
+        int sampled_cycle_count = 0;
+        double estimated_cycles = 0.0;
+        double ci_half_width = 0.0;      // 95% confidence interval
+        double host_time_s = 0.0;
+        // Validation against a full run
+        bool validated = false;
+        int full_cycle_count = 0;
+        double full_host_time_s = 0.0;
+    } sampling;
+    Quantization quant;
+    float quant_reference_psnr = -1.0f;   // Negative without a reference run
+    nlohmann::json printQuantization();
+
+    Approximation approx;
+    bool approx_enabled = false;
+    int approx_latency = 0;
+    nlohmann::json printApproximation();
+
+    // Packet datapath
+    struct Lanes {
+        int width = 1;
+        long long packets[6] = {0};   // Executions per stage
+        long long samples[6] = {0};   // Lanes in use, summed over executions
+    } lanes;
+    nlohmann::json printLanes();
+
+    // Ray marching policy
+    struct Marching {
+        MarchPolicy policy;
+        int steps_per_cycle = 0;
+        // Statistics
+        long long rays = 0, samples = 0;
+        long long steps = 0;          // Positions tested against the occupancy grid
+        long long extra_cycles = 0;   // Cycles spent on steps beyond the packet latency
+        double dt_sum = 0.0;
+    } march;
+    int marchCycles(int steps) const;
+    nlohmann::json printMarching();
+
+    // Hash grid access analysis, created with the parameters
+    int hash_analysis_banks = 0;
+    std::vector<HashFunction> hash_analysis_functions;
+    std::unique_ptr<HashAnalysis> hash_analysis;
+
+    // How a ray ended, the value of its pixel in the termination map
+    enum Termination {
+        NOT_MARCHED = 0,   // No occupied cell on the ray, or not sampled
+        LEFT_GRID = 1,     // Marched past RAY_DEFAULT_MAX
+        MAX_T = 2,         // Issued MAX_T_COUNT samples
+        EARLY = 3          // Opacity reached the early termination threshold
+    };
+    // Per-pixel maps, bottom row first like the framebuffer
+    struct CostMaps {
+        bool enabled = false;
+        bool pfm = true;
+        std::string directory;
+        std::vector<float> alpha, depth, samples, cycles, termination;
+        std::vector<float> sample_t;   // t of each issued sample, MAX_T_COUNT per ray buffer slot
+    } cost_maps;
+    void writeCostMaps();
+    nlohmann::json printCostMaps();
+
+    // Bandwidth and energy accounting. Accesses are counted by the kernels,
+    // each by a single stage so the threads of a parallel run never share one.
+    enum Access {
+        MARCH_PACKETS, MARCH_SAMPLES, OCCUPANCY_READS, PIXEL_WRITES,
+        HASH_PACKETS, HASH_SAMPLES, HASH_CORNER_READS, HASH_INTERP_MACS,
+        SH_PACKETS, SH_SAMPLES, SH_EVALUATIONS,
+        SIGMA_PACKETS, SIGMA_SAMPLES, SIGMA_MACS, SIGMA_WEIGHT_READS,
+        COLOR_PACKETS, COLOR_SAMPLES, COLOR_MACS, COLOR_WEIGHT_READS,
+        VR_PACKETS, VR_SAMPLES, EXPS, SIGMOIDS, ET_WRITES,
+        NUM_ACCESSES
+    };
+    struct Energy {
+        bool enabled = false;
+        EnergyTable table;
+        double target_fps = 0.0;
+        long long accesses[NUM_ACCESSES] = {0};
+        long long mlp_weights[2] = {0, 0};   // Read per sigma/color MLP execution, after pruning
+        // Sampled runs: accesses of each simulated ray by sequence ID, and
+        // the frame totals estimated from them like the cycle count
+        std::vector<long long> ray_accesses;
+        double estimated[NUM_ACCESSES] = {0};
+    } energy;
+    void countAccess(int slot, Access access, long long n) {
+        if (!energy.enabled) return;
+        energy.accesses[access] += n;
+        if (sampling.enabled) rayTable.slots[slot].accesses[access] += n;
+    }
+    // Eight corners per level, inference never writes the tables
+    void countHashAccesses(int slot, int n) {
+        if (!energy.enabled) return;
+        long long corners = 8LL * n * hash_enc->getNumLevels();
+        countAccess(slot, HASH_PACKETS, 1);
+        countAccess(slot, HASH_SAMPLES, n);
+        countAccess(slot, HASH_CORNER_READS, corners);
+        countAccess(slot, HASH_INTERP_MACS, corners * hash_enc->getNumFeaturesPerLevel());
+    }
+    nlohmann::json printEnergy();
+
+    // Bottleneck analysis
+    struct Bottleneck {
+        bool enabled = false;
+        // Cycles with each occupancy per FIFO, sampled by the sequential loop
+        std::vector<std::vector<long long>> occupancy;
+        long long sampled_cycles = 0;
+        // Packets ray marching would form with one more lane, from the samples of each ray
+        long long wider_packets = 0;
+    } bottleneck;
+    void countWiderPackets(int samples) {
+        if (bottleneck.enabled) bottleneck.wider_packets += (samples + lanes.width) / (lanes.width + 1);
+    }
+    void sampleOccupancy();
+    nlohmann::json printBottleneck();
+
+    // Checkpoints of the sequential loop
+    struct Checkpointing {
+        std::string path;
+        double interval_s = 600.0;
+        std::string resume_path;
+        long long resumed_cycle = -1;
+        uint64_t fingerprint = 0;   // Taken after the prepass, before the first tile moves on
+        std::thread writer;
+        std::atomic<bool> writing{false};
+        // Updated by the writer thread, read after joining it
+        int written = 0;
+        long long last_cycle = -1;
+    } checkpoint;
+    uint64_t checkpointFingerprint();
+    void saveState(CheckpointWriter& out);
+    void loadState(CheckpointReader& in);
+    // Copies the state and leaves the file to the writer thread
+    void writeCheckpoint();
+    bool resumeCheckpoint();
+    nlohmann::json printCheckpoint();
+    // visit(name, fifo) for every FIFO between the stages, in dataflow order
+    template <typename Visit>
+    void forEachFifo(Visit&& visit) {
+        visit("hash_in", hash_in_Fifo);
+        visit("sh_in", sh_in_Fifo);
+        visit("hash_out", hash_out_Fifo);
+        visit("sh_out", sh_out_Fifo);
+        visit("sigmlp_in", sigmlp_in_Fifo);
+        visit("sigmlp_out", sigmlp_out_Fifo);
+        visit("colmlp_hash", colmlpFifo_Hash);
+        visit("colmlp_sh", colmlpFifo_SH);
+        visit("colmlp_out", colmlp_out_Fifo);
+        visit("vr_in", vr_in_Fifo);
+        visit("vr_out", vr_out_Fifo);
+        visit("et", etFifo);
+    }
+
+    // Sparse MLPs
+    struct Pruning {
+        bool enabled = false;
+        float threshold = 0.0f;
+        float target_sparsity = 0.0f;
+        MLP::PEArray pe;
+        // Results
+        float sig_threshold = 0.0f, col_threshold = 0.0f;
+        float sig_sparsity = 0.0f, col_sparsity = 0.0f;
+        int sig_dense_cycles = 1, col_dense_cycles = 1;
+        long long dense_cycles[2] = {0, 0};   // Busy cycles of sigma/color MLP without skipping
+        long long sparse_cycles[2] = {0, 0};
+    } pruning;
+    void applyPruning();
+    // Per-simulator state derived from the loaded modules
+    void attachModules();
+    nlohmann::json printPruning();
+
+    void selectSampledPixels();
+    void estimateFromSamples();
+    void validateSampling();
+    std::string ground_truth_path;
+    std::string output_image_path = "output.png";
+    bool write_history_files = true;
+    void evaluateQuality();
+
+    // Host Profiling
+    enum ProfileSection {
+        PROF_LOAD_CONFIGS,
+        PROF_LOAD_PARAMS,
+        PROF_PREPASS,
+        PROF_SIMULATE,
+        PROF_RAYMARCHING,
+        PROF_HASHENCODING,
+        PROF_SHENCODING,
+        PROF_SIGMAMLP,
+        PROF_COLORMLP,
+        PROF_VOLUMERENDERING,
+        PROF_FIFO_UPDATE,
+        PROF_OUTPUT,
+        PROF_QUALITY
+    };
+    Profiler profiler = Profiler({
+        "load_configs", "load_parameters", "prepass", "simulate",
+        "rayMarching", "hashEncoding", "shEncoding", "sigmaMLP", "colorMLP", "volumeRendering",
+        "fifo_update", "output", "quality"
+    });
+    double progress_interval_s = 5.0;
+    std::function<void(const nlohmann::json&)> progress_callback;
+    void printProgress(double elapsed);
+    struct Limits {
+        long long max_cycles = 0;
+        double max_seconds = 0.0;
+    } limits;
+    // Empty while the run is within its limits
+    std::string limitReached(long long cycles, double elapsed) const;
+
     // Process Variables
     int rayCount;
     int MAX_RAY_COUNT;
@@ -56,10 +548,6 @@ private:
         COLORMLP,
         VOLUMERENDERING
     };
-    enum ModuleState {
-        WAIT_FOR_INPUT,
-        DONE_AN_EXECUTION
-    };
     enum ModuleState module_state[6] = {
         /* RAY MARCHING */ WAIT_FOR_INPUT,
         /* HASH ENCODING */ WAIT_FOR_INPUT,
@@ -84,14 +572,144 @@ private:
         /* COLOR MLP */ 0,
         /* VOLUME RENDERING */ 0
     };
+    StageStalls stalls[6];
+    // Cycle of each stage. The sequential loop advances them together, in
+    // parallel mode every stage thread advances its own.
+    struct alignas(64) StageClock {
+        long long cycle = 0;              // Cycle being evaluated, owned by the stage
+        std::atomic<long long> done{0};   // Cycles completed, published to other stages
+    };
+    StageClock clocks[6];
     void initialize();
+    void simulate();
+    bool endRayMarchingCycle();
+    void sampleReorderStats(int stage);
+
+    // Parallel discrete-event simulation
+    struct Parallel {
+        bool enabled = false;
+        bool validate = false;
+        // Stage s evaluates cycle c once stage t has completed c + lead[s][t] cycles, -1 for none
+        int lead[6][6];
+        std::atomic<long long> stop{0};   // Last cycle, set by ray marching
+        std::atomic<int> finished{0};
+        std::atomic<bool> abort{false};   // Ray marching stops at its next cycle
+        // Statistics
+        long long waits[6] = {0};         // Times a stage had to wait for another one
+        long long skipped[6] = {0};       // Busy cycles passed without evaluation
+        long long samples_issued = 0, samples_rendered = 0;
+        double host_time_s = 0.0;
+        // Validation against the sequential run
+        bool validated = false;
+        bool matched = false;
+        int sequential_cycle_count = 0;
+        double sequential_host_time_s = 0.0;
+    } parallel;
+    template <typename T>
+    void connect(FIFO<T>& fifo, Stage producer, Stage consumer);
+    void connectStages();
+    void simulateParallel();
+    template <int S>
+    void runStage();
+    void waitForStage(int stage, long long cycles, long long& waits);
+    bool waitForRayMarching(long long cycle, long long& waits);
+    void validateParallel();
+    uint64_t frameChecksum();
+    nlohmann::json printParallel();
+    // Statistics a validation rerun resets or adds to, restored after it so
+    // the report is that of the validated run. The frame is the rerun's.
+    struct RunStats {
+        explicit RunStats(const Profiler& profiler): profiler(profiler) {}
+        Profiler profiler;
+        int ray_count = 0;
+        long long simulated_cycles = 0, samples_issued = 0, samples_rendered = 0;
+        StageStalls stalls[6];
+        int ray_buffer_peak = 0;
+        long long ray_buffer_full_stall_cycles = 0;
+        long long join_occupancy = 0, vr_occupancy = 0;
+        int join_peak = 0, vr_peak = 0;
+        long long join_stall_cycles = 0, vr_stall_cycles = 0, vr_order_stall_cycles = 0;
+        long long hash_lookups = 0, hash_misses = 0;
+        long long sh_evaluations = 0, sh_reuses = 0;
+        long long dense_cycles[2] = {0, 0}, sparse_cycles[2] = {0, 0};
+        Lanes lanes;
+        Marching march;
+        Energy energy;
+        Bottleneck bottleneck;
+        std::unique_ptr<HashAnalysis> hash_analysis;
+    };
+    // Moves the hash analysis out so the rerun does not record the lookups twice
+    RunStats saveRunStats();
+    void restoreRunStats(RunStats& stats);
+    // On-chip ray buffer. Each ray in flight owns a slot, and the pipeline
+    // registers carry the slot instead of the ray.
+    struct RayState {
+        int id;                   // Sequence ID, -1 for a free slot
+        int pixel;
+        int tile;
+        float t;                  // Marching position
+        int t_count;              // Samples issued
+        int outstanding;          // Samples issued but not yet retired by volume rendering
+        bool marched;             // Ray marching is done with this ray
+        Vec3f color;
+        float opacity;            // 1 - transmittance
+        Vec3f committed_color;    // Written back at early termination / end of marching
+        float committed_opacity;
+        bool sh_valid;            // sh holds the ray's encoded direction
+        Vec16f sh;
+        // Cost maps
+        long long start_cycle;
+        int rendered;             // Samples composited
+        int termination;
+        float depth;              // Weighted sample t
+        float committed_depth;
+        long long accesses[NUM_ACCESSES];   // Energy accounting of a sampled run
+        CHECKPOINT_FIELDS(id, pixel, tile, t, t_count, outstanding, marched, color, opacity,
+            committed_color, committed_opacity, sh_valid, sh, start_cycle, rendered, termination,
+            depth, committed_depth, accesses)
+    };
+    struct RayTable {
+        int capacity = 16;
+        std::vector<RayState> slots;
+        std::vector<int> free_slots;
+        int occupied = 0;
+        // Statistics
+        int peak_occupied = 0;
+        long long full_stall_cycles = 0;
+
+        void reset() {
+            slots.assign(capacity, RayState());
+            free_slots.clear();
+            for (int i = capacity - 1; i >= 0; i--) {
+                slots[i].id = -1;
+                free_slots.push_back(i);
+            }
+            occupied = 0;
+            peak_occupied = 0;
+            full_stall_cycles = 0;
+        }
+        int allocate() {
+            if (free_slots.empty()) return -1;
+            int slot = free_slots.back();
+            free_slots.pop_back();
+            occupied++;
+            if (occupied > peak_occupied) peak_occupied = occupied;
+            return slot;
+        }
+        void release(int slot) {
+            slots[slot].id = -1;
+            free_slots.push_back(slot);
+            occupied--;
+        }
+    } rayTable;
     struct FeaturePool {
         // Ray Marching
-        int rayID;
-        int rayMarchingID;
-        std::vector<int> valid_pixel;
-        std::vector<int> t_count;
-        std::vector<float> ts;
+        int rayID;                      // Index in the work list of the current tile
+        int rayMarchingID;              // Sequence ID of the marched ray
+        int raySlot;                    // Ray buffer slot of the marched ray
+        int tileBase;                   // Sequence ID of valid_pixel[0]
+        std::vector<int> valid_pixel;   // Work list of the current tile
+        std::vector<float> valid_t;     // t just before the first occupied sample
         
         // Hash Encoding
         int HashRayID;
@@ -103,83 +721,233 @@ private:
         int ColorRayID;
         // Volume Rendering
         int VolumeRayID;
-        std::vector<Vec3f> colors;
-        std::vector<float> opacities;
     } featurePool;
+    void startRay(int seq, int index, int slot);
+    void retireRay(int slot, long long cycle);
+    // Write back the accumulated color if it is more opaque than the last one
+    static bool writeBack(RayState& state) {
+        if (state.committed_opacity < state.opacity) {
+            state.committed_color = state.color;
+            state.committed_opacity = state.opacity;
+            state.committed_depth = state.depth;
+            return true;
+        }
+        return false;
+    }
+
+    // Modules until loadParameters has loaded them, empty after
+    struct {
+        std::shared_ptr<OccupancyGrid> occupancy_grid;
+        std::shared_ptr<MLP> sig_mlp, col_mlp;
+        std::shared_ptr<HashEncoding> hash_enc;
+    } unloaded;
 
     // Note: All the fifo are input fifo.
-    void init_valid_pixel();
+    void init_valid_pixel(int x0, int y0, int w, int h);
     void rayMarching();
     std::shared_ptr<Camera> camera;
-    std::shared_ptr<OccupancyGrid> occupancy_grid;
+    std::shared_ptr<const OccupancyGrid> occupancy_grid;
     struct ET_Data {
-        int rayID;
+        int rayID;  // Sequence ID, the slot may already be reused
     };
     FIFO<ET_Data> etFifo;
     void hashEncoding();
-    std::shared_ptr<HashEncoding> hash_enc;
+    std::shared_ptr<const HashEncoding> hash_enc;
+    // Registers carry a packet of samples of one ray, a column per lane
     struct Hash_in_Reg {
         int rayID;
-        Vec3f input;
+        Tag tag;        // Packet sequence number
+        Packet<3> input;
+        CHECKPOINT_FIELDS(rayID, tag, input)
     };
     FIFO<Hash_in_Reg> hash_in_Fifo;
     struct Hash_out_Reg {
         int rayID;
-        Vec32f output;
+        Tag tag;
+        Packet<32> output;
+        CHECKPOINT_FIELDS(rayID, tag, output)
     };
     FIFO<Hash_out_Reg> hash_out_Fifo;
-    void shEncoding();
     std::shared_ptr<SHEncoding> sh_enc;
+    bool sh_per_ray = false;
+    long long sh_evaluations = 0;  // Samples that ran the SH unit
+    long long sh_reuses = 0;       // Samples served from the ray's slot
     struct SH_in_Reg {
         int rayID;
-        Vec3f input;
+        Tag tag;
+        Packet<3> input;
+        Packet<1> dt;    // Step size of each sample
+        CHECKPOINT_FIELDS(rayID, tag, input, dt)
     };
     FIFO<SH_in_Reg> sh_in_Fifo;
     struct SH_out_Reg {
         int rayID;
-        Vec16f output;
+        Tag tag;
+        Packet<16> output;
+        Packet<1> dt;
+        CHECKPOINT_FIELDS(rayID, tag, output, dt)
     };
     FIFO<SH_out_Reg> sh_out_Fifo;
-    void sigmaMLP();
-    std::shared_ptr<MLP> sig_mlp;
+    std::shared_ptr<const MLP> sig_mlp;
     struct SigMLP_in_Reg {
         int rayID;
-        Vec32f input;
+        Tag tag;
+        Packet<32> input;
+        CHECKPOINT_FIELDS(rayID, tag, input)
     };
     FIFO<SigMLP_in_Reg> sigmlp_in_Fifo;
     struct SigMLP_out_Reg {
         int rayID;
-        Vec16f output;
+        Tag tag;
+        Packet<16> output;
+        CHECKPOINT_FIELDS(rayID, tag, output)
     };
     FIFO<SigMLP_out_Reg> sigmlp_out_Fifo;
-    void colorMLP();
-    std::shared_ptr<MLP> col_mlp;
+    std::shared_ptr<const MLP> col_mlp;
     struct Col_MLP_From_Hash {
         int rayID;
-        Vec16f input;
+        Tag tag;
+        Packet<16> input;
+        CHECKPOINT_FIELDS(rayID, tag, input)
     };
     FIFO<Col_MLP_From_Hash> colmlpFifo_Hash;
     struct Col_MLP_From_SH {
         int rayID;
-        Vec16f input;
+        Tag tag;
+        Packet<16> input;
+        Packet<1> dt;
+        CHECKPOINT_FIELDS(rayID, tag, input, dt)
     };
     FIFO<Col_MLP_From_SH> colmlpFifo_SH;
     struct Col_MLP_out_Reg {
         int rayID;
-        Vec4f output;
+        Tag tag;
+        Packet<4> output;
+        Packet<1> dt;
+        CHECKPOINT_FIELDS(rayID, tag, output, dt)
     };
     FIFO<Col_MLP_out_Reg> colmlp_out_Fifo;
     
-    void volumeRendering();
     struct VR_in_Reg {
         int rayID;
-        Vec4f input;
+        Tag tag;
+        Packet<4> input;
+        Packet<1> dt;
+        CHECKPOINT_FIELDS(rayID, tag, input, dt)
     };
     FIFO<VR_in_Reg> vr_in_Fifo;
     struct VR_out_Reg {
         int rayID;
+        int lanes;      // Samples composited
     };
     FIFO<VR_out_Reg> vr_out_Fifo;
+
+    // Reorder buffers
+    struct JoinEntry {
+        int rayID;
+        bool has_hash = false, has_sh = false;
+        Packet<16> hash, sh;
+        Packet<1> dt;
+        CHECKPOINT_FIELDS(rayID, has_hash, has_sh, hash, sh, dt)
+    };
+    struct Reorder {
+        int join_size = 0, vr_size = 0;
+        ReorderBuffer<JoinEntry> join;
+        ReorderBuffer<VR_in_Reg> vr;
+        Tag next_tag = 0;  // Tag of the next packet issued by ray marching, wraps around
+        // Statistics
+        long long join_occupancy = 0, vr_occupancy = 0;  // Summed every cycle
+        int join_peak = 0, vr_peak = 0;
+        long long join_stall_cycles = 0;  // An arrival was outside the window
+        long long vr_stall_cycles = 0;
+        long long vr_order_stall_cycles = 0;  // Volume rendering waits for an older sample
+    } reorder;
+    void acceptJoin();
+    void acceptVR();
+    // Hash lookups with misses
+    struct HashMiss {
+        bool enabled = false;
+        float rate = 0.0f;
+        int latency = 20;
+        size_t outstanding = 8;
+        unsigned seed = 0;
+        std::mt19937 rng;
+        struct Lookup {
+            long long ready;  // Cycle the result can leave the unit
+            Hash_out_Reg result;
+            CHECKPOINT_FIELDS(ready, result)
+        };
+        std::vector<Lookup> pending;
+        long long lookups = 0, misses = 0;
+    } hash_miss;
+    void hashEncodingVariable();
+
+    // Stage kernels, see Stage in pipeline.hpp
+    struct HashKernel {
+        Simulator* sim;
+        void beginCycle() {}
+        bool fetch(Hash_in_Reg& input);
+        Hash_out_Reg run(const Hash_in_Reg& input, int& cycles);
+        Drain drain(FIFO<Hash_out_Reg>& out);
+    };
+    struct SHKernel {
+        Simulator* sim;
+        void beginCycle() {}
+        bool fetch(SH_in_Reg& input);
+        SH_out_Reg run(const SH_in_Reg& input, int& cycles);
+        Drain drain(FIFO<SH_out_Reg>& out);
+    };
+    struct SigmaKernel {
+        Simulator* sim;
+        void beginCycle() {}
+        bool fetch(SigMLP_in_Reg& input);
+        SigMLP_out_Reg run(const SigMLP_in_Reg& input, int& cycles);
+        Drain drain(FIFO<SigMLP_out_Reg>& out);
+    };
+    // Both halves of a sample, joined in lockstep or through the reorder buffer
+    struct ColorInput {
+        Col_MLP_From_Hash hash;
+        Col_MLP_From_SH sh;
+    };
+    struct ColorKernel {
+        Simulator* sim;
+        void beginCycle();
+        bool fetch(ColorInput& input);
+        Col_MLP_out_Reg run(const ColorInput& input, int& cycles);
+        Drain drain(FIFO<Col_MLP_out_Reg>& out);
+    };
+    struct VRKernel {
+        Simulator* sim;
+        void beginCycle();
+        bool fetch(VR_in_Reg& input);
+        VR_out_Reg run(const VR_in_Reg& input, int& cycles);
+        Drain drain(FIFO<VR_out_Reg>& out);
+    };
+    using HashStage = ::Stage<Hash_in_Reg, Hash_out_Reg, HashKernel>;
+    using SHStage = ::Stage<SH_in_Reg, SH_out_Reg, SHKernel>;
+    using SigmaStage = ::Stage<SigMLP_in_Reg, SigMLP_out_Reg, SigmaKernel>;
+    using ColorStage = ::Stage<ColorInput, Col_MLP_out_Reg, ColorKernel>;
+    using VRStage = ::Stage<VR_in_Reg, VR_out_Reg, VRKernel>;
+    using RayMarchingStage = MemberStage<Simulator, &Simulator::rayMarching>;
+    using HashEncodingStage = MemberStage<Simulator, &Simulator::hashEncoding>;
+
+    HashStage hash_stage{HashKernel{this}, hash_out_Fifo, waitCounter[HASHENCODING], module_state[HASHENCODING], latency[HASHENCODING], stalls[HASHENCODING]};
+    SHStage sh_stage{SHKernel{this}, sh_out_Fifo, waitCounter[SHENCODING], module_state[SHENCODING], latency[SHENCODING], stalls[SHENCODING]};
+    SigmaStage sigma_stage{SigmaKernel{this}, sigmlp_out_Fifo, waitCounter[SIGMAMLP], module_state[SIGMAMLP], latency[SIGMAMLP], stalls[SIGMAMLP]};
+    ColorStage color_stage{ColorKernel{this}, colmlp_out_Fifo, waitCounter[COLORMLP], module_state[COLORMLP], latency[COLORMLP], stalls[COLORMLP]};
+    VRStage vr_stage{VRKernel{this}, vr_out_Fifo, waitCounter[VOLUMERENDERING], module_state[VOLUMERENDERING], latency[VOLUMERENDERING], stalls[VOLUMERENDERING]};
+    RayMarchingStage ray_marching_stage{this};
+    HashEncodingStage hash_encoding_stage{this};
+    // Evaluated in Stage order, the index matches the profiler sections from PROF_RAYMARCHING
+    Pipeline<RayMarchingStage, HashEncodingStage, SHStage, SigmaStage, ColorStage, VRStage> pipeline{
+        ray_marching_stage, hash_encoding_stage, sh_stage, sigma_stage, color_stage, vr_stage
+    };
+    // Connected in connectStages()
+    FifoGroup<ET_Data, Hash_in_Reg, Hash_out_Reg, SH_in_Reg, SH_out_Reg, SigMLP_in_Reg, SigMLP_out_Reg,
+        Col_MLP_From_Hash, Col_MLP_From_SH, Col_MLP_out_Reg, VR_in_Reg, VR_out_Reg> fifos{
+        etFifo, hash_in_Fifo, hash_out_Fifo, sh_in_Fifo, sh_out_Fifo, sigmlp_in_Fifo, sigmlp_out_Fifo,
+        colmlpFifo_Hash, colmlpFifo_SH, colmlp_out_Fifo, vr_in_Fifo, vr_out_Fifo
+    };
 };
 
 
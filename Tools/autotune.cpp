@@ -0,0 +1,400 @@
+// Frame-rate auto-tuner: searches max_t_count, clock frequency and lane
+// width for configurations that reach a target FPS above a PSNR floor.
+//
+// Cycles and PSNR do not depend on the clock, so only (max_t_count, lanes)
+// pairs are simulated, each once: results are cached in memory and in a
+// JSON file keyed by scene, resolution and arguments, the size and time of
+// the ./main binary and snapshot, and a hash of the config and camera
+// files, and every frequency is evaluated from them. For each lane width max_t_count is bisected for
+// the smallest value meeting the PSNR floor (PSNR grows with max_t_count,
+// cycles too), then the frequency list is bisected for the lowest clock
+// reaching the target. FPS is scaled from the simulated resolution to the
+// equivalent one by pixel count.
+//
+// Usage: ./autotune <scene> --target-fps 30 [--psnr-floor 25] [--equivalent 800x800]
+//                   [--resolution 200] [--max-t 8:1024] [--lanes 1,2,4,8]
+//                   [--frequencies 100,200,400,600,800,1000,1500,2000]
+//                   [--main ./main] [--cache autotune_cache.json] [--json autotune.json]
+//                   [-- extra ./main arguments]
+// Hardware cost is lanes x MHz / 100, a proxy for datapath area times clock.
+// Lanes are the datapath width of all stages: every stage executes the
+// packets ray marching forms, so a per-stage width would not change them.
+#include <nlohmann/json.hpp>
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Options {
+    std::string scene;
+    double target_fps = 0.0;
+    double psnr_floor = 0.0;
+    int equivalent_w = 800, equivalent_h = 800;
+    int resolution = 200;
+    int max_t_low = 8, max_t_high = 1024;
+    std::vector<int> lanes = {1, 2, 4, 8};
+    std::vector<int> frequencies = {100, 200, 400, 600, 800, 1000, 1500, 2000};
+    std::string main_path = "./main";
+    std::string cache_path = "autotune_cache.json";
+    std::string json_path = "autotune.json";
+    std::string log_path = "autotune.log";
+    std::vector<std::string> extra;
+};
+
+// One simulation, independent of the clock
+struct Result {
+    long long cycles = 0;
+    double psnr_db = 0.0;
+    bool has_psnr = false;
+};
+
+struct Point {
+    int max_t_count, lanes, frequency;
+    double fps;       // At the equivalent resolution
+    double psnr_db;
+    double cost;
+    bool feasible;    // Meets the target and the floor
+};
+
+// Frequency of the simulation runs, the report name depends on it
+constexpr int RUN_FREQUENCY = 100;
+
+std::vector<int> parseList(const std::string& text) {
+    std::vector<int> values;
+    std::stringstream list(text);
+    std::string item;
+    while (std::getline(list, item, ',')) values.push_back(std::stoi(item));
+    return values;
+}
+
+// Size and modification time, to notice a rebuilt binary or a new snapshot
+std::string fileStamp(const std::string& path) {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) return "missing";
+    return std::to_string(info.st_size) + "@" + std::to_string(info.st_mtime);
+}
+
+// FNV-1a of the contents, for the small JSON inputs
+std::string fileHash(const std::string& path) {
+    std::ifstream fin(path, std::ios::binary);
+    if (!fin) return "missing";
+    uint64_t hash = 1469598103934665603ull;
+    char c;
+    while (fin.get(c)) hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    char text[17];
+    snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(hash));
+    return text;
+}
+
+class Tuner {
+public:
+    explicit Tuner(const Options& options): options(options) {
+        // Inputs of ./main besides its arguments, as main resolves them
+        std::string config_path = "./configs/base.json";
+        for (size_t i = 0; i + 1 < options.extra.size(); i++) {
+            if (options.extra[i] == "--config") config_path = options.extra[i + 1];
+        }
+        inputs = "main=" + fileStamp(options.main_path) + " config=" + fileHash(config_path) +
+            " cameras=" + fileHash("./data/nerf_synthetic/" + options.scene + "/transforms_test.json") +
+            " snapshot=" + fileStamp("./snapshots/Hash19_Float/" + options.scene + ".msgpack");
+        std::ifstream fin(options.cache_path);
+        if (fin) {
+            try {
+                fin >> cache;
+            }
+            catch (const nlohmann::json::exception&) {
+                printf("Ignoring unreadable cache [%s]\n", options.cache_path.c_str());
+                cache = nlohmann::json::object();
+            }
+        }
+        if (!cache.is_object()) cache = nlohmann::json::object();
+    }
+
+    // Simulated or cached. Returns false when ./main failed.
+    bool evaluate(int max_t_count, int lanes, Result& result) {
+        std::string key = cacheKey(max_t_count, lanes);
+        if (cache.contains(key)) {
+            result.cycles = cache[key].at("cycles").get<long long>();
+            result.has_psnr = cache[key].contains("psnr_db");
+            if (result.has_psnr) result.psnr_db = cache[key]["psnr_db"].get<double>();
+            hits++;
+            return true;
+        }
+        if (!run(max_t_count, lanes, result)) return false;
+        nlohmann::json entry = {{"cycles", result.cycles}};
+        if (result.has_psnr) entry["psnr_db"] = result.psnr_db;
+        cache[key] = entry;
+        std::ofstream fout(options.cache_path);
+        fout << cache.dump(4) << "\n";
+        runs++;
+        return true;
+    }
+
+    double fps(long long cycles, int frequency) const {
+        double scale = static_cast<double>(options.resolution) * options.resolution /
+            (static_cast<double>(options.equivalent_w) * options.equivalent_h);
+        return frequency * 1e6 / cycles * scale;
+    }
+
+    int runs = 0, hits = 0;
+
+private:
+    const Options& options;
+    nlohmann::json cache;
+    std::string inputs;
+
+    std::string cacheKey(int max_t_count, int lanes) const {
+        std::string key = options.scene + " " + std::to_string(options.resolution) + " " +
+            std::to_string(max_t_count) + " --lanes " + std::to_string(lanes);
+        for (const std::string& arg : options.extra) key += " " + arg;
+        return key + " | " + inputs;
+    }
+
+    bool run(int max_t_count, int lanes, Result& result) {
+        std::vector<std::string> args = {
+            options.main_path, options.scene, std::to_string(RUN_FREQUENCY), std::to_string(max_t_count),
+            "--resolution", std::to_string(options.resolution), "--lanes", std::to_string(lanes)
+        };
+        args.insert(args.end(), options.extra.begin(), options.extra.end());
+        std::string report_path = "History_" + std::to_string(RUN_FREQUENCY) + "MHz_" + options.scene + ".json";
+        remove(report_path.c_str());
+        printf("  simulating max_t_count %d, lanes %d\n", max_t_count, lanes);
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid < 0) {
+            puts("Error: fork failed");
+            exit(1);
+        }
+        if (pid == 0) {
+            int fd = open(options.log_path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+            if (fd >= 0) {
+                dup2(fd, STDOUT_FILENO);
+                dup2(fd, STDERR_FILENO);
+                close(fd);
+            }
+            std::vector<char*> argv;
+            for (std::string& arg : args) argv.push_back(&arg[0]);
+            argv.push_back(nullptr);
+            execv(argv[0], argv.data());
+            _exit(127);
+        }
+        int status;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            printf("Error: ./main failed for max_t_count %d, lanes %d, see [%s]\n",
+                max_t_count, lanes, options.log_path.c_str());
+            return false;
+        }
+        std::ifstream fin(report_path);
+        if (!fin) {
+            printf("Error: no report [%s]\n", report_path.c_str());
+            return false;
+        }
+        nlohmann::json report;
+        fin >> report;
+        result.cycles = report.at("cycle_count").get<long long>();
+        result.has_psnr = report.contains("quality");
+        if (result.has_psnr) result.psnr_db = report["quality"].at("psnr_db").get<double>();
+        return true;
+    }
+};
+
+bool meetsFloor(const Result& result, double floor) {
+    return floor <= 0.0 || (result.has_psnr && result.psnr_db >= floor);
+}
+
+// a is at least as good as b everywhere and better somewhere
+bool dominates(const Point& a, const Point& b) {
+    bool no_worse = a.fps >= b.fps && a.psnr_db >= b.psnr_db && a.cost <= b.cost;
+    bool better = a.fps > b.fps || a.psnr_db > b.psnr_db || a.cost < b.cost;
+    return no_worse && better;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--") {
+            options.extra.assign(argv + i + 1, argv + argc);
+            break;
+        }
+        else if (arg == "--target-fps" && i + 1 < argc) options.target_fps = std::stod(argv[++i]);
+        else if (arg == "--psnr-floor" && i + 1 < argc) options.psnr_floor = std::stod(argv[++i]);
+        else if (arg == "--equivalent" && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &options.equivalent_w, &options.equivalent_h) != 2) {
+                printf("Invalid equivalent resolution [%s], expected <width>x<height>\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (arg == "--resolution" && i + 1 < argc) options.resolution = std::stoi(argv[++i]);
+        else if (arg == "--max-t" && i + 1 < argc) {
+            if (sscanf(argv[++i], "%d:%d", &options.max_t_low, &options.max_t_high) != 2) {
+                printf("Invalid max_t_count range [%s], expected <low>:<high>\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (arg == "--lanes" && i + 1 < argc) options.lanes = parseList(argv[++i]);
+        else if (arg == "--frequencies" && i + 1 < argc) options.frequencies = parseList(argv[++i]);
+        else if (arg == "--main" && i + 1 < argc) options.main_path = argv[++i];
+        else if (arg == "--cache" && i + 1 < argc) options.cache_path = argv[++i];
+        else if (arg == "--json" && i + 1 < argc) options.json_path = argv[++i];
+        else if (arg[0] != '-' && options.scene.empty()) options.scene = arg;
+        else {
+            printf("Unknown argument [%s]\n", arg.c_str());
+            exit(1);
+        }
+    }
+    if (options.scene.empty() || options.target_fps <= 0.0) {
+        puts("Error: a scene and --target-fps are required");
+        exit(1);
+    }
+    if (options.max_t_low < 1 || options.max_t_low > options.max_t_high ||
+        options.lanes.empty() || options.frequencies.empty() || options.resolution < 1) {
+        puts("Error: invalid search space");
+        exit(1);
+    }
+    std::sort(options.frequencies.begin(), options.frequencies.end());
+    Tuner tuner(options);
+    std::vector<Point> points;
+    std::map<std::pair<int, int>, Result> evaluated;
+
+    for (int lanes : options.lanes) {
+        printf("Lanes %d\n", lanes);
+        auto evaluate = [&](int max_t_count, Result& result) {
+            if (!tuner.evaluate(max_t_count, lanes, result)) exit(1);
+            evaluated[{max_t_count, lanes}] = result;
+        };
+        // Smallest max_t_count meeting the PSNR floor
+        Result high;
+        evaluate(options.max_t_high, high);
+        if (!meetsFloor(high, options.psnr_floor)) {
+            if (!high.has_psnr) puts("  no PSNR in the report, is the ground truth image missing?");
+            printf("  PSNR floor not reached at max_t_count %d\n", options.max_t_high);
+            continue;
+        }
+        int lower = options.max_t_low, upper = options.max_t_high;
+        Result probe;
+        evaluate(lower, probe);
+        if (!meetsFloor(probe, options.psnr_floor)) {
+            while (upper - lower > 1) {
+                int middle = lower + (upper - lower) / 2;
+                evaluate(middle, probe);
+                if (meetsFloor(probe, options.psnr_floor)) upper = middle;
+                else lower = middle;
+            }
+        }
+        else {
+            upper = lower;
+        }
+        const Result& best = evaluated[{upper, lanes}];
+        // Lowest listed clock reaching the target
+        auto reaches = [&](int frequency) { return tuner.fps(best.cycles, frequency) >= options.target_fps; };
+        int first = 0, last = options.frequencies.size();
+        while (first < last) {
+            int middle = (first + last) / 2;
+            if (reaches(options.frequencies[middle])) last = middle;
+            else first = middle + 1;
+        }
+        if (first < static_cast<int>(options.frequencies.size())) {
+            printf("  max_t_count %d at %d MHz: %.2f FPS\n", upper, options.frequencies[first],
+                tuner.fps(best.cycles, options.frequencies[first]));
+        }
+        else {
+            printf("  max_t_count %d does not reach %.2f FPS at %d MHz\n", upper, options.target_fps,
+                options.frequencies.back());
+        }
+    }
+
+    // Every simulated pair at every clock
+    for (const auto& item : evaluated) {
+        for (int frequency : options.frequencies) {
+            Point point;
+            point.max_t_count = item.first.first;
+            point.lanes = item.first.second;
+            point.frequency = frequency;
+            point.fps = tuner.fps(item.second.cycles, frequency);
+            point.psnr_db = item.second.has_psnr ? item.second.psnr_db : 0.0;
+            point.cost = point.lanes * frequency / 100.0;
+            point.feasible = point.fps >= options.target_fps && meetsFloor(item.second, options.psnr_floor);
+            points.push_back(point);
+        }
+    }
+    std::vector<Point> front;
+    for (const Point& p : points) {
+        bool dominated = false;
+        for (const Point& q : points) {
+            if (dominates(q, p)) {
+                dominated = true;
+                break;
+            }
+        }
+        if (!dominated) front.push_back(p);
+    }
+    std::sort(front.begin(), front.end(), [](const Point& a, const Point& b) {
+        return a.cost != b.cost ? a.cost < b.cost : a.fps > b.fps;
+    });
+
+    printf("Pareto front over FPS, PSNR and cost (%zu of %zu points, %d simulations, %d cached)\n",
+        front.size(), points.size(), tuner.runs, tuner.hits);
+    printf("%12s %6s %10s %12s %10s %8s %s\n", "max_t_count", "Lanes", "MHz", "FPS", "PSNR (dB)", "Cost", "");
+    const Point* pick = nullptr;
+    nlohmann::json front_json = nlohmann::json::array();
+    for (const Point& p : front) {
+        printf("%12d %6d %10d %12.2f %10.3f %8.1f %s\n", p.max_t_count, p.lanes, p.frequency, p.fps, p.psnr_db, p.cost,
+            p.feasible ? "meets target" : "");
+        if (p.feasible && (pick == nullptr || p.cost < pick->cost ||
+            (p.cost == pick->cost && p.psnr_db > pick->psnr_db))) {
+            pick = &p;
+        }
+        front_json.push_back({
+            {"max_t_count", p.max_t_count},
+            {"lanes", p.lanes},
+            {"frequency_mhz", p.frequency},
+            {"fps", p.fps},
+            {"psnr_db", p.psnr_db},
+            {"cost", p.cost},
+            {"feasible", p.feasible}
+        });
+    }
+    nlohmann::json result = {
+        {"scene", options.scene},
+        {"target_fps", options.target_fps},
+        {"psnr_floor", options.psnr_floor},
+        {"equivalent_resolution", {options.equivalent_w, options.equivalent_h}},
+        {"simulated_resolution", options.resolution},
+        {"simulations", tuner.runs},
+        {"cache_hits", tuner.hits},
+        {"pareto_front", front_json}
+    };
+    if (pick != nullptr) {
+        printf("Cheapest configuration meeting the target: ./main %s %d %d --lanes %d (%.2f FPS, %.3f dB)\n",
+            options.scene.c_str(), pick->frequency, pick->max_t_count, pick->lanes, pick->fps, pick->psnr_db);
+        result["recommended"] = {
+            {"max_t_count", pick->max_t_count},
+            {"lanes", pick->lanes},
+            {"frequency_mhz", pick->frequency}
+        };
+    }
+    else {
+        puts("No configuration meets the target FPS and the PSNR floor");
+    }
+    std::ofstream fout(options.json_path);
+    fout << result.dump(4) << "\n";
+    fout.close();
+    printf("Results written to [%s]\n", options.json_path.c_str());
+    return pick != nullptr ? 0 : 1;
+}
@@ -0,0 +1,227 @@
+// Synthetic scene generator: writes a snapshot and camera JSON in the
+// layout ./main reads, so a scene can be simulated without the NeRF data.
+// Everything is derived from the seed, the same options give the same files.
+//
+// Usage: ./gen-scene [--name synth] [--out .] [--config ./configs/base.json] [--seed 0]
+//                    [--structure sphere|shell|scattered] [--radius 0.25] [--thickness 0.05]
+//                    [--density 1.0] [--weights random|procedural] [--hash-std 0.1]
+//                    [--views 1] [--distance 4.0] [--elevation 30]
+// Then: ./main <name> [frequency] [max_t_count]
+#include "hash.hpp"
+#include "mlp.hpp"
+#include "utils.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Options {
+    std::string name = "synth";
+    std::string out = ".";
+    std::string config_path = "./configs/base.json";
+    unsigned seed = 0;
+    // Occupancy, in the simulator's [0, 1)^3 grid space around its center
+    std::string structure = "sphere";
+    float radius = 0.25f;
+    float thickness = 0.05f;
+    float density = 1.0f;        // Fraction of the structure's cells kept
+    // Parameters
+    std::string weights = "random";
+    float hash_std = 0.1f;
+    // Cameras on a ring looking at the origin, NeRF units
+    int views = 1;
+    float distance = 4.0f;
+    float elevation_deg = 30.0f;
+};
+
+constexpr int GRID_RESOLUTION = 128;
+constexpr float CAMERA_ANGLE_X = 0.6911112070083618f;
+
+// Deterministic value in [-1, 1) without a generator, for procedural weights
+float procedural(long long i, float frequency) {
+    return std::sin(i * frequency + 0.5f * std::sin(i * 0.013f));
+}
+
+// Fills n values: normal with the given std, or a procedural pattern with the same spread
+void fill(std::vector<float>& params, long long n, float std_dev, const Options& options, std::mt19937& rng) {
+    std::normal_distribution<float> dist(0.0f, std_dev);
+    long long base = params.size();
+    for (long long i = 0; i < n; i++) {
+        if (options.weights == "procedural") params.push_back(std_dev * 1.41421356f * procedural(base + i, 0.7548776f));
+        else params.push_back(dist(rng));
+    }
+}
+
+// Layer by layer as MLP::loadParameters reads them, Xavier-scaled
+void fillMLP(std::vector<float>& params, int input_size, int output_size, const nlohmann::json& config,
+    const Options& options, std::mt19937& rng) {
+    int width = utils::get_int_from_json(config, "n_neurons");
+    int depth = utils::get_int_from_json(config, "n_hidden_layers");
+    std::vector<int> sizes = {input_size};
+    for (int i = 0; i < depth; i++) sizes.push_back(width);
+    sizes.push_back(output_size);
+    for (size_t l = 0; l + 1 < sizes.size(); l++) {
+        float std_dev = std::sqrt(2.0f / (sizes[l] + sizes[l + 1]));
+        fill(params, static_cast<long long>(sizes[l]) * sizes[l + 1], std_dev, options, rng);
+    }
+}
+
+bool occupied(const Options& options, int x, int y, int z, std::mt19937& rng) {
+    Vec3f p = (Vec3f(x, y, z) + Vec3f::Constant(0.5f)) / GRID_RESOLUTION - Vec3f::Constant(0.5f);
+    float r = p.norm();
+    bool inside;
+    if (options.structure == "sphere") inside = r < options.radius;
+    else if (options.structure == "shell") inside = std::abs(r - options.radius) < options.thickness / 2;
+    else inside = true;  // scattered
+    return inside && std::uniform_real_distribution<float>(0.0f, 1.0f)(rng) < options.density;
+}
+
+// Camera to world in the NeRF (OpenGL) convention, looking at the origin
+nlohmann::json cameraMatrix(float azimuth, float elevation, float distance) {
+    Vec3f position(distance * std::cos(elevation) * std::cos(azimuth),
+        distance * std::cos(elevation) * std::sin(azimuth), distance * std::sin(elevation));
+    Vec3f back = position.normalized();
+    Vec3f right = Vec3f(0, 0, 1).cross(back).normalized();
+    Vec3f up = back.cross(right);
+    nlohmann::json matrix = nlohmann::json::array();
+    for (int r = 0; r < 3; r++) matrix.push_back({right(r), up(r), back(r), position(r)});
+    matrix.push_back({0.0, 0.0, 0.0, 1.0});
+    return matrix;
+}
+
+void appendHalf(nlohmann::json::binary_t& out, float value) {
+    uint32_t h = utils::from_float_to_int16(value);
+    out.push_back(h & 0xFF);
+    out.push_back(h >> 8);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--name" && i + 1 < argc) options.name = argv[++i];
+        else if (arg == "--out" && i + 1 < argc) options.out = argv[++i];
+        else if (arg == "--config" && i + 1 < argc) options.config_path = argv[++i];
+        else if (arg == "--seed" && i + 1 < argc) options.seed = std::stoul(argv[++i]);
+        else if (arg == "--structure" && i + 1 < argc) options.structure = argv[++i];
+        else if (arg == "--radius" && i + 1 < argc) options.radius = std::stof(argv[++i]);
+        else if (arg == "--thickness" && i + 1 < argc) options.thickness = std::stof(argv[++i]);
+        else if (arg == "--density" && i + 1 < argc) options.density = std::stof(argv[++i]);
+        else if (arg == "--weights" && i + 1 < argc) options.weights = argv[++i];
+        else if (arg == "--hash-std" && i + 1 < argc) options.hash_std = std::stof(argv[++i]);
+        else if (arg == "--views" && i + 1 < argc) options.views = std::stoi(argv[++i]);
+        else if (arg == "--distance" && i + 1 < argc) options.distance = std::stof(argv[++i]);
+        else if (arg == "--elevation" && i + 1 < argc) options.elevation_deg = std::stof(argv[++i]);
+        else {
+            printf("Unknown argument [%s]\n", arg.c_str());
+            exit(1);
+        }
+    }
+    if (options.structure != "sphere" && options.structure != "shell" && options.structure != "scattered") {
+        printf("Unknown structure [%s], expected sphere, shell or scattered\n", options.structure.c_str());
+        exit(1);
+    }
+    if (options.weights != "random" && options.weights != "procedural") {
+        printf("Unknown weights [%s], expected random or procedural\n", options.weights.c_str());
+        exit(1);
+    }
+    if (options.density < 0.0f || options.density > 1.0f || options.views < 1) {
+        puts("Error: density must be in [0, 1] and views at least 1");
+        exit(1);
+    }
+
+    nlohmann::json configs;
+    std::ifstream fin(options.config_path);
+    if (!fin) {
+        printf("Cannot open configs [%s]\n", options.config_path.c_str());
+        exit(1);
+    }
+    fin >> configs;
+    std::mt19937 rng(options.seed);
+
+    // Parameters in the order Simulator::loadParameters splits them
+    std::vector<float> params;
+    fillMLP(params, 32, 16, configs.at("network"), options, rng);
+    fillMLP(params, 32, 16, configs.at("rgb_network"), options, rng);
+    long long mlp_params = params.size();
+    long long hash_params = HashEncoding(configs.at("encoding")).getNumParams();
+    fill(params, hash_params, options.hash_std, options, rng);
+    long long expected = MLP(32, 16, configs.at("network")).getNumParams() +
+        MLP(32, 16, configs.at("rgb_network")).getNumParams();
+    if (mlp_params != expected) {
+        puts("Error: MLP layout does not match the configs");
+        exit(1);
+    }
+    nlohmann::json::binary_t params_binary;
+    params_binary.reserve(params.size() * 2);
+    for (float p : params) appendHalf(params_binary, p);
+
+    // Density grid in Morton order, 1 for an occupied cell
+    const int cells = GRID_RESOLUTION * GRID_RESOLUTION * GRID_RESOLUTION;
+    std::vector<uint8_t> grid(cells);
+    long long num_occupied = 0;
+    for (int x = 0; x < GRID_RESOLUTION; x++) {
+        for (int y = 0; y < GRID_RESOLUTION; y++) {
+            for (int z = 0; z < GRID_RESOLUTION; z++) {
+                grid[(x * GRID_RESOLUTION + y) * GRID_RESOLUTION + z] = occupied(options, x, y, z, rng);
+                num_occupied += grid[(x * GRID_RESOLUTION + y) * GRID_RESOLUTION + z];
+            }
+        }
+    }
+    nlohmann::json::binary_t density_binary;
+    density_binary.reserve(cells * 2);
+    for (int i = 0; i < cells; i++) appendHalf(density_binary, grid[utils::inv_morton(i, GRID_RESOLUTION)] ? 1.0f : 0.0f);
+
+    nlohmann::json snapshot;
+    snapshot["snapshot"]["params_binary"] = params_binary;
+    snapshot["snapshot"]["density_grid_binary"] = density_binary;
+    snapshot["synthetic"] = {
+        {"seed", options.seed},
+        {"structure", options.structure},
+        {"radius", options.radius},
+        {"thickness", options.thickness},
+        {"density", options.density},
+        {"weights", options.weights},
+        {"hash_std", options.hash_std}
+    };
+
+    nlohmann::json cameras;
+    cameras["camera_angle_x"] = CAMERA_ANGLE_X;
+    cameras["frames"] = nlohmann::json::array();
+    const float to_radians = 3.14159265f / 180.0f;
+    for (int v = 0; v < options.views; v++) {
+        float azimuth = 2 * 3.14159265f * v / options.views + 90 * to_radians;
+        cameras["frames"].push_back({
+            {"file_path", "./test/r_" + std::to_string(v)},
+            {"transform_matrix", cameraMatrix(azimuth, options.elevation_deg * to_radians, options.distance)}
+        });
+    }
+
+    namespace fs = std::filesystem;
+    fs::path snapshot_dir = fs::path(options.out) / "snapshots" / "Hash19_Float";
+    fs::path scene_dir = fs::path(options.out) / "data" / "nerf_synthetic" / options.name;
+    fs::create_directories(snapshot_dir);
+    fs::create_directories(scene_dir);
+    fs::path snapshot_path = snapshot_dir / (options.name + ".msgpack");
+    fs::path camera_path = scene_dir / "transforms_test.json";
+    std::vector<uint8_t> msgpack = nlohmann::json::to_msgpack(snapshot);
+    std::ofstream fout(snapshot_path, std::ios::binary);
+    fout.write(reinterpret_cast<const char*>(msgpack.data()), msgpack.size());
+    fout.close();
+    fout.open(camera_path);
+    fout << cameras.dump(4) << "\n";
+    fout.close();
+
+    printf("Parameters: %lld MLP + %lld hash grid\n", mlp_params, hash_params);
+    printf("Occupancy: %s, %lld / %d cells (%.2f%%)\n", options.structure.c_str(),
+        num_occupied, cells, 100.0 * num_occupied / cells);
+    printf("Snapshot written to [%s]\n", snapshot_path.c_str());
+    printf("Cameras written to [%s], %d views\n", camera_path.c_str(), options.views);
+    return 0;
+}
@@ -0,0 +1,224 @@
+#include "approx.hpp"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+    constexpr float LOG2E = 1.4426950408889634f;
+    constexpr float LN2 = 0.6931471805599453f;
+
+    // Reference of the reduced function
+    double reference(ApproxFunc func, double x) {
+        return func == ApproxFunc::EXP ? std::exp2(x) : 1.0 / (1.0 + std::exp(-x));
+    }
+
+    // 2^k for an integer exponent in the normal range
+    inline float pow2i(int k) {
+        uint32_t bits = static_cast<uint32_t>(k + 127) << 23;
+        float f;
+        std::memcpy(&f, &bits, 4);
+        return f;
+    }
+}
+
+ApproxUnit::ApproxUnit(ApproxFunc func, ApproxKind kind, int size, int bits, int latency):
+    func(func), kind(kind), size(size), bits(bits), latency(latency), step(std::ldexp(1.0f, -bits)) {
+    double domain = func == ApproxFunc::EXP ? 1.0 : SIGMOID_RANGE;
+    if (kind == ApproxKind::LUT) {
+        table.resize(size + 1);
+        for (int i = 0; i <= size; i++) {
+            table[i] = quantize(static_cast<float>(reference(func, domain * i / size)));
+        }
+    }
+    else if (kind == ApproxKind::PWL) {
+        slope.resize(size);
+        intercept.resize(size);
+        for (int i = 0; i < size; i++) {
+            double a = domain * i / size, b = domain * (i + 1) / size;
+            double m = (reference(func, b) - reference(func, a)) / (b - a);
+            double c = reference(func, a) - m * a;
+            // Center the error of the secant so that it is minimax on the segment
+            double e_min = 0.0, e_max = 0.0;
+            for (int s = 0; s <= 32; s++) {
+                double x = a + (b - a) * s / 32;
+                double e = reference(func, x) - (m * x + c);
+                e_min = std::min(e_min, e);
+                e_max = std::max(e_max, e);
+            }
+            slope[i] = quantize(static_cast<float>(m));
+            intercept[i] = quantize(static_cast<float>(c + (e_min + e_max) / 2));
+        }
+    }
+    else if (kind == ApproxKind::CORDIC) {
+        // Hyperbolic CORDIC repeats iterations 4, 13, 40, ... to converge
+        double gain = 1.0;
+        for (int i = 1, repeat = 4; static_cast<int>(shifts.size()) < size; i++) {
+            shifts.push_back(i);
+            if (i == repeat && static_cast<int>(shifts.size()) < size) {
+                shifts.push_back(i);
+                repeat = 3 * repeat + 1;
+            }
+        }
+        for (int s : shifts) {
+            double p = std::ldexp(1.0, -s);
+            atanh_table.push_back(quantize(static_cast<float>(std::atanh(p))));
+            gain *= std::sqrt(1.0 - p * p);
+        }
+        cordic_gain = quantize(static_cast<float>(1.0 / gain));
+    }
+    measureError();
+}
+
+bool ApproxUnit::parse(const std::string& text, ApproxFunc func, ApproxUnit& out) {
+    if (text == "exact") {
+        out = ApproxUnit(func);
+        return true;
+    }
+    char kind_name[16];
+    int size, bits, latency;
+    if (sscanf(text.c_str(), "%15[a-z]:%d:%d:%d", kind_name, &size, &bits, &latency) != 4 ||
+        size <= 0 || bits <= 0 || bits > 23 || latency < 0) {
+        return false;
+    }
+    std::string kind = kind_name;
+    if (kind == "lut") out = ApproxUnit(func, ApproxKind::LUT, size, bits, latency);
+    else if (kind == "pwl") out = ApproxUnit(func, ApproxKind::PWL, size, bits, latency);
+    else if (kind == "cordic") out = ApproxUnit(func, ApproxKind::CORDIC, size, bits, latency);
+    else return false;
+    return true;
+}
+
+float ApproxUnit::quantize(float x) const {
+    return std::nearbyint(x / step) * step;
+}
+
+float ApproxUnit::reduced(float x) const {
+    const float domain = func == ApproxFunc::EXP ? 1.0f : SIGMOID_RANGE;
+    float pos = x * (size / domain);
+    int i = std::min(static_cast<int>(pos), size - 1);
+    if (kind == ApproxKind::LUT) {
+        float w = quantize(pos - i);
+        return quantize(table[i] + w * (table[i + 1] - table[i]));
+    }
+    return quantize(slope[i] * x + intercept[i]);
+}
+
+float ApproxUnit::cordicExp(float r) const {
+    // Rotation mode: x + y converges to exp(r) for |r| < 1.118
+    float x = cordic_gain, y = 0.0f, z = r;
+    for (size_t i = 0; i < shifts.size(); i++) {
+        float p = std::ldexp(1.0f, -shifts[i]);
+        float d = z >= 0.0f ? 1.0f : -1.0f;
+        float xn = quantize(x + d * y * p);
+        float yn = quantize(y + d * x * p);
+        z = quantize(z - d * atanh_table[i]);
+        x = xn;
+        y = yn;
+    }
+    return x + y;
+}
+
+float ApproxUnit::operator()(float x) const {
+    if (kind == ApproxKind::EXACT) {
+        return func == ApproxFunc::EXP ? std::exp(x) : 1.0f / (1.0f + std::exp(-x));
+    }
+    if (func == ApproxFunc::EXP) {
+        float t = std::min(std::max(x * LOG2E, -126.0f), 127.0f);
+        float k = std::floor(t);
+        float f = t - k;
+        float mantissa = kind == ApproxKind::CORDIC ? cordicExp(f * LN2) : reduced(f);
+        return mantissa * pow2i(static_cast<int>(k));
+    }
+    float a = std::fabs(x);
+    float s;
+    if (a >= SIGMOID_RANGE) {
+        s = 1.0f;
+    }
+    else if (kind == ApproxKind::CORDIC) {
+        // exp(-a) by CORDIC, then a divider
+        float t = -a * LOG2E;
+        float k = std::floor(t);
+        float e = cordicExp((t - k) * LN2) * pow2i(static_cast<int>(k));
+        s = quantize(1.0f / (1.0f + e));
+    }
+    else {
+        s = reduced(a);
+    }
+    return x < 0.0f ? 1.0f - s : s;
+}
+
+// Scalar on purpose: table indices, segment selection and the CORDIC
+// directions depend on each value, so the loop does not vectorize
+void ApproxUnit::apply(float* values, int n) const {
+    for (int i = 0; i < n; i++) {
+        values[i] = (*this)(values[i]);
+    }
+}
+
+void ApproxUnit::measureError() {
+    // Relative error for exp over the range seen in volume rendering,
+    // absolute error for sigmoid
+    const int POINTS = 4096;
+    double lo = func == ApproxFunc::EXP ? -20.0 : -10.0;
+    double hi = func == ApproxFunc::EXP ? 4.0 : 10.0;
+    max_error = 0.0;
+    mean_error = 0.0;
+    for (int i = 0; i <= POINTS; i++) {
+        double x = lo + (hi - lo) * i / POINTS;
+        double ref = func == ApproxFunc::EXP ? std::exp(x) : 1.0 / (1.0 + std::exp(-x));
+        double e = std::fabs((*this)(static_cast<float>(x)) - ref);
+        if (func == ApproxFunc::EXP) e /= ref;
+        max_error = std::max(max_error, e);
+        mean_error += e;
+    }
+    mean_error /= POINTS + 1;
+}
+
+std::string ApproxUnit::name() const {
+    std::string params = ":" + std::to_string(size) + ":" + std::to_string(bits) + ":" + std::to_string(latency);
+    switch (kind) {
+        case ApproxKind::LUT: return "lut" + params;
+        case ApproxKind::PWL: return "pwl" + params;
+        case ApproxKind::CORDIC: return "cordic" + params;
+        default: return "exact";
+    }
+}
+
+int ApproxUnit::romBits() const {
+    int word = bits + 2;
+    switch (kind) {
+        case ApproxKind::LUT: return (size + 1) * word;
+        case ApproxKind::PWL: return 2 * size * word;
+        case ApproxKind::CORDIC: return size * word;
+        default: return 0;
+    }
+}
+
+int ApproxUnit::adders() const {
+    // Range reduction for exp, reflection for sigmoid
+    int common = 1;
+    switch (kind) {
+        case ApproxKind::LUT: return common + 2;
+        case ApproxKind::PWL: return common + 1;
+        case ApproxKind::CORDIC: return common + 3 * size + 1 + (func == ApproxFunc::SIGMOID ? 1 : 0);
+        default: return 0;
+    }
+}
+
+int ApproxUnit::multipliers() const {
+    if (kind == ApproxKind::EXACT) return 0;
+    int reduce = func == ApproxFunc::EXP ? 1 : 0;
+    switch (kind) {
+        case ApproxKind::LUT: return reduce + 1;
+        case ApproxKind::PWL: return reduce + 1;
+        // A divider costs about two multipliers
+        default: return reduce + (func == ApproxFunc::SIGMOID ? 3 : 0);
+    }
+}
+
+double ApproxUnit::areaGE() const {
+    int word = bits + 2;
+    return 0.5 * romBits() + 6.0 * word * adders() + 5.0 * word * word * multipliers();
+}
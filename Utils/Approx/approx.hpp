@@ -0,0 +1,78 @@
+#ifndef APPROX_HPP_
+#define APPROX_HPP_
+
+#include <string>
+#include <vector>
+
+// Hardware approximations of the transcendental functions in volume rendering.
+// exp is range-reduced to 2^k * 2^f with f in [0, 1), so tables only cover 2^f.
+// sigmoid uses its symmetry and tables cover [0, SIGMOID_RANGE).
+enum class ApproxFunc {
+    EXP,
+    SIGMOID
+};
+
+enum class ApproxKind {
+    EXACT,   // libm
+    LUT,     // Table of samples, linear interpolation between neighbours
+    PWL,     // Uniform segments of slope/intercept pairs fitted for minimax error
+    CORDIC   // Hyperbolic CORDIC, size is the number of iterations
+};
+
+class ApproxUnit {
+public:
+    ApproxUnit() = default;
+    explicit ApproxUnit(ApproxFunc func): func(func) {}
+    // size: table entries / segments / iterations, bits: fractional bits of
+    // the stored values and the datapath, latency: extra cycles per evaluation
+    ApproxUnit(ApproxFunc func, ApproxKind kind, int size, int bits, int latency);
+
+    // "exact", "lut:<size>:<bits>:<latency>", "pwl:...", "cordic:<iterations>:<bits>:<latency>"
+    static bool parse(const std::string& text, ApproxFunc func, ApproxUnit& out);
+
+    float operator()(float x) const;
+    void apply(float* values, int n) const;
+
+    bool isExact() const {
+        return kind == ApproxKind::EXACT;
+    }
+    int getLatency() const {
+        return latency;
+    }
+    std::string name() const;
+    // Area proxy: ROM bits, adders and multipliers of the unrolled datapath,
+    // combined into gate equivalents with rough per-bit costs
+    int romBits() const;
+    int adders() const;
+    int multipliers() const;
+    double areaGE() const;
+    // Error measured over the function's working range at construction
+    double getMaxError() const {
+        return max_error;
+    }
+    double getMeanError() const {
+        return mean_error;
+    }
+
+    static constexpr float SIGMOID_RANGE = 8.0f;
+
+private:
+    ApproxFunc func = ApproxFunc::EXP;
+    ApproxKind kind = ApproxKind::EXACT;
+    int size = 0, bits = 0, latency = 0;
+    float step = 1.0f;  // 2^-bits
+    std::vector<float> table;                  // LUT samples
+    std::vector<float> slope, intercept;       // PWL segments
+    std::vector<float> atanh_table;            // CORDIC angles
+    std::vector<int> shifts;                   // CORDIC shift sequence
+    float cordic_gain = 1.0f;
+    double max_error = 0.0, mean_error = 0.0;
+
+    // Approximations of the reduced functions: 2^f for f in [0, 1), sigmoid for x in [0, range)
+    float reduced(float x) const;
+    float cordicExp(float r) const;
+    float quantize(float x) const;
+    void measureError();
+};
+
+#endif // APPROX_HPP_
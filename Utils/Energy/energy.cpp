@@ -0,0 +1,55 @@
+#include "energy.hpp"
+#include <cstdio>
+#include <fstream>
+
+bool EnergyTable::load(const std::string& path, EnergyTable& table) {
+    std::ifstream fin(path);
+    if (!fin) {
+        printf("Cannot open energy table [%s]\n", path.c_str());
+        return false;
+    }
+    nlohmann::json configs;
+    try {
+        fin >> configs;
+    }
+    catch (const nlohmann::json::exception& e) {
+        printf("Cannot parse energy table [%s]: %s\n", path.c_str(), e.what());
+        return false;
+    }
+    nlohmann::json defaults = table.toJson();
+    for (auto& item : configs.items()) {
+        if (!defaults.contains(item.key()) || !item.value().is_number()) {
+            printf("Unknown energy table entry [%s]\n", item.key().c_str());
+            return false;
+        }
+        defaults[item.key()] = item.value();
+    }
+    table.hash_read_byte = defaults["hash_read_byte"];
+    table.weight_read_byte = defaults["weight_read_byte"];
+    table.fifo_byte = defaults["fifo_byte"];
+    table.framebuffer_write_byte = defaults["framebuffer_write_byte"];
+    table.occupancy_read = defaults["occupancy_read"];
+    table.mac = defaults["mac"];
+    table.sh_evaluation = defaults["sh_evaluation"];
+    table.exp = defaults["exp"];
+    table.sigmoid = defaults["sigmoid"];
+    table.value_bytes = defaults["value_bytes"];
+    table.header_bytes = defaults["header_bytes"];
+    return true;
+}
+
+nlohmann::json EnergyTable::toJson() const {
+    return {
+        {"hash_read_byte", hash_read_byte},
+        {"weight_read_byte", weight_read_byte},
+        {"fifo_byte", fifo_byte},
+        {"framebuffer_write_byte", framebuffer_write_byte},
+        {"occupancy_read", occupancy_read},
+        {"mac", mac},
+        {"sh_evaluation", sh_evaluation},
+        {"exp", exp},
+        {"sigmoid", sigmoid},
+        {"value_bytes", value_bytes},
+        {"header_bytes", header_bytes}
+    };
+}
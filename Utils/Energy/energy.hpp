@@ -0,0 +1,26 @@
+#ifndef ENERGY_HPP_
+#define ENERGY_HPP_
+
+#include <string>
+#include <nlohmann/json.hpp>
+
+// Energy of one operation in pJ. The defaults are rough 45 nm figures for
+// an fp16 datapath; a JSON table with any subset of the keys overrides them.
+struct EnergyTable {
+    double hash_read_byte = 1.25;         // Hash table SRAM, banks of a few hundred KB
+    double weight_read_byte = 0.6;        // MLP weight buffers, small SRAM
+    double fifo_byte = 0.1;               // Pipeline registers and FIFOs
+    double framebuffer_write_byte = 1.5;
+    double occupancy_read = 0.5;          // One occupancy bit
+    double mac = 1.5;                     // fp16 multiply-accumulate
+    double sh_evaluation = 40.0;          // Degree 4 SH basis of one direction
+    double exp = 4.0;
+    double sigmoid = 5.0;
+    int value_bytes = 2;                  // Datapath values moved between stages
+    int header_bytes = 4;                 // Ray slot and tag of a FIFO entry
+
+    static bool load(const std::string& path, EnergyTable& table);
+    nlohmann::json toJson() const;
+};
+
+#endif // ENERGY_HPP_
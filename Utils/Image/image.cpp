@@ -1,9 +1,14 @@
 // It's for stb image write
 #define STB_IMAGE_WRITE_IMPLEMENTATION
+#define STB_IMAGE_IMPLEMENTATION
 
 #include "image.hpp"
 
+#include <cctype>
+#include <cstring>
+
 #include <stb_image_write.h>
+#include <stb_image.h>
 
 void Image::writeImgToFile(const std::string& file_name){
     std::vector<uint8_t> rgb_data(resolution.x() * resolution.y() * 3);
@@ -15,4 +20,135 @@ void Image::writeImgToFile(const std::string& file_name){
 
 	stbi_flip_vertically_on_write(true);
 	stbi_write_png(file_name.c_str(), resolution.x(), resolution.y(), 3, rgb_data.data(), 0);
-}
\ No newline at end of file
+}
+
+bool Image::writeFloatToFile(const std::string& file_name, bool pfm) const{
+	static_assert(sizeof(Color) == 3 * sizeof(float), "Color must be packed floats");
+	return writeFloatImage(file_name, data.data()->data(), resolution.x(), resolution.y(), 3, pfm);
+}
+
+bool writeFloatImage(const std::string& file_name, const float* data, int w, int h, int channels, bool pfm){
+	FILE* file = fopen(file_name.c_str(), "wb");
+	if (file == nullptr) {
+		printf("Cannot open [%s] for writing\n", file_name.c_str());
+		return false;
+	}
+	// Negative scale: little endian
+	if (pfm) fprintf(file, "%s\n%d %d\n-1.0\n", channels == 3 ? "PF" : "Pf", w, h);
+	fwrite(data, sizeof(float), static_cast<size_t>(w) * h * channels, file);
+	fclose(file);
+	return true;
+}
+
+bool Image::readImgFromFile(const std::string& file_name){
+	int w, h, c;
+	// Same row order as writeImgToFile, only for this thread and this load
+	stbi_set_flip_vertically_on_load_thread(true);
+	uint8_t* raw = stbi_load(file_name.c_str(), &w, &h, &c, 4);
+	stbi_set_flip_vertically_on_load_thread(false);
+	if (raw == nullptr) {
+		printf("Cannot read image [%s]\n", file_name.c_str());
+		return false;
+	}
+	if (w != resolution.x() || h != resolution.y()) {
+		printf("Image [%s] is %dx%d, expect %dx%d\n", file_name.c_str(), w, h, resolution.x(), resolution.y());
+		stbi_image_free(raw);
+		return false;
+	}
+	for (size_t i = 0; i < data.size(); i++) {
+		float alpha = raw[4 * i + 3] / 255.f;
+		data[i] = Color(raw[4 * i], raw[4 * i + 1], raw[4 * i + 2]) / 255.f * alpha;
+	}
+	stbi_image_free(raw);
+	return true;
+}
+
+bool StreamImageWriter::open(const std::string& file_name, int w, int h, bool keep){
+	close();
+	char header[64];
+	header_size = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", w, h);
+	long total = header_size + 3L * w * h;
+	resolution = Vec2i(w, h);
+	if (keep) {
+		// Blocks written before stay, the file must be the same image
+		file = fopen(file_name.c_str(), "r+b");
+		char existing[64] = {0};
+		if (file == nullptr || fread(existing, 1, header_size, file) != static_cast<size_t>(header_size) ||
+			std::memcmp(existing, header, header_size) != 0 || fseek(file, 0, SEEK_END) != 0 || ftell(file) != total) {
+			printf("Cannot continue writing [%s] as a %dx%d PPM\n", file_name.c_str(), w, h);
+			close();
+			return false;
+		}
+		return true;
+	}
+	file = fopen(file_name.c_str(), "wb");
+	if (file == nullptr) {
+		printf("Cannot open [%s] for writing\n", file_name.c_str());
+		return false;
+	}
+	fwrite(header, 1, header_size, file);
+	// Size the file up front so blocks can land in any order
+	fseek(file, total - 1, SEEK_SET);
+	fputc(0, file);
+	return true;
+}
+
+void StreamImageWriter::writeBlock(int col, int row, int cols, int rows, const std::vector<Image::Color>& block){
+	if (file == nullptr) return;
+	row_buffer.resize(3 * cols);
+	for (int r = 0; r < rows; r++) {
+		for (int c = 0; c < cols; c++) {
+			const Image::Color& color = block[r * cols + c];
+			row_buffer[3 * c] = utils::trans(color.x());
+			row_buffer[3 * c + 1] = utils::trans(color.y());
+			row_buffer[3 * c + 2] = utils::trans(color.z());
+		}
+		fseek(file, header_size + 3L * ((row + r) * static_cast<long>(resolution.x()) + col), SEEK_SET);
+		fwrite(row_buffer.data(), 1, row_buffer.size(), file);
+	}
+}
+
+void StreamImageWriter::close(){
+	if (file != nullptr) {
+		fclose(file);
+		file = nullptr;
+	}
+}
+
+bool StreamImageReader::open(const std::string& file_name){
+	close();
+	file = fopen(file_name.c_str(), "rb");
+	if (file == nullptr) return false;
+	int w, h, max_value;
+	// A single whitespace separates the header from the pixels
+	if (fscanf(file, "P6 %d %d %d", &w, &h, &max_value) != 3 || max_value != 255 || w <= 0 || h <= 0 ||
+		!isspace(fgetc(file))) {
+		printf("[%s] is not an 8 bit binary PPM\n", file_name.c_str());
+		close();
+		return false;
+	}
+	resolution = Vec2i(w, h);
+	header_size = ftell(file);
+	return true;
+}
+
+bool StreamImageReader::readBlock(int col, int row, int cols, int rows, std::vector<Image::Color>& block){
+	if (file == nullptr) return false;
+	row_buffer.resize(3 * cols);
+	block.resize(static_cast<size_t>(cols) * rows);
+	for (int r = 0; r < rows; r++) {
+		fseek(file, header_size + 3L * ((row + r) * static_cast<long>(resolution.x()) + col), SEEK_SET);
+		if (fread(row_buffer.data(), 1, row_buffer.size(), file) != row_buffer.size()) return false;
+		for (int c = 0; c < cols; c++) {
+			block[r * cols + c] = Image::Color(row_buffer[3 * c], row_buffer[3 * c + 1], row_buffer[3 * c + 2]) / 255.f;
+		}
+	}
+	return true;
+}
+
+void StreamImageReader::close(){
+	if (file != nullptr) {
+		fclose(file);
+		file = nullptr;
+	}
+}
@@ -10,8 +10,9 @@ public:
     using Color = Vec3f;
     
     Image() = delete;
-    Image(int w, int h): resolution(w, h){
-        data.resize(w * h);
+    // Without allocate only the resolution is kept, e.g. for streamed output
+    Image(int w, int h, bool allocate = true): resolution(w, h){
+        if (allocate) data.resize(w * h);
     }
     [[nodiscard]] float getAspectRatio() const{
         return static_cast<float>(resolution.x()) / static_cast<float>(resolution.y());
@@ -25,10 +26,75 @@ public:
     void setPixel(int x, int y, const Vec3f& value){
         data[x + resolution.x() * y] = value;
     }
+    [[nodiscard]] const std::vector<Color>& getData() const{
+        return data;
+    }
+    void setData(const std::vector<Color>& pixels){
+        data = pixels;
+    }
+    void clear(){
+        data.assign(data.size(), Color::Zero());
+    }
     void writeImgToFile(const std::string& file_name);
+    // The float framebuffer as is, PFM or headerless float32
+    bool writeFloatToFile(const std::string& file_name, bool pfm = true) const;
+    // Read an RGBA image and composite it onto a black background.
+    bool readImgFromFile(const std::string& file_name);
 private:
     std::vector<Color> data;
     Vec2i resolution;
 };
 
+// w x h pixels of `channels` floats (1 or 3), bottom row first. PFM keeps the
+// rows in that order, raw writes the bytes with no header.
+bool writeFloatImage(const std::string& file_name, const float* data, int w, int h, int channels, bool pfm = true);
+
+// Binary PPM written block by block, so the whole frame never has to be in memory.
+// Coordinates are the file's: row 0 is the top row.
+class StreamImageWriter{
+public:
+    StreamImageWriter() = default;
+    StreamImageWriter(const StreamImageWriter&) = delete;
+    StreamImageWriter& operator=(const StreamImageWriter&) = delete;
+    ~StreamImageWriter(){
+        close();
+    }
+    // keep continues a file written before, e.g. when resuming a checkpoint
+    bool open(const std::string& file_name, int w, int h, bool keep = false);
+    // cols x rows block at (col, row), row-major
+    void writeBlock(int col, int row, int cols, int rows, const std::vector<Image::Color>& block);
+    void close();
+private:
+    FILE* file = nullptr;
+    long header_size = 0;
+    Vec2i resolution;
+    std::vector<uint8_t> row_buffer;
+};
+
+// Binary PPM read block by block, the counterpart of StreamImageWriter
+class StreamImageReader{
+public:
+    StreamImageReader() = default;
+    StreamImageReader(const StreamImageReader&) = delete;
+    StreamImageReader& operator=(const StreamImageReader&) = delete;
+    ~StreamImageReader(){
+        close();
+    }
+    bool open(const std::string& file_name);
+    bool isOpen() const{
+        return file != nullptr;
+    }
+    [[nodiscard]] Vec2i getResolution() const{
+        return resolution;
+    }
+    // cols x rows block at (col, row), row-major, scaled to [0, 1]
+    bool readBlock(int col, int row, int cols, int rows, std::vector<Image::Color>& block);
+    void close();
+private:
+    FILE* file = nullptr;
+    long header_size = 0;
+    Vec2i resolution;
+    std::vector<uint8_t> row_buffer;
+};
+
 #endif // IMAGE_HPP_
\ No newline at end of file
@@ -0,0 +1,103 @@
+#include "metrics.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    constexpr int SSIM_WIN = 7;
+    constexpr float SSIM_K1 = 0.01f, SSIM_K2 = 0.03f;
+
+    // Split an image into planar channels so that reductions run on contiguous floats.
+    std::vector<float> toPlanar(const Image& img, bool quantize) {
+        const std::vector<Image::Color>& data = img.getData();
+        int n = data.size();
+        std::vector<float> planar(3 * n);
+        const float* src = data[0].data();
+        #pragma omp parallel for
+        for (int i = 0; i < n; i++) {
+            for (int c = 0; c < 3; c++) {
+                float v = src[3 * i + c];
+                planar[c * n + i] = quantize ? utils::trans(v) / 255.f : v;
+            }
+        }
+        return planar;
+    }
+}
+
+float metrics::psnrFromMSE(double mse) {
+    if (mse <= 0.0) return MAX_PSNR;
+    return std::min(MAX_PSNR, static_cast<float>(10.0 * std::log10(1.0 / mse)));
+}
+
+float metrics::computePSNR(const Image& test, const Image& ref) {
+    std::vector<float> x = toPlanar(test, true), y = toPlanar(ref, false);
+    const float* px = x.data();
+    const float* py = y.data();
+    int n = x.size();
+    double sum = 0.0;
+    #pragma omp parallel for simd reduction(+:sum)
+    for (int i = 0; i < n; i++) {
+        float d = px[i] - py[i];
+        sum += d * d;
+    }
+    return psnrFromMSE(sum / n);
+}
+
+float metrics::computeSSIM(const Image& test, const Image& ref) {
+    int w = test.getResolution().x(), h = test.getResolution().y(), n = w * h;
+    if (w < SSIM_WIN || h < SSIM_WIN) return 0.0f;
+    std::vector<float> x = toPlanar(test, true), y = toPlanar(ref, false);
+
+    const float C1 = SSIM_K1 * SSIM_K1, C2 = SSIM_K2 * SSIM_K2;
+    const float inv_np = 1.0f / (SSIM_WIN * SSIM_WIN);
+    const float cov_norm = static_cast<float>(SSIM_WIN * SSIM_WIN) / (SSIM_WIN * SSIM_WIN - 1);
+    // skimage crops (win - 1) / 2 pixels at each border before averaging,
+    // so only windows fully inside the image contribute.
+    int out_w = w - SSIM_WIN + 1, out_h = h - SSIM_WIN + 1;
+
+    // Horizontal window sums of x, y, xx, yy, xy for every row
+    std::vector<float> hs(5 * out_w * h);
+    double total = 0.0;
+    for (int c = 0; c < 3; c++) {
+        const float* px = x.data() + c * n;
+        const float* py = y.data() + c * n;
+        #pragma omp parallel for
+        for (int r = 0; r < h; r++) {
+            float* out = hs.data() + 5 * out_w * r;
+            const float* rx = px + r * w;
+            const float* ry = py + r * w;
+            for (int j = 0; j < out_w; j++) {
+                float sx = 0, sy = 0, sxx = 0, syy = 0, sxy = 0;
+                for (int k = 0; k < SSIM_WIN; k++) {
+                    float a = rx[j + k], b = ry[j + k];
+                    sx += a; sy += b;
+                    sxx += a * a; syy += b * b; sxy += a * b;
+                }
+                out[j] = sx;
+                out[out_w + j] = sy;
+                out[2 * out_w + j] = sxx;
+                out[3 * out_w + j] = syy;
+                out[4 * out_w + j] = sxy;
+            }
+        }
+        double sum = 0.0;
+        #pragma omp parallel for reduction(+:sum)
+        for (int r = 0; r < out_h; r++) {
+            for (int j = 0; j < out_w; j++) {
+                float s[5] = {0, 0, 0, 0, 0};
+                for (int k = 0; k < SSIM_WIN; k++) {
+                    const float* row = hs.data() + 5 * out_w * (r + k);
+                    for (int q = 0; q < 5; q++) s[q] += row[q * out_w + j];
+                }
+                float ux = s[0] * inv_np, uy = s[1] * inv_np;
+                float vx = cov_norm * (s[2] * inv_np - ux * ux);
+                float vy = cov_norm * (s[3] * inv_np - uy * uy);
+                float vxy = cov_norm * (s[4] * inv_np - ux * uy);
+                float num = (2 * ux * uy + C1) * (2 * vxy + C2);
+                float den = (ux * ux + uy * uy + C1) * (vx + vy + C2);
+                sum += num / den;
+            }
+        }
+        total += sum / (static_cast<double>(out_w) * out_h);
+    }
+    return static_cast<float>(total / 3.0);
+}
@@ -0,0 +1,17 @@
+#ifndef METRICS_HPP_
+#define METRICS_HPP_
+
+#include "image.hpp"
+
+// Image quality metrics, matching skimage's peak_signal_noise_ratio and
+// structural_similarity (7x7 uniform window, data_range = 1) as used by eval.py.
+namespace metrics {
+    // PSNR of identical images, where skimage returns inf
+    constexpr float MAX_PSNR = 100.0f;
+    float psnrFromMSE(double mse);
+    // `test` is quantized to 8 bit first, the same way writeImgToFile does.
+    float computePSNR(const Image& test, const Image& ref);
+    float computeSSIM(const Image& test, const Image& ref);
+}
+
+#endif // METRICS_HPP_
@@ -0,0 +1,203 @@
+#ifndef CHECKPOINT_HPP_
+#define CHECKPOINT_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+#include <Eigen/Core>
+
+// Lists the members of a register or slot for putValue/getValue
+#define CHECKPOINT_FIELDS(...) \
+    auto checkpointFields() { return std::tie(__VA_ARGS__); } \
+    auto checkpointFields() const { return std::tie(__VA_ARGS__); }
+
+namespace checkpoint {
+    template <typename T>
+    constexpr bool isMatrix = std::is_base_of<Eigen::PlainObjectBase<T>, T>::value;
+
+    template <typename T, typename = void>
+    struct HasFields : std::false_type {};
+    template <typename T>
+    struct HasFields<T, std::void_t<decltype(std::declval<T&>().checkpointFields())>> : std::true_type {};
+
+    template <typename T>
+    struct IsVector : std::false_type {};
+    template <typename T>
+    struct IsVector<std::vector<T>> : std::true_type {};
+
+    // Vectors of these are written with one shape for all elements
+    template <typename T, typename = void>
+    struct IsFixedMatrix : std::false_type {};
+    template <typename T>
+    struct IsFixedMatrix<T, std::enable_if_t<isMatrix<T>>>:
+        std::integral_constant<bool, T::SizeAtCompileTime != Eigen::Dynamic> {};
+}
+
+// Binary state of a simulation in progress, in host byte order. put/get copy
+// the bytes of trivially copyable values only. putValue/getValue also take
+// Eigen matrices, written as rows, cols and coefficients, and structs that
+// list their members with CHECKPOINT_FIELDS, and vectors of any of these.
+class CheckpointWriter {
+public:
+    template <typename T>
+    void put(const T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "use putValue() for matrices and registers");
+        append(&value, sizeof(T));
+    }
+    template <typename T>
+    void putValue(const T& value) {
+        if constexpr (checkpoint::isMatrix<T>) {
+            put<int64_t>(value.rows());
+            put<int64_t>(value.cols());
+            append(value.data(), value.size() * sizeof(typename T::Scalar));
+        }
+        else if constexpr (checkpoint::HasFields<T>::value) {
+            std::apply([this](const auto&... fields) { (putValue(fields), ...); }, value.checkpointFields());
+        }
+        else if constexpr (checkpoint::IsVector<T>::value) {
+            putVector(value);
+        }
+        else {
+            put(value);
+        }
+    }
+    template <typename T>
+    void putVector(const std::vector<T>& values) {
+        put<uint64_t>(values.size());
+        if constexpr (checkpoint::IsFixedMatrix<T>::value) {
+            put<int64_t>(T::RowsAtCompileTime);
+            put<int64_t>(T::ColsAtCompileTime);
+            for (const T& value : values) append(value.data(), value.size() * sizeof(typename T::Scalar));
+        }
+        else if constexpr (std::is_trivially_copyable<T>::value) {
+            append(values.data(), values.size() * sizeof(T));
+        }
+        else {
+            for (const T& value : values) putValue(value);
+        }
+    }
+    void putString(const std::string& text) {
+        put<uint64_t>(text.size());
+        append(text.data(), text.size());
+    }
+    std::vector<char> release() {
+        return std::move(bytes);
+    }
+
+private:
+    std::vector<char> bytes;
+
+    void append(const void* data, size_t size) {
+        const char* begin = static_cast<const char*>(data);
+        bytes.insert(bytes.end(), begin, begin + size);
+    }
+};
+
+// Reads what CheckpointWriter wrote in the same order. A read past the end
+// or a failed check marks the reader failed, test ok() once at the end.
+class CheckpointReader {
+public:
+    explicit CheckpointReader(std::vector<char> data): bytes(std::move(data)) {}
+
+    template <typename T>
+    void get(T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "use getValue() for matrices and registers");
+        take(&value, sizeof(T));
+    }
+    // A matrix must have a shape its type can hold
+    template <typename T>
+    void getValue(T& value) {
+        if constexpr (checkpoint::isMatrix<T>) {
+            int64_t rows = -1, cols = -1;
+            get(rows);
+            get(cols);
+            if (failed || !fits<T>(rows, cols)) {
+                failed = true;
+                return;
+            }
+            value.resize(rows, cols);
+            take(value.data(), value.size() * sizeof(typename T::Scalar));
+        }
+        else if constexpr (checkpoint::HasFields<T>::value) {
+            std::apply([this](auto&... fields) { (getValue(fields), ...); }, value.checkpointFields());
+        }
+        else if constexpr (checkpoint::IsVector<T>::value) {
+            getVector(value);
+        }
+        else {
+            get(value);
+        }
+    }
+    template <typename T>
+    void getVector(std::vector<T>& values) {
+        uint64_t size = 0;
+        get(size);
+        // Every element takes at least a byte
+        size_t element = checkpoint::IsFixedMatrix<T>::value || !std::is_trivially_copyable<T>::value ? 1 : sizeof(T);
+        if (failed || size > (bytes.size() - pos) / element) {
+            failed = true;
+            return;
+        }
+        values.resize(size);
+        if constexpr (checkpoint::IsFixedMatrix<T>::value) {
+            int64_t rows = -1, cols = -1;
+            get(rows);
+            get(cols);
+            expect(rows == T::RowsAtCompileTime && cols == T::ColsAtCompileTime);
+            for (T& value : values) take(value.data(), value.size() * sizeof(typename T::Scalar));
+        }
+        else if constexpr (std::is_trivially_copyable<T>::value) {
+            take(values.data(), size * sizeof(T));
+        }
+        else {
+            for (T& value : values) getValue(value);
+        }
+    }
+    void getString(std::string& text) {
+        std::vector<char> chars;
+        getVector(chars);
+        text.assign(chars.begin(), chars.end());
+    }
+    // For values the reader can only check against its own
+    void expect(bool condition) {
+        if (!condition) failed = true;
+    }
+    bool ok() const {
+        return !failed;
+    }
+    bool atEnd() const {
+        return pos == bytes.size();
+    }
+
+private:
+    std::vector<char> bytes;
+    size_t pos = 0;
+    bool failed = false;
+
+    template <typename T>
+    bool fits(int64_t rows, int64_t cols) const {
+        auto fitsDim = [](int64_t n, int fixed, int max) {
+            return n >= 0 && (fixed == Eigen::Dynamic || n == fixed) && (max == Eigen::Dynamic || n <= max);
+        };
+        if (!fitsDim(rows, T::RowsAtCompileTime, T::MaxRowsAtCompileTime) ||
+            !fitsDim(cols, T::ColsAtCompileTime, T::MaxColsAtCompileTime)) {
+            return false;
+        }
+        uint64_t left = (bytes.size() - pos) / sizeof(typename T::Scalar);
+        return rows == 0 || static_cast<uint64_t>(cols) <= left / static_cast<uint64_t>(rows);
+    }
+
+    void take(void* data, size_t size) {
+        if (failed || size > bytes.size() - pos) {
+            failed = true;
+            return;
+        }
+        std::memcpy(data, bytes.data() + pos, size);
+        pos += size;
+    }
+};
+
+#endif // CHECKPOINT_HPP_
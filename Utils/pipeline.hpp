@@ -0,0 +1,135 @@
+#ifndef PIPELINE_HPP_
+#define PIPELINE_HPP_
+
+#include <tuple>
+#include <utility>
+
+#include "utils.hpp"
+
+enum ModuleState {
+    WAIT_FOR_INPUT,
+    DONE_AN_EXECUTION
+};
+
+// What a stage did with its finished output
+enum class Drain {
+    BLOCKED,         // Downstream is full, try again next cycle
+    DONE,            // Take the next input in the same cycle
+    DONE_END_CYCLE   // Take the next input next cycle
+};
+
+// Cycles a stage could not work, the remaining cycles it was busy. Each
+// stage updates its own, on its own cache line for the parallel mode.
+struct alignas(64) StageStalls {
+    long long blocked = 0;   // The finished output could not be drained
+    long long starved = 0;   // No input to take
+};
+
+// A pipeline stage with the simulator's handshake: an execution keeps the
+// stage busy for its latency, then the output is drained downstream before
+// the next input is taken. The Kernel is the data path and is called
+// statically, so a tick inlines into the cycle loop:
+//   void beginCycle()                      every cycle, also while busy
+//   bool fetch(In& input)                  take an input if one is ready
+//   Out run(const In& input, int& cycles)  cycles starts at the latency
+//   Drain drain(FIFO<Out>& out)            pass the output on
+// Counter, state and latency stay with the owner, indexed by stage.
+template <typename In, typename Out, typename Kernel>
+class Stage {
+public:
+    Stage(Kernel kernel, FIFO<Out>& out, int& wait_counter, ModuleState& state, const int& latency, StageStalls& stalls):
+        kernel(kernel), out(out), wait_counter(wait_counter), state(state), latency(latency), stalls(stalls) {}
+
+    inline void tick() {
+        kernel.beginCycle();
+        if (wait_counter > 0) {
+            wait_counter--;
+            return;
+        }
+        if (state == DONE_AN_EXECUTION) {
+            Drain result = kernel.drain(out);
+            if (result != Drain::BLOCKED) state = WAIT_FOR_INPUT;
+            else stalls.blocked++;
+            if (result == Drain::DONE_END_CYCLE) return;
+        }
+        if (state == WAIT_FOR_INPUT) {
+            In input;
+            if (kernel.fetch(input)) {
+                int cycles = latency;
+                out.write(kernel.run(input, cycles));
+                wait_counter = cycles - 1;
+                state = DONE_AN_EXECUTION;
+            }
+            else stalls.starved++;
+        }
+    }
+
+private:
+    Kernel kernel;
+    FIFO<Out>& out;
+    int& wait_counter;
+    ModuleState& state;
+    const int& latency;
+    StageStalls& stalls;
+};
+
+// Drain helper: move the head of a stage's output FIFO into the next input FIFO
+template <typename Out, typename Next, typename Convert>
+inline Drain forward(FIFO<Out>& out, FIFO<Next>& next, Convert convert) {
+    if (!next.isFull() && !out.isEmpty()) {
+        next.write(convert(out.read()));
+        return Drain::DONE;
+    }
+    return Drain::BLOCKED;
+}
+
+// A stage with its own handshake, written as a member function of Owner
+template <typename Owner, void (Owner::*Step)()>
+struct MemberStage {
+    Owner* owner;
+    inline void tick() { (owner->*Step)(); }
+};
+
+// Stages ticked in a fixed order every cycle. The visitor is called as
+// visit(index, step) for each stage, e.g. to time it, and must call step().
+template <typename... Stages>
+class Pipeline {
+public:
+    static constexpr int size = sizeof...(Stages);
+
+    explicit Pipeline(Stages&... stages): stages(&stages...) {}
+
+    template <typename Visit>
+    inline void tick(Visit&& visit) {
+        tickAll(visit, std::index_sequence_for<Stages...>());
+    }
+    // A single stage, for stages that run on their own
+    template <int I>
+    inline void tickStage() {
+        std::get<I>(stages)->tick();
+    }
+
+private:
+    std::tuple<Stages*...> stages;
+
+    template <typename Visit, size_t... I>
+    inline void tickAll(Visit& visit, std::index_sequence<I...>) {
+        (visit(static_cast<int>(I), [this] { std::get<I>(stages)->tick(); }), ...);
+    }
+};
+
+// FIFOs of a pipeline, reset together
+template <typename... Ts>
+class FifoGroup {
+public:
+    explicit FifoGroup(FIFO<Ts>&... fifos): fifos(&fifos...) {}
+
+    void reset() {
+        std::apply([](FIFO<Ts>*... fifo) { (fifo->reset(), ...); }, fifos);
+    }
+
+private:
+    std::tuple<FIFO<Ts>*...> fifos;
+};
+
+#endif // PIPELINE_HPP_
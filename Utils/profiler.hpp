@@ -0,0 +1,92 @@
+#ifndef PROFILER_HPP_
+#define PROFILER_HPP_
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+
+// Host-side self profiling: accumulated wall time and call count per section.
+// Coarse sections are always timed, fine (per-cycle) sections only when
+// fine timing is enabled, so the default cycle loop pays a single branch.
+class Profiler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit Profiler(const std::vector<std::string>& names): sections(names.size()) {
+        for (size_t i = 0; i < names.size(); i++) {
+            sections[i].name = names[i];
+        }
+    }
+
+    class ScopedTimer {
+    public:
+        ScopedTimer(Profiler& profiler, int id): profiler(profiler), id(id), start(Clock::now()) {}
+        ~ScopedTimer() {
+            profiler.addTime(id, std::chrono::duration<double>(Clock::now() - start).count());
+        }
+    private:
+        Profiler& profiler;
+        int id;
+        Clock::time_point start;
+    };
+
+    void addTime(int id, double seconds) {
+        sections[id].seconds += seconds;
+        sections[id].calls++;
+    }
+    // Time a per-cycle call only if fine timing is enabled
+    template <typename Func>
+    void timeFine(int id, Func&& func) {
+        if (!fine_timing) {
+            func();
+            return;
+        }
+        Clock::time_point start = Clock::now();
+        func();
+        addTime(id, std::chrono::duration<double>(Clock::now() - start).count());
+    }
+
+    void setFineTiming(bool enable) {
+        fine_timing = enable;
+    }
+    bool isFineTiming() const {
+        return fine_timing;
+    }
+    double getSeconds(int id) const {
+        return sections[id].seconds;
+    }
+    void reset() {
+        for (auto& section: sections) {
+            section.seconds = 0.0;
+            section.calls = 0;
+        }
+    }
+
+    void print() const {
+        for (const auto& section: sections) {
+            if (section.calls == 0) continue;
+            printf("  %-18s %10.3f s  %12lld calls\n", section.name.c_str(), section.seconds, section.calls);
+        }
+    }
+    nlohmann::json toJson() const {
+        nlohmann::json out = nlohmann::json::object();
+        for (const auto& section: sections) {
+            if (section.calls == 0) continue;
+            out[section.name] = {{"seconds", section.seconds}, {"calls", section.calls}};
+        }
+        return out;
+    }
+
+private:
+    struct Section {
+        std::string name;
+        double seconds = 0.0;
+        long long calls = 0;
+    };
+    std::vector<Section> sections;
+    bool fine_timing = false;
+};
+
+#endif // PROFILER_HPP_
@@ -0,0 +1,125 @@
+#ifndef QUANT_HPP_
+#define QUANT_HPP_
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <Eigen/Core>
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+// Numeric format emulation for the quantized datapath. Values stay fp32 on
+// the host but are rounded to what the target format can represent.
+enum class NumFormat {
+    FP32,
+    FP16,
+    BF16,
+    INT8,
+    INT16
+};
+
+namespace quant {
+    static inline float roundFP16(float x) {
+#if defined(__F16C__)
+        return _cvtsh_ss(_cvtss_sh(x, _MM_FROUND_TO_NEAREST_INT));
+#else
+        // Round to nearest even on the fp16 mantissa, with fp16 range and subnormals
+        float a = std::fabs(x);
+        if (!(a < 65520.0f)) return std::isnan(x) ? x : std::copysign(INFINITY, x);
+        if (a < 6.103515625e-05f) {
+            // Subnormal: fixed step of 2^-24
+            return std::copysign(std::nearbyint(a * 16777216.0f) / 16777216.0f, x);
+        }
+        uint32_t u;
+        std::memcpy(&u, &x, 4);
+        u += 0x0FFF + ((u >> 13) & 1);
+        u &= 0xFFFFE000u;
+        float y;
+        std::memcpy(&y, &u, 4);
+        return y;
+#endif
+    }
+    static inline float roundBF16(float x) {
+        uint32_t u;
+        std::memcpy(&u, &x, 4);
+        if ((u & 0x7F800000u) == 0x7F800000u) return x;
+        u += 0x7FFF + ((u >> 16) & 1);
+        u &= 0xFFFF0000u;
+        float y;
+        std::memcpy(&y, &u, 4);
+        return y;
+    }
+    static inline float roundFixed(float x, float scale, int bits) {
+        const float q_max = static_cast<float>((1 << (bits - 1)) - 1);
+        float q = std::nearbyint(x / scale);
+        q = q > q_max ? q_max : (q < -q_max - 1 ? -q_max - 1 : q);
+        return q * scale;
+    }
+}
+
+class Quantizer {
+public:
+    Quantizer() = default;
+    Quantizer(NumFormat format, float scale = 1.0f): format(format), scale(scale) {}
+
+    // "fp32", "fp16", "bf16", "int8:<scale>", "int16:<scale>"
+    static bool parse(const std::string& text, Quantizer& out) {
+        std::string name = text.substr(0, text.find(':'));
+        float scale = 1.0f;
+        if (text.find(':') != std::string::npos) {
+            scale = std::stof(text.substr(text.find(':') + 1));
+        }
+        if (name == "fp32") out = Quantizer(NumFormat::FP32);
+        else if (name == "fp16") out = Quantizer(NumFormat::FP16);
+        else if (name == "bf16") out = Quantizer(NumFormat::BF16);
+        else if (name == "int8") out = Quantizer(NumFormat::INT8, scale);
+        else if (name == "int16") out = Quantizer(NumFormat::INT16, scale);
+        else return false;
+        return true;
+    }
+
+    inline float operator()(float x) const {
+        switch (format) {
+            case NumFormat::FP16: return quant::roundFP16(x);
+            case NumFormat::BF16: return quant::roundBF16(x);
+            case NumFormat::INT8: return quant::roundFixed(x, scale, 8);
+            case NumFormat::INT16: return quant::roundFixed(x, scale, 16);
+            default: return x;
+        }
+    }
+    template <typename Derived>
+    void apply(Eigen::MatrixBase<Derived>& values) const {
+        if (format == NumFormat::FP32) return;
+        for (int i = 0; i < values.size(); i++) {
+            values(i) = (*this)(values(i));
+        }
+    }
+
+    bool isExact() const {
+        return format == NumFormat::FP32;
+    }
+    int bits() const {
+        switch (format) {
+            case NumFormat::FP16: case NumFormat::BF16: case NumFormat::INT16: return 16;
+            case NumFormat::INT8: return 8;
+            default: return 32;
+        }
+    }
+    std::string name() const {
+        switch (format) {
+            case NumFormat::FP16: return "fp16";
+            case NumFormat::BF16: return "bf16";
+            case NumFormat::INT8: return "int8:" + std::to_string(scale);
+            case NumFormat::INT16: return "int16:" + std::to_string(scale);
+            default: return "fp32";
+        }
+    }
+
+private:
+    NumFormat format = NumFormat::FP32;
+    float scale = 1.0f;  // Value of one LSB for fixed point
+};
+
+#endif // QUANT_HPP_
@@ -6,6 +6,8 @@
 #include <string>
 #include <memory> // It's for Ubuntu and other Linux OS using GCC
 #include <iostream>
+#include <atomic>
+#include <cmath>
 
 #include "nlohmann/json.hpp"
 
@@ -29,6 +31,11 @@ using Vec32f = Eigen::Matrix<float, 32, 1>;
 using VecXf = Eigen::VectorXf;
 using MatXf = Eigen::MatrixXf;
 
+// A packet of samples, one column per lane, stored inline
+constexpr int MAX_LANES = 16;
+template <int Rows>
+using Packet = Eigen::Matrix<float, Rows, Eigen::Dynamic, Rows == 1 ? Eigen::RowMajor : Eigen::ColMajor, Rows, MAX_LANES>;
+
 // Basic Constants
 constexpr float PI = 3.14159265358979323846f;
 constexpr float INV_PI = 0.31830988618379067154f;
@@ -45,64 +52,288 @@ inline Eigen::VectorXf stdvectorToEigenVector(std::vector<float>& stdv){
     return Eigen::Map<Eigen::VectorXf>(stdv.data(), stdv.size());
 }
 
+// Bounded FIFO between two pipeline stages. A write becomes visible to the
+// consumer in the cycle after it was made, like a register. Writes and reads
+// are stamped with the cycle of the side that made them, so each side sees
+// what the sequential stage order implies even when the two stages run on
+// different threads up to a cycle apart. Single producer, single consumer,
+// lock-free.
 template <typename T>
 class FIFO {
 public:
-    FIFO(): fifoSize(2) {}
-    FIFO(int size): fifoSize(size) {}
+    FIFO(): FIFO(2) {}
+    FIFO(int size): fifoSize(size) {
+        int capacity = 1;
+        while (capacity < 2 * size + 4) capacity <<= 1;
+        slots.resize(capacity);
+        mask = capacity - 1;
+    }
+    FIFO(const FIFO&) = delete;
+    FIFO& operator=(const FIFO&) = delete;
+
+    // Cycle counters of the producing and consuming stage. consumer_first:
+    // whether the consumer stage runs before the producer within a cycle.
+    void bind(const long long* producer, const long long* consumer, bool consumer_first) {
+        producer_cycle = producer;
+        consumer_cycle = consumer;
+        read_lag = consumer_first ? 0 : 1;
+    }
+    void reset() {
+        head.store(0, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_relaxed);
+        head_local = 0;
+        write_cycle = -1;
+        writes_in_cycle = 0;
+        for (Slot& slot : slots) slot.read = -1;
+        full_check_cnt = empty_check_cnt = full_cnt = empty_cnt = 0;
+    }
 
     bool write(T data) {
-        if (fifo.size() < fifoSize) {
-			Upd_Buffer = std::make_shared<T>(data);
+        if (producerCount() < fifoSize) {
+            Slot& slot = slots[head_local & mask];
+            slot.data = data;
+            slot.written = *producer_cycle;
+            if (write_cycle != *producer_cycle) {
+                write_cycle = *producer_cycle;
+                writes_in_cycle = 0;
+            }
+            writes_in_cycle++;
+            head.store(++head_local, std::memory_order_release);
             return true;
         }
-		puts("FIFO is full!");
-		exit(1);
+        puts("FIFO is full!");
+        exit(1);
         return false;
     }
     T read() {
-        T data;
-        if (fifo.size() > 0) {
-            data = fifo[0];
-            fifo.erase(fifo.begin());
+        if (visible()) {
+            long long t = tail.load(std::memory_order_relaxed);
+            Slot& slot = slots[t & mask];
+            T data = slot.data;
+            slot.read = *consumer_cycle;
+            tail.store(t + 1, std::memory_order_release);
             return data;
         }
-		puts("FIFO is empty!");
-		exit(1);
-        return data;
-    }
-	void update() {
-		if (Upd_Buffer != nullptr) {
-			fifo.push_back(*Upd_Buffer);
-			Upd_Buffer = nullptr;
-		}
-	}
+        puts("FIFO is empty!");
+        exit(1);
+        return T();
+    }
+    // Look at the head without reading it
+    const T& peek() {
+        if (!visible()) {
+            puts("FIFO is empty!");
+            exit(1);
+        }
+        return slots[tail.load(std::memory_order_relaxed) & mask].data;
+    }
     bool isFull() {
-		full_check_cnt++;
-		if (fifo.size() == fifoSize) full_cnt++;
-        return fifo.size() == fifoSize;
+        full_check_cnt++;
+        bool full = producerCount() >= fifoSize;
+        if (full) full_cnt++;
+        return full;
     }
     bool isEmpty() {
-		empty_check_cnt++;
-		if (fifo.size() == 0) empty_cnt++;
-        return fifo.size() == 0;
+        empty_check_cnt++;
+        bool empty = !visible();
+        if (empty) empty_cnt++;
+        return empty;
+    }
+    // Entries in the FIFO, including writes not yet visible to the consumer
+    long long getCount() const {
+        return head.load(std::memory_order_relaxed) - tail.load(std::memory_order_relaxed);
+    }
+    int getCapacity() const {
+        return fifoSize;
+    }
+    // isFull()/isEmpty() calls, and how many of them found the FIFO full/empty
+    void getCheckCounts(long long& full_checks, long long& full, long long& empty_checks, long long& empty) const {
+        full_checks = full_check_cnt;
+        full = full_cnt;
+        empty_checks = empty_check_cnt;
+        empty = empty_cnt;
+    }
+    // Entries written since the last reset
+    long long getWrites() const {
+        return head.load(std::memory_order_relaxed);
+    }
+    // Checkpoint of a FIFO between cycles. Every slot keeps its cycle stamps,
+    // only the entries not read yet keep their data.
+    template <typename Writer>
+    void save(Writer& out) const {
+        long long h = head.load(std::memory_order_relaxed), t = tail.load(std::memory_order_relaxed);
+        out.put(static_cast<long long>(slots.size()));
+        out.put(h);
+        out.put(t);
+        out.put(write_cycle);
+        out.put(writes_in_cycle);
+        out.put(full_check_cnt);
+        out.put(full_cnt);
+        out.put(empty_check_cnt);
+        out.put(empty_cnt);
+        for (const Slot& slot : slots) {
+            out.put(slot.written);
+            out.put(slot.read);
+        }
+        for (long long i = t; i < h; i++) out.putValue(slots[i & mask].data);
+    }
+    template <typename Reader>
+    void load(Reader& in) {
+        long long size = 0, h = 0, t = 0;
+        in.get(size);
+        in.get(h);
+        in.get(t);
+        in.expect(size == static_cast<long long>(slots.size()) && t <= h && h - t <= fifoSize);
+        if (!in.ok()) return;
+        head.store(h, std::memory_order_relaxed);
+        tail.store(t, std::memory_order_relaxed);
+        head_local = h;
+        in.get(write_cycle);
+        in.get(writes_in_cycle);
+        in.get(full_check_cnt);
+        in.get(full_cnt);
+        in.get(empty_check_cnt);
+        in.get(empty_cnt);
+        for (Slot& slot : slots) {
+            in.get(slot.written);
+            in.get(slot.read);
+        }
+        for (long long i = t; i < h; i++) in.getValue(slots[i & mask].data);
     }
     void printFIFO() {
-        printf("Size: %d / %d\n", fifo.size(), fifoSize);
-		printf("Full Check: %d / %d = %f\n", full_cnt, full_check_cnt, (float)full_cnt / full_check_cnt);
-		printf("Empty Check: %d / %d = %f\n", empty_cnt, empty_check_cnt, (float)empty_cnt / empty_check_cnt);
-	}
+        printf("Size: %lld / %d\n", head.load() - tail.load(), fifoSize);
+        printf("Full Check: %d / %d = %f\n", full_cnt, full_check_cnt, (float)full_cnt / full_check_cnt);
+        printf("Empty Check: %d / %d = %f\n", empty_cnt, empty_check_cnt, (float)empty_cnt / empty_check_cnt);
+    }
 
 private:
+    struct Slot {
+        T data;
+        long long written = -1;  // Cycle of the write
+        long long read = -1;     // Cycle of the read
+    };
     int fifoSize;
-	std::shared_ptr<T> Upd_Buffer = nullptr;
-    std::vector<T> fifo;
+    std::vector<Slot> slots;
+    long long mask;
+    const long long* producer_cycle = nullptr;
+    const long long* consumer_cycle = nullptr;
+    int read_lag = 1;
+
+    // Written entries, and entries read by the consumer
+    alignas(64) std::atomic<long long> head{0};
+    alignas(64) std::atomic<long long> tail{0};
+    // Producer side
+    alignas(64) long long head_local = 0;
+    long long write_cycle = -1;
+    int writes_in_cycle = 0;
+    int full_check_cnt = 0, full_cnt = 0;
+    // Consumer side
+    alignas(64) int empty_check_cnt = 0;
+    int empty_cnt = 0;
 
-	// For Debug
-	int full_check_cnt = 0, empty_check_cnt = 0;
-	int full_cnt = 0, empty_cnt = 0;
+    // The oldest entry was written before the consumer's cycle
+    bool visible() {
+        long long t = tail.load(std::memory_order_relaxed);
+        return t < head.load(std::memory_order_acquire) && slots[t & mask].written < *consumer_cycle;
+    }
+    // Entries as the producer sees them: its writes of earlier cycles minus
+    // the reads the consumer made up to the cycle it is evaluated before
+    long long producerCount() {
+        long long cycle = *producer_cycle;
+        long long written = head_local - (write_cycle == cycle ? writes_in_cycle : 0);
+        long long last = cycle - read_lag;
+        long long t = tail.load(std::memory_order_acquire);
+        while (t > 0 && slots[(t - 1) & mask].read > last) t--;
+        return written - t;
+    }
 };
 
+// Sequence number of a sample packet. Tags wrap around, so they are only
+// compared through their unsigned difference.
+using Tag = uint32_t;
+
+// Window of in-flight entries indexed by a sequential tag. Tags in
+// [base, base + size) map to the slots following base's; entries may arrive
+// and be released in any order, and base moves past released tags in order.
+template <typename T>
+class ReorderBuffer {
+public:
+    void reset(int capacity) {
+        size = capacity;
+        base = 0;
+        base_slot = 0;
+        count = 0;
+        slots.assign(capacity, T());
+        state.assign(capacity, EMPTY);
+    }
+    bool inWindow(Tag tag) const {
+        return tag - base < static_cast<Tag>(size);
+    }
+    bool contains(Tag tag) const {
+        return inWindow(tag) && state[slot(tag)] == PRESENT;
+    }
+    // Existing entry of a tag in the window, or a fresh one
+    T& get(Tag tag) {
+        int s = slot(tag);
+        if (state[s] != PRESENT) {
+            slots[s] = T();
+            state[s] = PRESENT;
+            count++;
+        }
+        return slots[s];
+    }
+    void release(Tag tag) {
+        state[slot(tag)] = RELEASED;
+        count--;
+        while (state[base_slot] == RELEASED) {
+            state[base_slot] = EMPTY;
+            base++;
+            base_slot = base_slot + 1 == size ? 0 : base_slot + 1;
+        }
+    }
+    Tag getBase() const {
+        return base;
+    }
+    int getCount() const {
+        return count;
+    }
+    int getSize() const {
+        return size;
+    }
+    template <typename Writer>
+    void save(Writer& out) const {
+        out.put(size);
+        out.put(base);
+        out.put(base_slot);
+        out.put(count);
+        out.putVector(slots);
+        out.putVector(state);
+    }
+    template <typename Reader>
+    void load(Reader& in) {
+        int saved_size = 0;
+        in.get(saved_size);
+        in.expect(saved_size == size);
+        in.get(base);
+        in.get(base_slot);
+        in.get(count);
+        in.getVector(slots);
+        in.getVector(state);
+        in.expect(static_cast<int>(slots.size()) == size && static_cast<int>(state.size()) == size &&
+            base_slot >= 0 && base_slot < std::max(size, 1));
+    }
+
+private:
+    enum SlotState : char { EMPTY, PRESENT, RELEASED };
+    int size = 0, base_slot = 0, count = 0;
+    Tag base = 0;
+    std::vector<T> slots;
+    std::vector<SlotState> state;
+
+    int slot(Tag tag) const {
+        int s = base_slot + static_cast<int>(tag - base);
+        return s >= size ? s - size : s;
+    }
+};
 
 namespace utils {
 
@@ -155,6 +386,17 @@ namespace utils {
 				((exponent == 0)&(mantissa != 0)) * ((v - 37) << 23|((mantissa << (150-v)) & 0x007FE000)));
 	}
 
+	// Inverse of from_int_to_float16, rounding to nearest even
+	static uint32_t from_float_to_int16(float f){
+		const uint32_t sign = (as_uint(f) >> 16) & 0x8000;
+		const float a = std::fabs(f);
+		if (!(a < 65520.0f)) return sign | 0x7C00;
+		if (a < 6.103515625e-05f) return sign | static_cast<uint32_t>(std::nearbyint(a * 16777216.0f));
+		uint32_t u = as_uint(a);
+		u += 0x0FFF + ((u >> 13) & 1);
+		return sign | (((u >> 23) - 112) << 10) | ((u >> 13) & 0x03FF);
+	}
+
 	static inline int inv_Part_1_By_2(int x){
 			x = ((x >> 2) | x) & 0x030C30C3;
 			x = ((x >> 4) | x) & 0x0300F00F;
@@ -1,84 +1,58 @@
 #include "NGP_Simulator.hpp"
+#include "options.hpp"
+#include "server.hpp"
 #include <iostream>
-#include <fstream>
 #include <chrono>
 #include <string>
+#include <vector>
 
 
-std::string PATH = "./configs/base.json";
-int RESOLITION = 800;
-std::string NAME = "lego";
-std::string DATA_PATH;
-int ID = 0;
-int FREQUENCY = 100;
-int max_t_count = 1024;
-
 int main(int argc, char** argv) {
-    std::cout << "Running Scene " << NAME << std::endl;
-
-    nlohmann::json configs, camera_configs;
-
-    if (argc > 1) {
-        NAME = argv[1];
-    }
-    if (argc > 2) {
-        FREQUENCY = std::stoi(argv[2]);
+    // Usage: ./main [scene] [frequency] [max_t_count] [--sample ratio] [--seed n] [--validate]
+    //              [--view n] [--config path] [--output path]
+    //              [--profile] [--progress seconds] [--max-cycles n] [--time-limit seconds]
+    //              [--resolution n] [--stream tile_size]
+    //              [--ray-buffer slots] [--quant stage=format,...] [--quant-reference]
+    //              [--prune threshold] [--sparsity target] [--pe-array PExMACs]
+    //              [--approx unit=config,...] [--sh-per-ray]
+    //              [--rob join:vr] [--hash-miss rate:latency:outstanding]
+    //              [--parallel] [--validate-parallel] [--lanes width]
+    //              [--march constant|cone:angle:max_steps|occupancy:levels] [--march-rate steps]
+    //              [--hash-analysis banks[:ngp,morton,tiled]] [--maps directory] [--maps-raw]
+    //              [--energy default|table.json] [--target-fps fps] [--bottleneck]
+    //              [--checkpoint file] [--checkpoint-interval seconds] [--resume file]
+    //              [--serve socket|-] [--workers n] [--cache scenes]
+    RunOptions options;
+    if (!parseArguments(std::vector<std::string>(argv + 1, argv + argc), options)) {
+        exit(1);
     }
-    if (argc > 3) {
-        max_t_count = std::stoi(argv[3]);
+    if (!options.serve.empty()) {
+        return serve(options);
     }
-    
-    std::ifstream fin;
-    fin.open(PATH);
-    fin >> configs;
-    fin.close();
-    printf("Read Configs from [%s]\n", PATH.c_str());
-
-    DATA_PATH = "./data/nerf_synthetic/" + NAME + "/" + "transforms_test.json";
-    fin.open(DATA_PATH);
-    fin >> camera_configs;
-    fin.close();
-    puts("Cameara Configs Loaded");
-
-    /* Generate Camera and Image */
-    std::shared_ptr<Image> img = 
-        std::make_shared<Image>(RESOLITION, RESOLITION);
-    std::shared_ptr<Camera> camera =
-        std::make_shared<Camera>(
-            camera_configs, img, ID
-        );
+    std::cout << "Running Scene " << options.scene << std::endl;
+    auto load_start = std::chrono::steady_clock::now();
 
-    /* Generate NGP Runner */
-    std::shared_ptr<OccupancyGrid> ocgrid =
-        std::make_shared<OccupancyGrid>(
-            128, -0.5, 1.5
-        );
-    // Two MLP
-    std::shared_ptr<MLP> sigma_mlp =
-        std::make_shared<MLP>(
-            32, 16, configs.at("network")
-        );
-    std::shared_ptr<MLP> color_mlp =
-        std::make_shared<MLP>(
-            32, 16, configs.at("rgb_network")
-        );
-    // Hash Encoding
-    std::shared_ptr<HashEncoding> hashenc =
-        std::make_shared<HashEncoding>(
-            configs.at("encoding")
-        );
-    // SH Encoding
-    std::shared_ptr<SHEncoding> shenc =
-        std::make_shared<SHEncoding>(
-            configs.at("dir_encoding").at("nested")[0]
+    SceneModel model;
+    if (!loadSceneModel(options.config_path, options.scene, model)) {
+        exit(1);
+    }
+    // Invalid configs, snapshots and checkpoints are thrown
+    try {
+        std::unique_ptr<Simulator> sim = createSimulator(options, model);
+        if (sim == nullptr) {
+            exit(1);
+        }
+        sim->addConfigLoadTime(
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - load_start).count()
         );
-    
-    Simulator sim(
-        NAME, camera, ocgrid, sigma_mlp, color_mlp, hashenc, shenc, max_t_count
-    );
-    sim.setSimulationFrequency(FREQUENCY);
-    sim.loadParameters("./snapshots/Hash19_Float/" + NAME + ".msgpack");
-    sim.render();
-    sim.printHistory();
+        sim->loadParameters(model.snapshot_path);
+        sim->render();
+        addQuantReference(options, model, *sim);
+        sim->printHistory();
+    }
+    catch (const std::exception& e) {
+        printf("Error: %s\n", e.what());
+        exit(1);
+    }
     return 0;
-}
\ No newline at end of file
+}
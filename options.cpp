@@ -0,0 +1,389 @@
+#include "options.hpp"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+bool parseArguments(const std::vector<std::string>& args, RunOptions& options) {
+    std::vector<std::string> positional;
+    try {
+        for (size_t i = 0; i < args.size(); i++) {
+            const std::string& arg = args[i];
+            bool has_value = i + 1 < args.size();
+            if (arg == "--sample" && has_value) {
+                options.sample_ratio = std::stof(args[++i]);
+            }
+            else if (arg == "--seed" && has_value) {
+                options.seed = std::stoul(args[++i]);
+            }
+            else if (arg == "--validate") {
+                options.validate_sampling = true;
+            }
+            else if (arg == "--profile") {
+                options.profile_stages = true;
+            }
+            else if (arg == "--progress" && has_value) {
+                options.progress_interval = std::stod(args[++i]);
+            }
+            else if (arg == "--max-cycles" && has_value) {
+                options.max_cycles = std::stoll(args[++i]);
+            }
+            else if (arg == "--time-limit" && has_value) {
+                options.time_limit = std::stod(args[++i]);
+            }
+            else if (arg == "--resolution" && has_value) {
+                options.resolution = std::stoi(args[++i]);
+            }
+            else if (arg == "--view" && has_value) {
+                options.view = std::stoi(args[++i]);
+            }
+            else if (arg == "--config" && has_value) {
+                options.config_path = args[++i];
+            }
+            else if (arg == "--output" && has_value) {
+                options.output = args[++i];
+            }
+            else if (arg == "--stream" && has_value) {
+                options.stream_tile = std::stoi(args[++i]);
+            }
+            else if (arg == "--ray-buffer" && has_value) {
+                options.ray_buffer_size = std::stoi(args[++i]);
+                if (options.ray_buffer_size < 1) {
+                    printf("Invalid ray buffer size [%d], expected at least 1\n", options.ray_buffer_size);
+                    return false;
+                }
+            }
+            else if (arg == "--quant" && has_value) {
+                options.quant_formats = args[++i];
+            }
+            else if (arg == "--quant-reference") {
+                options.quant_reference = true;
+            }
+            else if (arg == "--rob" && has_value) {
+                if (sscanf(args[++i].c_str(), "%d:%d", &options.join_rob, &options.vr_rob) != 2 ||
+                    options.join_rob < 0 || options.vr_rob < 0) {
+                    printf("Invalid reorder buffers [%s], expected <join>:<vr>\n", args[i].c_str());
+                    return false;
+                }
+            }
+            else if (arg == "--hash-miss" && has_value) {
+                if (sscanf(args[++i].c_str(), "%f:%d:%d", &options.hash_miss_rate, &options.hash_miss_latency,
+                        &options.hash_outstanding) != 3 ||
+                    options.hash_miss_latency < 1 || options.hash_outstanding < 1) {
+                    printf("Invalid hash miss model [%s], expected <rate>:<latency>:<outstanding>\n", args[i].c_str());
+                    return false;
+                }
+            }
+            else if (arg == "--parallel") {
+                options.parallel = true;
+            }
+            else if (arg == "--validate-parallel") {
+                options.parallel = true;
+                options.validate_parallel = true;
+            }
+            else if (arg == "--lanes" && has_value) {
+                options.lanes = std::stoi(args[++i]);
+                if (options.lanes < 1 || options.lanes > MAX_LANES) {
+                    printf("Invalid lanes [%d], expected 1 to %d\n", options.lanes, MAX_LANES);
+                    return false;
+                }
+            }
+            else if (arg == "--march" && has_value) {
+                options.march_policy = args[++i];
+            }
+            else if (arg == "--march-rate" && has_value) {
+                options.march_rate = std::stoi(args[++i]);
+                if (options.march_rate < 0) {
+                    printf("Invalid march rate [%d]\n", options.march_rate);
+                    return false;
+                }
+            }
+            else if (arg == "--hash-analysis" && has_value) {
+                options.hash_analysis = args[++i];
+            }
+            else if (arg == "--maps" && has_value) {
+                options.cost_maps = args[++i];
+            }
+            else if (arg == "--maps-raw") {
+                options.cost_maps_raw = true;
+            }
+            else if (arg == "--energy" && has_value) {
+                options.energy_table = args[++i];
+            }
+            else if (arg == "--target-fps" && has_value) {
+                options.target_fps = std::stod(args[++i]);
+            }
+            else if (arg == "--bottleneck") {
+                options.bottleneck = true;
+            }
+            else if (arg == "--sh-per-ray") {
+                options.sh_per_ray = true;
+            }
+            else if (arg == "--sh-latency" && has_value) {
+                options.sh_latency = std::stoi(args[++i]);
+                if (options.sh_latency < 1) {
+                    printf("Invalid SH latency [%d]\n", options.sh_latency);
+                    return false;
+                }
+            }
+            else if (arg == "--approx" && has_value) {
+                options.approx_units = args[++i];
+            }
+            else if (arg == "--prune" && has_value) {
+                options.prune_threshold = std::stof(args[++i]);
+            }
+            else if (arg == "--sparsity" && has_value) {
+                options.prune_sparsity = std::stof(args[++i]);
+            }
+            else if (arg == "--pe-array" && has_value) {
+                if (sscanf(args[++i].c_str(), "%dx%d", &options.pe_count, &options.pe_macs) != 2 ||
+                    options.pe_count <= 0 || options.pe_macs <= 0) {
+                    printf("Invalid PE array [%s], expected <PEs>x<MACs>\n", args[i].c_str());
+                    return false;
+                }
+            }
+            else if (arg == "--checkpoint" && has_value) {
+                options.checkpoint = args[++i];
+            }
+            else if (arg == "--checkpoint-interval" && has_value) {
+                options.checkpoint_interval = std::stod(args[++i]);
+            }
+            else if (arg == "--resume" && has_value) {
+                options.resume = args[++i];
+            }
+            else if (arg == "--serve" && has_value) {
+                options.serve = args[++i];
+            }
+            else if (arg == "--workers" && has_value) {
+                options.workers = std::stoi(args[++i]);
+            }
+            else if (arg == "--cache" && has_value) {
+                options.cache_size = std::stoi(args[++i]);
+                if (options.cache_size < 1) {
+                    printf("Invalid cache size [%d]\n", options.cache_size);
+                    return false;
+                }
+            }
+            else if (arg.rfind("--", 0) == 0) {
+                printf("Unknown argument [%s]\n", arg.c_str());
+                return false;
+            }
+            else {
+                positional.push_back(arg);
+            }
+        }
+        if (positional.size() > 0) {
+            options.scene = positional[0];
+        }
+        if (positional.size() > 1) {
+            options.frequency = std::stoi(positional[1]);
+        }
+        if (positional.size() > 2) {
+            options.max_t_count = std::stoi(positional[2]);
+        }
+    }
+    catch (const std::exception&) {
+        puts("Invalid numeric argument");
+        return false;
+    }
+    if (options.resolution < 1 || options.view < 0 || options.frequency < 1 || options.max_t_count < 1) {
+        puts("Error: resolution, frequency and max_t_count must be positive and the view non-negative");
+        return false;
+    }
+    return true;
+}
+
+bool loadSceneModel(const std::string& config_path, const std::string& scene, SceneModel& model) {
+    std::ifstream fin(config_path);
+    if (!fin) {
+        printf("Cannot open configs [%s]\n", config_path.c_str());
+        return false;
+    }
+    fin >> model.configs;
+    fin.close();
+    printf("Read Configs from [%s]\n", config_path.c_str());
+
+    model.data_dir = "./data/nerf_synthetic/" + scene + "/";
+    std::string camera_path = model.data_dir + "transforms_test.json";
+    fin.open(camera_path);
+    if (!fin) {
+        printf("Cannot open cameras [%s]\n", camera_path.c_str());
+        return false;
+    }
+    fin >> model.camera_configs;
+    fin.close();
+    puts("Cameara Configs Loaded");
+    model.snapshot_path = "./snapshots/Hash19_Float/" + scene + ".msgpack";
+    return true;
+}
+
+std::unique_ptr<Simulator> createSimulator(const RunOptions& options, const SceneModel& model,
+    const Simulator::Modules* modules) {
+    const nlohmann::json& configs = model.configs;
+    if (options.view >= static_cast<int>(model.camera_configs.at("frames").size())) {
+        printf("Invalid view [%d], the scene has %zu\n", options.view, model.camera_configs.at("frames").size());
+        return nullptr;
+    }
+
+    /* Generate Camera and Image */
+    std::shared_ptr<Image> img =
+        std::make_shared<Image>(options.resolution, options.resolution, options.stream_tile == 0);
+    std::shared_ptr<Camera> camera =
+        std::make_shared<Camera>(
+            model.camera_configs, img, options.view
+        );
+
+    /* Generate NGP Runner, shared modules are already loaded */
+    std::shared_ptr<OccupancyGrid> ocgrid;
+    std::shared_ptr<MLP> sigma_mlp, color_mlp;
+    std::shared_ptr<HashEncoding> hashenc;
+    if (modules == nullptr) {
+        ocgrid =
+            std::make_shared<OccupancyGrid>(
+                128, -0.5, 1.5
+            );
+        // Two MLP
+        sigma_mlp =
+            std::make_shared<MLP>(
+                32, 16, configs.at("network")
+            );
+        color_mlp =
+            std::make_shared<MLP>(
+                32, 16, configs.at("rgb_network")
+            );
+        // Hash Encoding
+        hashenc =
+            std::make_shared<HashEncoding>(
+                configs.at("encoding")
+            );
+    }
+    // SH Encoding
+    std::shared_ptr<SHEncoding> shenc =
+        std::make_shared<SHEncoding>(
+            configs.at("dir_encoding").at("nested")[0]
+        );
+
+    std::unique_ptr<Simulator> sim = std::make_unique<Simulator>(
+        options.scene, camera, ocgrid, sigma_mlp, color_mlp, hashenc, shenc, options.max_t_count
+    );
+    sim->setProfiling(options.profile_stages, options.progress_interval);
+    sim->setLimits(options.max_cycles, options.time_limit);
+    sim->setSimulationFrequency(options.frequency);
+    sim->setSampling(options.sample_ratio, 64, options.seed, options.validate_sampling);
+    if (options.output.empty()) sim->setStreaming(options.stream_tile);
+    else sim->setStreaming(options.stream_tile, options.output);
+    if (!options.output.empty() && options.stream_tile == 0) sim->setOutput(options.output);
+    sim->setRayBufferSize(options.ray_buffer_size);
+    sim->setSHPerRay(options.sh_per_ray, options.sh_latency);
+    sim->setParallel(options.parallel, options.validate_parallel);
+    sim->setLanes(options.lanes);
+    MarchPolicy march;
+    if (!MarchPolicy::parse(options.march_policy, march)) {
+        printf("Invalid march policy [%s], expected constant, cone:<angle>:<max steps> or occupancy:<levels>\n",
+            options.march_policy.c_str());
+        return nullptr;
+    }
+    sim->setMarching(march, options.march_rate);
+    if (!options.hash_analysis.empty()) {
+        int banks;
+        std::vector<HashFunction> functions;
+        if (!HashAnalysis::parse(options.hash_analysis, banks, functions)) {
+            printf("Invalid hash analysis [%s], expected <banks>[:ngp,morton,tiled]\n", options.hash_analysis.c_str());
+            return nullptr;
+        }
+        sim->setHashAnalysis(banks, functions);
+    }
+    sim->setCostMaps(options.cost_maps, !options.cost_maps_raw);
+    sim->setBottleneckAnalysis(options.bottleneck);
+    sim->setCheckpoint(options.checkpoint, options.checkpoint_interval, options.resume);
+    if (!options.energy_table.empty() || options.target_fps > 0) {
+        EnergyTable table;
+        if (!options.energy_table.empty() && options.energy_table != "default" &&
+            !EnergyTable::load(options.energy_table, table)) {
+            return nullptr;
+        }
+        sim->setEnergy(table, options.target_fps);
+    }
+    if (options.hash_miss_rate > 0.0f &&
+        (options.join_rob < options.hash_outstanding || options.vr_rob < options.hash_outstanding)) {
+        puts("Error: Hash misses complete out of order, reorder buffers must hold the outstanding lookups");
+        return nullptr;
+    }
+    sim->setReorderBuffers(options.join_rob, options.vr_rob);
+    sim->setHashMissModel(options.hash_miss_rate, options.hash_miss_latency, options.hash_outstanding, options.seed);
+    // Stages: hash, interp, mlp, accum, vr. Formats: fp32, fp16, bf16, int8:<lsb>, int16:<lsb>
+    Simulator::Quantization quant;
+    std::stringstream quant_list(options.quant_formats);
+    std::string item;
+    while (std::getline(quant_list, item, ',')) {
+        std::string stage = item.substr(0, item.find('='));
+        Quantizer format;
+        if (item.find('=') == std::string::npos ||
+            !Quantizer::parse(item.substr(item.find('=') + 1), format)) {
+            printf("Invalid quantization [%s]\n", item.c_str());
+            return nullptr;
+        }
+        if (stage == "hash") quant.hash_table = format;
+        else if (stage == "interp") quant.hash_interp = format;
+        else if (stage == "mlp") quant.mlp_weights = format;
+        else if (stage == "accum") quant.mlp_accum = format;
+        else if (stage == "vr") quant.volume = format;
+        else {
+            printf("Unknown quantization stage [%s]\n", stage.c_str());
+            return nullptr;
+        }
+    }
+    sim->setQuantization(quant);
+    // Units: density, alpha, sigmoid. Configs: exact, lut|pwl|cordic:<size>:<bits>:<latency>
+    Simulator::Approximation approx;
+    std::stringstream approx_list(options.approx_units);
+    while (std::getline(approx_list, item, ',')) {
+        std::string unit = item.substr(0, item.find('='));
+        std::string config = item.find('=') == std::string::npos ? "" : item.substr(item.find('=') + 1);
+        ApproxFunc func = unit == "sigmoid" ? ApproxFunc::SIGMOID : ApproxFunc::EXP;
+        ApproxUnit* target = unit == "density" ? &approx.density_exp :
+            unit == "alpha" ? &approx.alpha_exp : unit == "sigmoid" ? &approx.sigmoid : nullptr;
+        if (target == nullptr) {
+            printf("Unknown approximation unit [%s]\n", unit.c_str());
+            return nullptr;
+        }
+        if (!ApproxUnit::parse(config, func, *target)) {
+            printf("Invalid approximation [%s]\n", item.c_str());
+            return nullptr;
+        }
+    }
+    sim->setApproximation(approx);
+    if (options.prune_threshold >= 0.0f || options.prune_sparsity > 0.0f) {
+        MLP::PEArray pe;
+        pe.num_pe = options.pe_count;
+        pe.macs_per_pe = options.pe_macs;
+        sim->setPruning(std::max(options.prune_threshold, 0.0f), options.prune_sparsity, pe);
+    }
+    sim->setGroundTruth(model.data_dir + "test/r_" + std::to_string(options.view) + ".png");
+    if (modules != nullptr) sim->useModules(*modules);
+    return sim;
+}
+
+void addQuantReference(const RunOptions& options, const SceneModel& model, Simulator& sim) {
+    float psnr;
+    if (!options.quant_reference || options.quant_formats.empty() || !sim.getPSNR(psnr)) return;
+    // Only the formats change, the frame is rendered whole and sequentially
+    RunOptions reference = options;
+    reference.quant_formats.clear();
+    reference.output.clear();
+    reference.stream_tile = 0;
+    reference.sample_ratio = 0.0f;
+    reference.validate_sampling = false;
+    reference.parallel = reference.validate_parallel = false;
+    reference.hash_analysis.clear();
+    reference.cost_maps.clear();
+    reference.bottleneck = false;
+    reference.checkpoint.clear();
+    reference.resume.clear();
+    puts("Reference run with fp32 formats");
+    std::unique_ptr<Simulator> fp32 = createSimulator(reference, model);
+    if (fp32 == nullptr) return;
+    fp32->setOutput("", false);
+    fp32->loadParameters(model.snapshot_path);
+    fp32->render();
+    if (fp32->getPSNR(psnr)) sim.setReferencePSNR(psnr);
+}
@@ -0,0 +1,103 @@
+#ifndef OPTIONS_HPP
+#define OPTIONS_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "NGP_Simulator.hpp"
+
+// Command line of ./main. Requests of the server use the same arguments.
+struct RunOptions {
+    std::string config_path = "./configs/base.json";
+    int resolution = 800;
+    std::string scene = "lego";
+    int view = 0;
+    int frequency = 100;
+    int max_t_count = 1024;
+    // Rendered frame, empty for output.png, or output.ppm when streaming
+    std::string output;
+    // Statistical sampling, 0 means simulate every pixel
+    float sample_ratio = 0.0f;
+    unsigned seed = 0;
+    bool validate_sampling = false;
+    // Host profiling
+    bool profile_stages = false;
+    double progress_interval = 5.0;
+    // Simulated cycles and host seconds before the run is stopped, 0 for no limit
+    long long max_cycles = 0;
+    double time_limit = 0.0;
+    // Streaming tiled rendering, 0 keeps the whole frame in memory
+    int stream_tile = 0;
+    // Slots of the on-chip ray buffer
+    int ray_buffer_size = 16;
+    // Datapath formats, e.g. "hash=fp16,mlp=int8:0.0078125,vr=bf16", and
+    // whether to rerun with fp32 everywhere for the reference PSNR
+    std::string quant_formats;
+    bool quant_reference = false;
+    // MLP pruning, a negative threshold disables it
+    float prune_threshold = -1.0f;
+    float prune_sparsity = 0.0f;
+    int pe_count = 64, pe_macs = 8;
+    // Transcendental units, e.g. "density=lut:64:12:1,alpha=pwl:16:12:1,sigmoid=cordic:16:14:4"
+    std::string approx_units;
+    // Encode SH once per ray instead of once per sample, and cycles of an SH evaluation
+    bool sh_per_ray = false;
+    int sh_latency = 1;
+    // Reorder buffer entries at the color MLP join and volume rendering, 0 joins in lockstep
+    int join_rob = 0, vr_rob = 0;
+    // Hash miss model: rate, latency and outstanding lookups
+    float hash_miss_rate = 0.0f;
+    int hash_miss_latency = 20, hash_outstanding = 8;
+    // Marching step policy and occupancy tests per cycle, 0 for unlimited
+    std::string march_policy = "constant";
+    int march_rate = 0;
+    // Samples per packet, 1 is the scalar datapath
+    int lanes = 1;
+    // One thread per pipeline stage, optionally checked against a sequential run
+    bool parallel = false;
+    bool validate_parallel = false;
+    // Hash grid access analysis: banks[:function,...], empty when off
+    std::string hash_analysis;
+    // Directory of the per-pixel float maps, empty when off
+    std::string cost_maps;
+    bool cost_maps_raw = false;
+    // Energy table, "default" for the built-in one, and the FPS to size the bandwidth for
+    std::string energy_table;
+    double target_fps = 0.0;
+    // Stage stall breakdown and what-if ranking at the end of the run
+    bool bottleneck = false;
+    // Checkpoint file and host seconds between writes, and a checkpoint to resume from
+    std::string checkpoint;
+    double checkpoint_interval = 600.0;
+    std::string resume;
+    // Server mode: Unix socket path or "-" for stdin/stdout, workers and cached scenes
+    std::string serve;
+    int workers = 0;
+    int cache_size = 4;
+};
+
+// Prints the error and returns false on an invalid argument
+bool parseArguments(const std::vector<std::string>& args, RunOptions& options);
+
+// Everything of a scene that does not depend on the hardware config
+struct SceneModel {
+    nlohmann::json configs, camera_configs;
+    std::string snapshot_path;
+    std::string data_dir;
+};
+
+bool loadSceneModel(const std::string& config_path, const std::string& scene, SceneModel& model);
+
+// Builds and configures a simulator for the options, nullptr with a message
+// if they are invalid. Parameters are loaded by the caller, unless modules
+// loaded by a simulator of the same scene and loading options are given.
+std::unique_ptr<Simulator> createSimulator(const RunOptions& options, const SceneModel& model,
+    const Simulator::Modules* modules = nullptr);
+
+// After render, with --quant-reference and --quant: renders the frame again
+// with every datapath format fp32, in memory and without writing files, and
+// gives its PSNR to sim for the quantization table
+void addQuantReference(const RunOptions& options, const SceneModel& model, Simulator& sim);
+
+#endif // OPTIONS_HPP
@@ -0,0 +1,376 @@
+#include "server.hpp"
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// A client, sent one whole line at a time
+class Connection {
+public:
+    explicit Connection(int fd): fd(fd) {}
+    ~Connection() { close(fd); }
+
+    void send(const nlohmann::json& response) {
+        std::string line = response.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace) + "\n";
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t sent = 0; sent < line.size();) {
+            ssize_t n = write(fd, line.data() + sent, line.size() - sent);
+            if (n <= 0) return;   // The client is gone, drop the response
+            sent += n;
+        }
+    }
+private:
+    int fd;
+    std::mutex mutex;
+};
+
+// Configs, cameras, decoded snapshots and loaded modules by config path and
+// scene, the least recently used scene is dropped first
+class SceneCache {
+public:
+    struct Entry {
+        std::mutex mutex;   // Held while loading
+        bool loaded = false;
+        SceneModel model;
+        std::shared_ptr<const Simulator::Snapshot> snapshot;
+        // By the options that change what loadParameters builds
+        std::unordered_map<std::string, Simulator::Modules> modules;
+    };
+
+    explicit SceneCache(int capacity): capacity(capacity) {}
+
+    std::shared_ptr<Entry> get(const std::string& key, bool& hit) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = index.find(key);
+        hit = it != index.end();
+        if (hit) {
+            order.splice(order.begin(), order, it->second);
+            hits++;
+            return it->second->second;
+        }
+        misses++;
+        order.emplace_front(key, std::make_shared<Entry>());
+        index[key] = order.begin();
+        // Running requests keep their evicted entry alive
+        while (static_cast<int>(order.size()) > capacity) {
+            index.erase(order.back().first);
+            order.pop_back();
+            evictions++;
+        }
+        return order.front().second;
+    }
+
+    nlohmann::json status() {
+        std::lock_guard<std::mutex> lock(mutex);
+        nlohmann::json scenes = nlohmann::json::array();
+        for (auto& entry : order) scenes.push_back(entry.first);
+        return {
+            {"capacity", capacity},
+            {"scenes", scenes},
+            {"hits", hits},
+            {"misses", misses},
+            {"evictions", evictions}
+        };
+    }
+private:
+    std::mutex mutex;
+    int capacity;
+    std::list<std::pair<std::string, std::shared_ptr<Entry>>> order;   // Most recent first
+    std::unordered_map<std::string, std::list<std::pair<std::string, std::shared_ptr<Entry>>>::iterator> index;
+    long long hits = 0, misses = 0, evictions = 0;
+};
+
+struct Job {
+    std::string op;
+    nlohmann::json request;
+    std::shared_ptr<Connection> connection;
+    Clock::time_point queued;
+};
+
+// Shared with the connection threads, which may outlive serve()
+struct Server {
+    RunOptions defaults;
+    SceneCache cache;
+    int workers;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<Job> queue;
+    int running = 0;
+    long long completed = 0, failed = 0;
+    bool stopping = false;
+    int listen_fd = -1;
+
+    Server(const RunOptions& defaults, int workers): defaults(defaults), cache(defaults.cache_size), workers(workers) {}
+
+    nlohmann::json run(const Job& job);
+    void work();
+    // Answers status and shutdown directly, queues runs
+    void handle(const std::string& line, const std::shared_ptr<Connection>& connection);
+    void stop();
+};
+
+nlohmann::json failure(const nlohmann::json& id, const std::string& message) {
+    return {{"id", id}, {"status", "error"}, {"error", message}};
+}
+
+// Quantized storage and pruning are applied to the modules
+std::string modulesKey(const RunOptions& options) {
+    return options.quant_formats + "|" + std::to_string(options.prune_threshold) + ":" +
+        std::to_string(options.prune_sparsity);
+}
+
+nlohmann::json Server::run(const Job& job) {
+    const nlohmann::json& request = job.request;
+    nlohmann::json id = request.value("id", nlohmann::json());
+    double queue_s = secondsSince(job.queued);
+    const std::string& op = job.op;
+    std::vector<std::string> args;
+    if (request.contains("args")) {
+        if (!request["args"].is_array()) return failure(id, "args must be an array of strings");
+        for (auto& arg : request["args"]) {
+            if (!arg.is_string()) return failure(id, "args must be an array of strings");
+            args.push_back(arg.get<std::string>());
+        }
+    }
+    RunOptions options = defaults;
+    options.output.clear();
+    if (!parseArguments(args, options)) return failure(id, "invalid arguments, see the server log");
+    if (!options.serve.empty()) return failure(id, "--serve is not allowed in a request");
+    // Limits of the server bound those of the requests
+    if (defaults.max_cycles > 0 && (options.max_cycles <= 0 || options.max_cycles > defaults.max_cycles)) {
+        options.max_cycles = defaults.max_cycles;
+    }
+    if (defaults.time_limit > 0 && (options.time_limit <= 0 || options.time_limit > defaults.time_limit)) {
+        options.time_limit = defaults.time_limit;
+    }
+    if (op == "render" && options.output.empty()) return failure(id, "render needs --output");
+    if (op == "simulate") options.output.clear();
+
+    Clock::time_point start = Clock::now();
+    bool hit;
+    std::shared_ptr<SceneCache::Entry> entry = cache.get(options.config_path + "|" + options.scene, hit);
+    std::string cached = hit ? "scene" : "miss";
+    std::unique_ptr<Simulator> sim;
+    {
+        std::lock_guard<std::mutex> lock(entry->mutex);
+        if (!entry->loaded) {
+            entry->loaded = loadSceneModel(options.config_path, options.scene, entry->model);
+            if (!entry->loaded) return failure(id, "cannot load scene [" + options.scene + "]");
+        }
+        std::string key = modulesKey(options);
+        auto modules = entry->modules.find(key);
+        bool shared = modules != entry->modules.end();
+        sim = createSimulator(options, entry->model, shared ? &modules->second : nullptr);
+        if (sim == nullptr) return failure(id, "invalid options, see the server log");
+        sim->addConfigLoadTime(secondsSince(start));
+        if (shared) {
+            cached = "hit";
+        }
+        else {
+            if (entry->snapshot == nullptr) {
+                auto decoded = std::make_shared<Simulator::Snapshot>();
+                if (!sim->readSnapshot(entry->model.snapshot_path, *decoded)) {
+                    return failure(id, "cannot read snapshot [" + entry->model.snapshot_path + "]");
+                }
+                entry->snapshot = decoded;
+            }
+            sim->loadParameters(*entry->snapshot);
+            entry->modules.emplace(key, sim->getModules());
+        }
+    }
+    // Frames and history files are only written when asked for
+    sim->setOutput(options.stream_tile == 0 ? options.output : "", false);
+    std::shared_ptr<Connection> connection = job.connection;
+    sim->setProgressCallback([id, connection](const nlohmann::json& progress) {
+        nlohmann::json line = progress;
+        line["id"] = id;
+        line["status"] = "progress";
+        connection->send(line);
+    });
+    double load_s = secondsSince(start);
+    sim->render();
+    addQuantReference(options, entry->model, *sim);
+    nlohmann::json report = sim->printHistory();
+
+    nlohmann::json response = {
+        {"id", id},
+        {"status", "ok"},
+        {"cache", cached},
+        {"queue_s", queue_s},
+        {"load_s", load_s},
+        {"run_s", secondsSince(start) - load_s},
+        {"report", report}
+    };
+    if (!options.output.empty()) response["image"] = options.output;
+    return response;
+}
+
+void Server::work() {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait(lock, [this]() { return stopping || !queue.empty(); });
+            if (queue.empty()) return;
+            job = std::move(queue.front());
+            queue.pop_front();
+            running++;
+        }
+        nlohmann::json response;
+        try {
+            response = run(job);
+        }
+        catch (const std::exception& e) {
+            response = failure(job.request.value("id", nlohmann::json()), e.what());
+        }
+        job.connection->send(response);
+        std::lock_guard<std::mutex> lock(mutex);
+        running--;
+        if (response["status"] == "ok") completed++;
+        else failed++;
+    }
+}
+
+void Server::handle(const std::string& line, const std::shared_ptr<Connection>& connection) {
+    if (line.find_first_not_of(" \t\r") == std::string::npos) return;
+    nlohmann::json request = nlohmann::json::parse(line, nullptr, false);
+    if (request.is_discarded() || !request.is_object()) {
+        connection->send(failure(nullptr, "request is not a JSON object"));
+        return;
+    }
+    nlohmann::json id = request.value("id", nlohmann::json());
+    std::string op = request.contains("op") && request["op"].is_string() ? request["op"].get<std::string>() : "simulate";
+    if (op == "status") {
+        nlohmann::json response = {{"id", id}, {"status", "ok"}, {"workers", workers}, {"cache", cache.status()}};
+        std::lock_guard<std::mutex> lock(mutex);
+        response["queued"] = queue.size();
+        response["running"] = running;
+        response["completed"] = completed;
+        response["failed"] = failed;
+        connection->send(response);
+    }
+    else if (op == "shutdown") {
+        connection->send({{"id", id}, {"status", "ok"}});
+        stop();
+    }
+    else if (op == "simulate" || op == "render") {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping) {
+            connection->send(failure(id, "server is shutting down"));
+            return;
+        }
+        queue.push_back(Job{op, request, connection, Clock::now()});
+        ready.notify_one();
+    }
+    else {
+        connection->send(failure(id, "unknown op [" + op + "], expected simulate, render, status or shutdown"));
+    }
+}
+
+// Queued runs still finish, new ones are refused
+void Server::stop() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stopping) return;
+    stopping = true;
+    ready.notify_all();
+    if (listen_fd >= 0) shutdown(listen_fd, SHUT_RDWR);
+}
+
+// Splits the stream into lines until the client closes it
+void readLines(int fd, const std::shared_ptr<Server>& server, const std::shared_ptr<Connection>& connection) {
+    std::string buffer;
+    char chunk[4096];
+    ssize_t n;
+    while ((n = read(fd, chunk, sizeof(chunk))) > 0) {
+        buffer.append(chunk, n);
+        size_t start = 0, end;
+        while ((end = buffer.find('\n', start)) != std::string::npos) {
+            server->handle(buffer.substr(start, end - start), connection);
+            start = end + 1;
+        }
+        buffer.erase(0, start);
+    }
+    if (!buffer.empty()) server->handle(buffer, connection);
+}
+
+} // namespace
+
+int serve(const RunOptions& options) {
+    int workers = options.workers > 0 ? options.workers : std::max(1u, std::thread::hardware_concurrency());
+    auto server = std::make_shared<Server>(options, workers);
+    server->defaults.serve.clear();
+
+    bool use_stdio = options.serve == "-";
+    int response_fd = -1;
+    if (use_stdio) {
+        // Keep stdout for the responses and send the simulator log to stderr
+        std::cout.flush();
+        fflush(stdout);
+        response_fd = dup(STDOUT_FILENO);
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+    }
+    else {
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if (options.serve.size() >= sizeof(address.sun_path)) {
+            printf("Socket path too long [%s]\n", options.serve.c_str());
+            exit(1);
+        }
+        options.serve.copy(address.sun_path, sizeof(address.sun_path) - 1);
+        server->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        unlink(options.serve.c_str());
+        if (server->listen_fd < 0 ||
+            bind(server->listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+            listen(server->listen_fd, 16) != 0) {
+            printf("Cannot listen on [%s]\n", options.serve.c_str());
+            exit(1);
+        }
+    }
+    // A client closing early must not end the server
+    signal(SIGPIPE, SIG_IGN);
+    fprintf(stderr, "Serving on [%s] with %d workers, caching %d scenes\n",
+        use_stdio ? "stdin" : options.serve.c_str(), workers, options.cache_size);
+
+    std::vector<std::thread> pool;
+    for (int i = 0; i < workers; i++) pool.emplace_back([server]() { server->work(); });
+
+    if (use_stdio) {
+        auto connection = std::make_shared<Connection>(response_fd);
+        readLines(STDIN_FILENO, server, connection);
+        server->stop();
+    }
+    else {
+        while (true) {
+            int fd = accept(server->listen_fd, nullptr, nullptr);
+            if (fd < 0) {
+                std::lock_guard<std::mutex> lock(server->mutex);
+                if (server->stopping) break;
+                continue;
+            }
+            auto connection = std::make_shared<Connection>(fd);
+            std::thread(readLines, fd, server, connection).detach();
+        }
+        close(server->listen_fd);
+        unlink(options.serve.c_str());
+    }
+    for (auto& worker : pool) worker.join();
+    return 0;
+}
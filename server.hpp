@@ -0,0 +1,24 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include "options.hpp"
+
+// Long-running simulation server. Requests are JSON lines on a Unix socket,
+// or on stdin when options.serve is "-" (the simulator log then goes to
+// stderr and stdout carries only responses):
+//   {"id": 1, "op": "simulate", "args": ["lego", "100", "64", "--lanes", "4"]}
+//   {"id": 2, "op": "render", "args": ["lego", "--view", "3", "--output", "v3.png"]}
+//   {"id": 3, "op": "status"}    {"op": "shutdown"}
+// args are the command line of ./main on top of the server's own options,
+// whose --max-cycles and --time-limit also cap those of every request.
+// Runs execute on a pool of workers. Every --progress seconds a running
+// request gets {"id", "status": "progress", "elapsed_s", "cycle_count", ...},
+// and it is answered when it finishes with
+// {"id", "status": "ok", "report", "cache", "queue_s", "load_s", "run_s"[, "image"]}
+// or {"id", "status": "error", "error"}. Configs, cameras, decoded snapshots
+// and the loaded modules of the most recently used scenes stay in memory.
+// "cache" is "hit" when the modules were shared, "scene" when only the scene
+// was cached and "miss" otherwise.
+int serve(const RunOptions& options);
+
+#endif // SERVER_HPP
@@ -2,13 +2,24 @@ add_languages("c++17")
 
 add_rules("mode.release")
 local depends = {
-    "eigen", "stb", "nlohmann_json"
+    "eigen", "stb", "nlohmann_json", "openmp"
 }
 add_requires(depends)
 
+-- fp16 rounding of the quantized datapath (Utils/quant.hpp) uses F16C when
+-- the compiler and target support it, the software rounding otherwise
+option("f16c")
+    set_showmenu(true)
+    set_description("Emulate fp16 with F16C instructions")
+    add_cxxflags("-mf16c")
+    add_cxxsnippets("f16c", "#include <immintrin.h>\nint test() { return _cvtss_sh(1.0f, 0); }")
+option_end()
+add_options("f16c")
+
 
 target("NGP-Simulator")
     add_packages(depends, {public = true})
+    add_syslinks("pthread", {public = true})
     set_kind("static")
    
     add_includedirs({
@@ -17,7 +28,10 @@ target("NGP-Simulator")
         "Modules/MLP",
         "Modules/SHEncoding",
         "Utils/",
-        "Utils/Image"
+        "Utils/Image",
+        "Utils/Metrics",
+        "Utils/Approx",
+        "Utils/Energy"
         }, {public = true}
     )
     add_files({
@@ -25,14 +39,51 @@ target("NGP-Simulator")
         "Modules/HashEncoding/*.cpp",
         "Modules/MLP/*.cpp",
         "Utils/Image/image.cpp",
+        "Utils/Metrics/metrics.cpp",
+        "Utils/Approx/approx.cpp",
+        "Utils/Energy/energy.cpp",
         "Modules/SHEncoding/*.cpp"
     })
     add_files("NGP_Simulator.cpp")
 
 target("main")
     set_kind("binary")
-    add_files("main.cpp")
+    add_files("main.cpp", "options.cpp", "server.cpp")
 
     add_deps("NGP-Simulator")
 
     set_targetdir(".")
+
+target("bench")
+    set_kind("binary")
+    set_default(false)
+    add_files("Bench/micro.cpp")
+
+    add_deps("NGP-Simulator")
+
+    set_targetdir(".")
+
+target("bench-e2e")
+    set_kind("binary")
+    set_default(false)
+    add_files("Bench/e2e.cpp")
+    add_packages("nlohmann_json")
+
+    set_targetdir(".")
+
+target("gen-scene")
+    set_kind("binary")
+    set_default(false)
+    add_files("Tools/gen_scene.cpp")
+
+    add_deps("NGP-Simulator")
+
+    set_targetdir(".")
+
+target("autotune")
+    set_kind("binary")
+    set_default(false)
+    add_files("Tools/autotune.cpp")
+    add_packages("nlohmann_json")
+
+    set_targetdir(".")